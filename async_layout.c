@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define LAY_IMPLEMENTATION
+#include "layout.h"
+#define LAY_ASYNC_IMPLEMENTATION
+#include "layout_async.h"
+
+// Checks the asynchronous layout jobs in layout_async.h against running the
+// same layouts synchronously.
+//
+// Each frame builds a slightly different tree into one context and submits it
+// with LAY_ASYNC_COPY, then goes on to build the next frame while up to
+// LASYNC_IN_FLIGHT jobs are computed, the way an application keeps handling
+// input. Finished jobs are found with lay_async_poll and compared to a
+// synchronous run of the same frame. Jobs are also submitted without a copy and
+// waited on, and every job must have called its completion callback once.
+//
+//   ./tool.bash build debug async && build/debug/lay_async [frames]
+
+#define LASYNC_IN_FLIGHT 3
+
+typedef struct lasync_pending {
+    lay_async_job *job;
+    int frame;
+} lasync_pending;
+
+static int lasync_callbacks;
+
+// A column of rows, each wrapping a number of fixed size cells. The number of
+// rows and cells, and the width of the root, change with the frame.
+static void lasync_build(lay_context *ctx, int frame)
+{
+    lay_reset_context(ctx);
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, (lay_scalar)(400 + frame % 7 * 30), 0);
+    lay_set_contain(ctx, root, LAY_COLUMN | LAY_START);
+    const int rows = 20 + frame % 13;
+    for (int r = 0; r < rows; ++r) {
+        lay_id row = lay_item(ctx);
+        lay_set_contain(ctx, row, LAY_ROW | LAY_WRAP | LAY_START);
+        lay_set_behave(ctx, row, LAY_HFILL);
+        lay_insert(ctx, root, row);
+        const int cells = 5 + (r * 7 + frame) % 17;
+        for (int c = 0; c < cells; ++c) {
+            lay_id cell = lay_item(ctx);
+            lay_set_size_xy(ctx, cell, (lay_scalar)(20 + (c * 13 + r) % 40), (lay_scalar)(10 + c % 3 * 5));
+            lay_set_margins_ltrb(ctx, cell, 1, 1, 1, 1);
+            lay_insert(ctx, row, cell);
+        }
+    }
+}
+
+static int lasync_check(lay_context *ctx, lay_context *expected, int frame)
+{
+    lasync_build(expected, frame);
+    lay_run_context(expected);
+    if (lay_items_count(ctx) != lay_items_count(expected)) {
+        printf("Frame %d: %u items, expected %u\n", frame,
+               (unsigned)lay_items_count(ctx), (unsigned)lay_items_count(expected));
+        return 1;
+    }
+    for (lay_id i = 0; i < lay_items_count(ctx); ++i) {
+        lay_vec4 got = lay_get_rect(ctx, i);
+        lay_vec4 want = lay_get_rect(expected, i);
+        if (got[0] != want[0] || got[1] != want[1] || got[2] != want[2] || got[3] != want[3]) {
+            printf("Frame %d, item %u: %g %g %g %g, expected %g %g %g %g\n", frame, (unsigned)i,
+                   (double)got[0], (double)got[1], (double)got[2], (double)got[3],
+                   (double)want[0], (double)want[1], (double)want[2], (double)want[3]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs on the worker thread, after the layout and before the job is done
+static void lasync_done(lay_async_job *job, void *user)
+{
+    (void)user;
+    if (lay_items_count(lay_async_context(job)) > 0)
+        ++lasync_callbacks;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 200;
+    if (argc > 1)
+        frames = atoi(argv[1]);
+
+    lay_async_worker *worker = lay_async_create();
+    if (worker == NULL) {
+        printf("Couldn't start the worker thread\n");
+        printf("Failed\n");
+        return 1;
+    }
+
+    lay_context ctx, expected;
+    lay_init_context(&ctx);
+    lay_init_context(&expected);
+    lasync_pending pending[LASYNC_IN_FLIGHT];
+    int num_pending = 0;
+    int failed = 0;
+    int submitted = 0;
+
+    // Copy jobs, with the main thread building the next frames meanwhile
+    for (int frame = 0; frame < frames; ++frame) {
+        lasync_build(&ctx, frame);
+        if (num_pending == LASYNC_IN_FLIGHT) {
+            // Out of jobs in flight, so the oldest one has to be waited for
+            lay_async_wait(pending[0].job);
+        }
+        // Jobs on one worker finish in order
+        while (num_pending > 0 && lay_async_poll(pending[0].job)) {
+            failed |= lasync_check(lay_async_context(pending[0].job), &expected, pending[0].frame);
+            lay_async_free(pending[0].job);
+            --num_pending;
+            memmove(pending, pending + 1, sizeof(lasync_pending) * num_pending);
+        }
+        lay_async_job *job = lay_async_submit(worker, &ctx, LAY_ASYNC_COPY, lasync_done, NULL);
+        if (job == NULL) {
+            printf("Out of memory\n");
+            failed = 1;
+            break;
+        }
+        ++submitted;
+        pending[num_pending].job = job;
+        pending[num_pending].frame = frame;
+        ++num_pending;
+    }
+    for (int i = 0; i < num_pending; ++i) {
+        lay_async_wait(pending[i].job);
+        failed |= lasync_check(lay_async_context(pending[i].job), &expected, pending[i].frame);
+        lay_async_free(pending[i].job);
+    }
+
+    // Jobs without a copy, which own the context until they're done
+    for (int frame = 0; frame < 10 && !failed; ++frame) {
+        lasync_build(&ctx, frame);
+        lay_async_job *job = lay_async_submit(worker, &ctx, 0, lasync_done, NULL);
+        if (job == NULL) {
+            printf("Out of memory\n");
+            failed = 1;
+            break;
+        }
+        ++submitted;
+        lay_async_wait(job);
+        failed |= lay_async_context(job) != &ctx;
+        lay_async_free(job);
+        failed |= lasync_check(&ctx, &expected, frame);
+    }
+
+    lay_async_destroy(worker);
+    lay_destroy_context(&ctx);
+    lay_destroy_context(&expected);
+
+    // Every callback ran before its job was waited for or freed, so the count
+    // is complete and safe to read here
+    if (lasync_callbacks != submitted) {
+        printf("%d callbacks for %d jobs\n", lasync_callbacks, submitted);
+        failed = 1;
+    }
+    if (!failed)
+        printf("    %d jobs computed on the worker thread\n", submitted);
+    printf(failed ? "Failed\n" : "Finished\n");
+    return failed;
+}
@@ -1,13 +1,34 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// For syscall, which the hardware counters need
+#define _GNU_SOURCE
+#endif
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 #define SOKOL_IMPL
 #include "sokol_time.h"
 #undef SOKOL_IMPL
 #define LAY_IMPLEMENTATION
+// For lay_bench replay. Recording isn't enabled, so the API calls made by the
+// other benchmarks cost the same as in a normal build.
+#define LAY_REPLAY
 #include "layout.h"
 #undef LAY_IMPLEMENTATION
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
 
 LONG WINAPI LayTestUnhandledExceptionFilter(EXCEPTION_POINTERS* ExceptionInfo)
 {
@@ -77,7 +98,18 @@ int sprint_item_info(char* str, lay_context *ctx, lay_id item)
 #define LTEST_VEC4UNEQ(vecvar, x, y, z, w) \
     LTEST_FALSE(vecvar[0] == x && vecvar[1] == y && vecvar[2] == z && vecvar[3] == w)
 
-static inline void benchmark_nested(lay_context *ctx)
+// The ids that benchmark_nested_check looks at
+typedef struct benchmark_nested_ids {
+    lay_id main_child;
+    lay_id rows[5];
+    lay_id cols1[5];
+    lay_id cols2[5];
+    lay_id cols3[2];
+    lay_id cols4[99];
+    lay_id cols5[50];
+} benchmark_nested_ids;
+
+static inline void benchmark_nested(lay_context *ctx, benchmark_nested_ids *ids)
 {
     const size_t num_rows = 5;
     // one of the rows is "fake" and will have 0 units tall height
@@ -98,14 +130,15 @@ static inline void benchmark_nested(lay_context *ctx)
     lay_insert(ctx, root, main_child);
     lay_set_behave(ctx, main_child, LAY_FILL);
 
-    lay_id *rows = (lay_id*)calloc(num_rows, sizeof(lay_id));
+    lay_id *rows = ids->rows;
+    ids->main_child = main_child;
 
     // auto-filling columns-in-row, each one should end up being
     // 10 units wide
     rows[0] = lay_item(ctx);
     lay_set_contain(ctx, rows[0], LAY_ROW);
     lay_set_behave(ctx, rows[0], LAY_FILL);
-    lay_id cols1[5];
+    lay_id *cols1 = ids->cols1;
     // hmm so both the row and its child columns need to be set to
     // fill? which means main_child also needs to be set to fill?
     for (size_t i = 0; i < 5; ++i) {
@@ -119,7 +152,7 @@ static inline void benchmark_nested(lay_context *ctx)
     rows[1] = lay_item(ctx);
     lay_set_contain(ctx, rows[1], LAY_ROW);
     lay_set_behave(ctx, rows[1], LAY_VFILL);
-    lay_id cols2[5];
+    lay_id *cols2 = ids->cols2;
     for (size_t i = 0; i < 5; ++i) {
         lay_id col = lay_item(ctx);
         // fixed-size horizontally, fill vertically
@@ -132,7 +165,7 @@ static inline void benchmark_nested(lay_context *ctx)
     // these columns have an inner item which sizes them
     rows[2] = lay_item(ctx);
     lay_set_contain(ctx, rows[2], LAY_ROW);
-    lay_id cols3[2];
+    lay_id *cols3 = ids->cols3;
     for (size_t i = 0; i < 2; ++i) {
         lay_id col = lay_item(ctx);
         lay_id inner_sizer = lay_item(ctx);
@@ -150,7 +183,7 @@ static inline void benchmark_nested(lay_context *ctx)
     rows[3] = lay_item(ctx);
     lay_set_contain(ctx, rows[3], LAY_ROW);
     lay_set_behave(ctx, rows[3], LAY_HFILL);
-    lay_id cols4[99];
+    lay_id *cols4 = ids->cols4;
     for (size_t i = 0; i < 99; ++i) {
         lay_id col = lay_item(ctx);
         lay_insert(ctx, rows[3], col);
@@ -162,7 +195,7 @@ static inline void benchmark_nested(lay_context *ctx)
     rows[4] = lay_item(ctx);
     lay_set_contain(ctx, rows[4], LAY_ROW);
     lay_set_behave(ctx, rows[4], LAY_FILL);
-    lay_id cols5[50];
+    lay_id *cols5 = ids->cols5;
     for (size_t i = 0; i < 50; ++i) {
         lay_id col = lay_item(ctx);
         lay_set_behave(ctx, col, LAY_FILL);
@@ -174,6 +207,22 @@ static inline void benchmark_nested(lay_context *ctx)
         lay_insert(ctx, main_child, rows[i]);
     }
 
+    lay_run_context(ctx);
+}
+
+// The correctness checks for benchmark_nested. These used to run inside the
+// timed loop, so they were part of every measurement. Now they run once, after
+// the timing is done.
+static void benchmark_nested_check(lay_context *ctx, const benchmark_nested_ids *ids)
+{
+    const lay_id main_child = ids->main_child;
+    const lay_id *rows = ids->rows;
+    const lay_id *cols1 = ids->cols1;
+    const lay_id *cols2 = ids->cols2;
+    const lay_id *cols3 = ids->cols3;
+    const lay_id *cols4 = ids->cols4;
+    const lay_id *cols5 = ids->cols5;
+
     // Repeat the run and tests multiple times to make sure we get the expected
     // results each time. The original version of oui would overwrite its input
     // state (intentionally) with the output state, so the context's input data
@@ -230,7 +279,1318 @@ static inline void benchmark_nested(lay_context *ctx)
         }
     }
 
-    free(rows);
+}
+
+// Builds a tree where sibling containers cycle through every box model (free
+// layout, row, column, and their wrapping variants), so that consecutive
+// containers visited by lay_calc_size and lay_arrange rarely share a box
+// model. This is the worst case for per-item branching on the container flags,
+// and is what the per-box-model kernel tables are meant to help with.
+static void benchmark_mixed_build(lay_context *ctx)
+{
+    static const uint32_t models[] = {
+        LAY_LAYOUT,
+        LAY_ROW,
+        LAY_COLUMN | LAY_END,
+        LAY_ROW | LAY_WRAP,
+        LAY_COLUMN | LAY_WRAP | LAY_START,
+        LAY_ROW | LAY_JUSTIFY,
+        LAY_COLUMN | LAY_WRAP,
+    };
+    const uint32_t num_models = sizeof(models) / sizeof(models[0]);
+    const uint32_t num_containers = 64;
+    const uint32_t children_per_container = 12;
+    // Simple LCG so the pattern is scrambled but the same on every run.
+    uint32_t seed = 12345;
+
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 720);
+    lay_set_contain(ctx, root, LAY_ROW | LAY_WRAP);
+
+    for (uint32_t i = 0; i < num_containers; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        lay_id container = lay_item(ctx);
+        lay_set_contain(ctx, container, models[(seed >> 16) % num_models]);
+        lay_set_size_xy(ctx, container, 150, 80);
+        lay_insert(ctx, root, container);
+        for (uint32_t j = 0; j < children_per_container; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            lay_id child = lay_item(ctx);
+            lay_set_size_xy(ctx, child, (lay_scalar)(10 + (seed >> 16) % 20), 12);
+            lay_set_behave(ctx, child, (seed >> 24) & 1 ? LAY_FILL : LAY_TOP);
+            lay_insert(ctx, container, child);
+        }
+    }
+}
+
+// Generated trees
+//
+// Each generator builds a tree of (close to) num_items items with a particular
+// shape, so that the cost per item can be compared across shapes and sizes.
+// They all use the same LCG as benchmark_mixed_build, so every run builds the
+// same tree.
+typedef void (*lbench_gen_fn)(lay_context *ctx, uint32_t num_items);
+
+static inline uint32_t lbench_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 16;
+}
+
+// Adds child after last, the previous child added to parent. lay_insert walks
+// all of the existing children, which would make building wide trees quadratic.
+static inline void lbench_add(lay_context *ctx, lay_id parent, lay_id *last, lay_id child)
+{
+    if (*last == LAY_INVALID_ID)
+        lay_insert(ctx, parent, child);
+    else
+        lay_append(ctx, *last, child);
+    *last = child;
+}
+
+// lay_calc_size and lay_arrange recurse once per level, so chains are capped
+// at this depth to keep the stack use bounded.
+#define LBENCH_MAX_DEPTH 1000
+
+// Chains of single children, LBENCH_MAX_DEPTH deep, side by side in a row.
+static void lbench_gen_chain(lay_context *ctx, uint32_t num_items)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 720);
+    lay_set_contain(ctx, root, LAY_ROW);
+    lay_id last = LAY_INVALID_ID;
+    while (lay_items_count(ctx) < num_items) {
+        lay_id parent = lay_item(ctx);
+        lay_set_contain(ctx, parent, LAY_COLUMN);
+        lay_set_behave(ctx, parent, LAY_FILL);
+        lbench_add(ctx, root, &last, parent);
+        for (uint32_t depth = 1; depth < LBENCH_MAX_DEPTH && lay_items_count(ctx) < num_items; ++depth) {
+            lay_id child = lay_item(ctx);
+            lay_set_contain(ctx, child, depth & 1 ? LAY_ROW : LAY_COLUMN);
+            lay_set_behave(ctx, child, LAY_FILL);
+            lay_insert(ctx, parent, child);
+            parent = child;
+        }
+        lay_set_size_xy(ctx, parent, 4, 4);
+    }
+}
+
+// One row or column with all of the items in it, alternating between fixed
+// size and filling children.
+static void lbench_gen_wide(lay_context *ctx, uint32_t num_items, uint32_t model)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 720);
+    lay_set_contain(ctx, root, model);
+    lay_id last = LAY_INVALID_ID;
+    uint32_t seed = 12345;
+    while (lay_items_count(ctx) < num_items) {
+        lay_id child = lay_item(ctx);
+        if (lbench_rand(&seed) & 1)
+            lay_set_behave(ctx, child, LAY_FILL);
+        else
+            lay_set_size_xy(ctx, child, (lay_scalar)(1 + lbench_rand(&seed) % 8), 10);
+        lbench_add(ctx, root, &last, child);
+    }
+}
+
+static void lbench_gen_wide_row(lay_context *ctx, uint32_t num_items)
+{
+    lbench_gen_wide(ctx, num_items, LAY_ROW);
+}
+
+static void lbench_gen_wide_column(lay_context *ctx, uint32_t num_items)
+{
+    lbench_gen_wide(ctx, num_items, LAY_COLUMN);
+}
+
+// A column of wrapping rows, 1000 children each, that wrap into many lines
+// and sometimes break by hand.
+static void lbench_gen_wrap(lay_context *ctx, uint32_t num_items)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 0);
+    lay_set_contain(ctx, root, LAY_COLUMN | LAY_START);
+    lay_id last_row = LAY_INVALID_ID;
+    uint32_t seed = 12345;
+    while (lay_items_count(ctx) < num_items) {
+        lay_id row = lay_item(ctx);
+        lay_set_behave(ctx, row, LAY_HFILL);
+        lay_set_contain(ctx, row, LAY_ROW | LAY_WRAP | LAY_START);
+        lbench_add(ctx, root, &last_row, row);
+        lay_id last = LAY_INVALID_ID;
+        for (uint32_t i = 0; i < 1000 && lay_items_count(ctx) < num_items; ++i) {
+            lay_id child = lay_item(ctx);
+            const uint32_t r = lbench_rand(&seed);
+            lay_set_size_xy(ctx, child, (lay_scalar)(8 + r % 16), 10);
+            lay_set_behave(ctx, child, r % 97 == 0 ? LAY_BREAK : 0);
+            lbench_add(ctx, row, &last, child);
+        }
+    }
+}
+
+// A column of LAY_GRID containers, 400 cells each, with every kind of track.
+static void lbench_gen_grid(lay_context *ctx, uint32_t num_items)
+{
+    static const lay_track columns[] = {
+        {LAY_TRACK_FIXED, 40},
+        {LAY_TRACK_AUTO, 0},
+        {LAY_TRACK_FILL, 0},
+        {LAY_TRACK_FILL, 0},
+    };
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 0);
+    lay_set_contain(ctx, root, LAY_COLUMN | LAY_START);
+    lay_id last_grid = LAY_INVALID_ID;
+    uint32_t seed = 12345;
+    while (lay_items_count(ctx) < num_items) {
+        lay_id grid = lay_item(ctx);
+        lay_set_behave(ctx, grid, LAY_HFILL);
+        lay_set_contain(ctx, grid, LAY_GRID);
+        lay_set_grid_columns(ctx, grid, columns, 4);
+        lbench_add(ctx, root, &last_grid, grid);
+        lay_id last = LAY_INVALID_ID;
+        for (uint32_t i = 0; i < 400 && lay_items_count(ctx) < num_items; ++i) {
+            lay_id cell = lay_item(ctx);
+            const uint32_t r = lbench_rand(&seed);
+            lay_set_size_xy(ctx, cell, (lay_scalar)(10 + r % 50), (lay_scalar)(8 + r % 9));
+            lay_set_behave(ctx, cell, r & 1 ? LAY_HFILL : LAY_LEFT);
+            lbench_add(ctx, grid, &last, cell);
+        }
+    }
+}
+
+// Random trees: each item goes into one of the last 64 containers, and gets a
+// random box model, behave flags, size and margins. Depth is capped at 64.
+static void lbench_gen_random(lay_context *ctx, uint32_t num_items)
+{
+    static const uint32_t models[] = {
+        LAY_LAYOUT,
+        LAY_ROW,
+        LAY_COLUMN | LAY_END,
+        LAY_ROW | LAY_WRAP,
+        LAY_COLUMN | LAY_WRAP | LAY_START,
+        LAY_ROW | LAY_JUSTIFY,
+    };
+    static const uint32_t behaves[] = {
+        0, LAY_FILL, LAY_HFILL | LAY_TOP, LAY_VFILL, LAY_LEFT | LAY_BOTTOM, LAY_CENTER,
+    };
+    enum { num_models = sizeof(models) / sizeof(models[0]) };
+    enum { num_behaves = sizeof(behaves) / sizeof(behaves[0]) };
+    enum { pool_size = 64, max_depth = 64 };
+    lay_id pool[pool_size];
+    lay_id lasts[pool_size];
+    uint8_t depths[pool_size];
+    uint32_t pool_count = 1;
+    uint32_t seed = 12345;
+
+    pool[0] = lay_item(ctx);
+    lasts[0] = LAY_INVALID_ID;
+    depths[0] = 0;
+    lay_set_size_xy(ctx, pool[0], 1280, 720);
+    lay_set_contain(ctx, pool[0], LAY_ROW | LAY_WRAP);
+    while (lay_items_count(ctx) < num_items) {
+        const uint32_t slot = lbench_rand(&seed) % pool_count;
+        lay_id item = lay_item(ctx);
+        lay_set_behave(ctx, item, behaves[lbench_rand(&seed) % num_behaves]);
+        if (lbench_rand(&seed) % 3 == 0)
+            lay_set_size_xy(ctx, item, (lay_scalar)(lbench_rand(&seed) % 40), (lay_scalar)(lbench_rand(&seed) % 30));
+        if (lbench_rand(&seed) % 4 == 0)
+            lay_set_margins_ltrb(ctx, item, 1, 2, 1, 2);
+        lbench_add(ctx, pool[slot], &lasts[slot], item);
+        // Some of the items become containers themselves
+        if (depths[slot] < max_depth && lbench_rand(&seed) % 4 == 0) {
+            lay_set_contain(ctx, item, models[lbench_rand(&seed) % num_models]);
+            const uint32_t target = pool_count < pool_size ? pool_count++ : lbench_rand(&seed) % pool_size;
+            depths[target] = (uint8_t)(depths[slot] + 1);
+            pool[target] = item;
+            lasts[target] = LAY_INVALID_ID;
+        }
+    }
+}
+
+// Application windows: a sidebar of entries, a header, a scrolling list of
+// cards with a few lines of text each, and a footer of buttons. Windows are
+// stacked in a column until there are enough items.
+static void lbench_gen_app(lay_context *ctx, uint32_t num_items)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 0);
+    lay_set_contain(ctx, root, LAY_COLUMN | LAY_START);
+    lay_id last_window = LAY_INVALID_ID;
+    while (lay_items_count(ctx) < num_items) {
+        lay_id window = lay_item(ctx);
+        lay_set_size_xy(ctx, window, 0, 720);
+        lay_set_behave(ctx, window, LAY_HFILL);
+        lay_set_contain(ctx, window, LAY_ROW);
+        lbench_add(ctx, root, &last_window, window);
+
+        lay_id sidebar = lay_item(ctx);
+        lay_set_size_xy(ctx, sidebar, 200, 0);
+        lay_set_behave(ctx, sidebar, LAY_VFILL);
+        lay_set_contain(ctx, sidebar, LAY_COLUMN | LAY_START);
+        lay_insert(ctx, window, sidebar);
+        for (int i = 0; i < 12; ++i) {
+            lay_id entry = lay_item(ctx);
+            lay_set_size_xy(ctx, entry, 0, 24);
+            lay_set_behave(ctx, entry, LAY_HFILL);
+            lay_set_margins_ltrb(ctx, entry, 2, 1, 2, 1);
+            lay_insert(ctx, sidebar, entry);
+        }
+
+        lay_id content = lay_item(ctx);
+        lay_set_behave(ctx, content, LAY_FILL);
+        lay_set_contain(ctx, content, LAY_COLUMN);
+        lay_insert(ctx, window, content);
+
+        lay_id header = lay_item(ctx);
+        lay_set_size_xy(ctx, header, 0, 40);
+        lay_set_behave(ctx, header, LAY_HFILL);
+        lay_set_contain(ctx, header, LAY_ROW | LAY_START);
+        lay_insert(ctx, content, header);
+        for (int i = 0; i < 4; ++i) {
+            lay_id tab = lay_item(ctx);
+            lay_set_size_xy(ctx, tab, 90, 30);
+            lay_set_margins_ltrb(ctx, tab, 4, 0, 4, 0);
+            lay_insert(ctx, header, tab);
+        }
+
+        lay_id list = lay_item(ctx);
+        lay_set_behave(ctx, list, LAY_FILL);
+        lay_set_contain(ctx, list, LAY_COLUMN | LAY_START);
+        lay_insert(ctx, content, list);
+        for (int i = 0; i < 20; ++i) {
+            lay_id card = lay_item(ctx);
+            lay_set_behave(ctx, card, LAY_HFILL);
+            lay_set_contain(ctx, card, LAY_ROW);
+            lay_set_margins_ltrb(ctx, card, 8, 4, 8, 4);
+            lay_insert(ctx, list, card);
+            lay_id icon = lay_item(ctx);
+            lay_set_size_xy(ctx, icon, 32, 32);
+            lay_insert(ctx, card, icon);
+            lay_id text = lay_item(ctx);
+            lay_set_behave(ctx, text, LAY_HFILL);
+            lay_set_contain(ctx, text, LAY_COLUMN);
+            lay_insert(ctx, card, text);
+            for (int j = 0; j < 3; ++j) {
+                lay_id line = lay_item(ctx);
+                lay_set_size_xy(ctx, line, 0, 14);
+                lay_set_behave(ctx, line, LAY_HFILL);
+                lay_insert(ctx, text, line);
+            }
+        }
+
+        lay_id footer = lay_item(ctx);
+        lay_set_behave(ctx, footer, LAY_HFILL);
+        lay_set_contain(ctx, footer, LAY_ROW | LAY_END);
+        lay_insert(ctx, content, footer);
+        for (int i = 0; i < 3; ++i) {
+            lay_id button = lay_item(ctx);
+            lay_set_size_xy(ctx, button, 70, 24);
+            lay_set_margins_ltrb(ctx, button, 4, 4, 4, 4);
+            lay_insert(ctx, footer, button);
+        }
+    }
+}
+
+typedef struct lbench_gen {
+    const char *name;
+    lbench_gen_fn build;
+} lbench_gen;
+
+static const lbench_gen lbench_gens[] = {
+    { "chain", lbench_gen_chain },
+    { "row", lbench_gen_wide_row },
+    { "column", lbench_gen_wide_column },
+    { "wrap", lbench_gen_wrap },
+    { "grid", lbench_gen_grid },
+    { "random", lbench_gen_random },
+    { "app", lbench_gen_app },
+};
+
+// Reporting
+//
+// Every benchmark records one sample per run, in sokol_time ticks, and reports
+// the distribution of those samples instead of just the mean: frame time
+// tails are what users notice. The first samples are warmup (cold caches,
+// buffers growing to size) and aren't counted.
+typedef enum lbench_format {
+    LBENCH_TEXT,
+    LBENCH_JSON,
+    LBENCH_CSV,
+} lbench_format;
+
+typedef struct lbench_options {
+    lbench_format format;
+    uint32_t runs;
+    uint32_t warmup;
+    bool histogram;
+    bool counters;
+} lbench_options;
+
+static lbench_options lbench_opts = { LBENCH_TEXT, 100000, 1000, false, false };
+static uint32_t lbench_num_reported = 0;
+
+// All in nanoseconds per run
+typedef struct lbench_stats {
+    uint32_t count;
+    double mean;
+    double stddev;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+    // Samples above Q3 + 3 * IQR, a Tukey far-out fence
+    uint32_t outliers;
+    double outlier_fence;
+} lbench_stats;
+
+static int lbench_compare_ticks(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Nearest-rank percentile of sorted samples
+static double lbench_percentile(const uint64_t *sorted, uint32_t count, double p)
+{
+    uint32_t rank = (uint32_t)ceil(p * (double)count);
+    if (rank < 1)
+        rank = 1;
+    return stm_ns(sorted[rank - 1]);
+}
+
+// Sorts the samples in place
+static lbench_stats lbench_compute_stats(uint64_t *samples, uint32_t count)
+{
+    lbench_stats st;
+    memset(&st, 0, sizeof(st));
+    st.count = count;
+    if (count == 0)
+        return st;
+    qsort(samples, count, sizeof(uint64_t), lbench_compare_ticks);
+    double sum = 0.0, sum_sq = 0.0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const double ns = stm_ns(samples[i]);
+        sum += ns;
+        sum_sq += ns * ns;
+    }
+    st.mean = sum / (double)count;
+    if (count > 1) {
+        const double var = (sum_sq - sum * st.mean) / (double)(count - 1);
+        st.stddev = var > 0.0 ? sqrt(var) : 0.0;
+    }
+    st.min = stm_ns(samples[0]);
+    st.p50 = lbench_percentile(samples, count, 0.5);
+    st.p90 = lbench_percentile(samples, count, 0.9);
+    st.p99 = lbench_percentile(samples, count, 0.99);
+    st.p999 = lbench_percentile(samples, count, 0.999);
+    st.max = stm_ns(samples[count - 1]);
+    const double q1 = lbench_percentile(samples, count, 0.25);
+    const double q3 = lbench_percentile(samples, count, 0.75);
+    st.outlier_fence = q3 + 3.0 * (q3 - q1);
+    for (uint32_t i = count; i > 0 && stm_ns(samples[i - 1]) > st.outlier_fence; --i)
+        ++st.outliers;
+    return st;
+}
+
+// Power of two buckets, in nanoseconds: bucket i counts samples in
+// [2^i, 2^(i + 1)).
+#define LBENCH_HISTOGRAM_BUCKETS 48
+
+static uint32_t lbench_histogram(const uint64_t *samples, uint32_t count, uint32_t *buckets)
+{
+    memset(buckets, 0, LBENCH_HISTOGRAM_BUCKETS * sizeof(uint32_t));
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t ns = (uint64_t)stm_ns(samples[i]);
+        uint32_t b = 0;
+        while (ns > 1 && b < LBENCH_HISTOGRAM_BUCKETS - 1) {
+            ns >>= 1;
+            ++b;
+        }
+        ++buckets[b];
+        if (b > last)
+            last = b;
+    }
+    return last + 1;
+}
+
+// Hardware performance counters
+//
+// With --counters, every phase that is timed also counts cycles, instructions,
+// L1 data cache misses, last level cache misses and branch misses over its
+// timed runs, and they are reported per item. This uses perf_event_open, so it
+// only works on Linux. Only user space is counted, which leaves out the
+// syscalls that read the counters between phases, but those syscalls do add a
+// little to the times. Counters that the CPU, hypervisor or
+// perf_event_paranoid don't allow are reported as unavailable.
+#define LBENCH_NUM_COUNTERS 5
+
+static const char *const lbench_counter_names[LBENCH_NUM_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+};
+
+// Totals over all the timed runs of a phase, scaled up if the kernel had to
+// multiplex the counters
+typedef struct lbench_counts {
+    double values[LBENCH_NUM_COUNTERS];
+} lbench_counts;
+
+typedef struct lbench_snapshot {
+    uint64_t enabled;
+    uint64_t running;
+    uint64_t values[LBENCH_NUM_COUNTERS];
+} lbench_snapshot;
+
+// Position of each counter in the group, or -1 if it couldn't be opened
+static int lbench_counter_slots[LBENCH_NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+static int lbench_counter_leader = -1;
+
+#ifdef __linux__
+static int lbench_perf_open(uint32_t type, uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+// Opens the counters as one group, so that they all count the same code.
+// Returns false if none of them could be opened.
+static bool lbench_counters_open(void)
+{
+#ifdef __linux__
+    static const struct { uint32_t type; uint64_t config; } events[LBENCH_NUM_COUNTERS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    int num_slots = 0;
+    for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i) {
+        const int fd = lbench_perf_open(events[i].type, events[i].config, lbench_counter_leader);
+        if (fd < 0)
+            continue;
+        if (lbench_counter_leader == -1)
+            lbench_counter_leader = fd;
+        lbench_counter_slots[i] = num_slots++;
+    }
+    if (lbench_counter_leader == -1)
+        return false;
+    ioctl(lbench_counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(lbench_counter_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void lbench_counters_read(lbench_snapshot *snap)
+{
+    memset(snap, 0, sizeof(*snap));
+#ifdef __linux__
+    if (lbench_counter_leader == -1)
+        return;
+    // nr, time_enabled, time_running, then a value per counter in the group
+    uint64_t buf[3 + LBENCH_NUM_COUNTERS];
+    if (read(lbench_counter_leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return;
+    snap->enabled = buf[1];
+    snap->running = buf[2];
+    for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i)
+        if (lbench_counter_slots[i] >= 0 && (uint64_t)lbench_counter_slots[i] < buf[0])
+            snap->values[i] = buf[3 + lbench_counter_slots[i]];
+#endif
+}
+
+// Adds what was counted since *snap to counts, and moves *snap to now. Like
+// stm_laptime, for counters. Does nothing without --counters or if counts is
+// NULL.
+static void lbench_counters_lap(lbench_snapshot *snap, lbench_counts *counts)
+{
+    if (!lbench_opts.counters || counts == NULL)
+        return;
+    lbench_snapshot now;
+    lbench_counters_read(&now);
+    const uint64_t running = now.running - snap->running;
+    const double scale = running > 0 ? (double)(now.enabled - snap->enabled) / (double)running : 0.0;
+    for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i)
+        counts->values[i] += (double)(now.values[i] - snap->values[i]) * scale;
+    *snap = now;
+}
+
+static void lbench_counters_start(lbench_snapshot *snap)
+{
+    if (lbench_opts.counters)
+        lbench_counters_read(snap);
+}
+
+static void lbench_counts_add(lbench_counts *sum, const lbench_counts *counts)
+{
+    for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i)
+        sum->values[i] += counts->values[i];
+}
+
+// Per item and run, or a negative number if the counter isn't available
+static double lbench_counter_per_item(const lbench_counts *counts, int counter, uint32_t items, uint32_t runs)
+{
+    if (lbench_counter_slots[counter] < 0 || items == 0 || runs == 0)
+        return -1.0;
+    return counts->values[counter] / ((double)items * (double)runs);
+}
+
+static void lbench_print_counts(const char *phase, const lbench_counts *counts, uint32_t items, uint32_t runs)
+{
+    printf("    %sper item:", phase);
+    for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i) {
+        const double v = lbench_counter_per_item(counts, i, items, runs);
+        if (v < 0.0)
+            printf(" %s n/a", lbench_counter_names[i]);
+        else
+            printf(" %s %.2f", lbench_counter_names[i], v);
+        if (i == 1 && v >= 0.0 && counts->values[0] > 0.0)
+            printf(" (IPC %.2f)", counts->values[1] / counts->values[0]);
+        printf(i + 1 < LBENCH_NUM_COUNTERS ? "," : "\n");
+    }
+}
+
+// Reports the samples of one benchmark, with warmup already left out. items is
+// the size of the tree, for the per-item numbers. counts are the hardware
+// counters over the same runs, or NULL.
+static void lbench_report(const char *name, uint32_t items, uint64_t *samples, uint32_t count,
+    const lbench_counts *counts)
+{
+    const lbench_stats st = lbench_compute_stats(samples, count);
+    uint32_t buckets[LBENCH_HISTOGRAM_BUCKETS];
+    uint32_t num_buckets = 0;
+    if (lbench_opts.histogram)
+        num_buckets = lbench_histogram(samples, count, buckets);
+
+    switch (lbench_opts.format) {
+    case LBENCH_TEXT:
+        printf("%s (%u items, %u runs)\n", name, (unsigned)items, (unsigned)count);
+        printf("    mean %.2f us, stddev %.2f us, %.2f ns/item\n",
+            st.mean / 1000.0, st.stddev / 1000.0, st.mean / (double)items);
+        printf("    min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f us\n",
+            st.min / 1000.0, st.p50 / 1000.0, st.p90 / 1000.0,
+            st.p99 / 1000.0, st.p999 / 1000.0, st.max / 1000.0);
+        printf("    outliers: %u (%.3f%%) above %.2f us\n",
+            (unsigned)st.outliers, 100.0 * (double)st.outliers / (double)(count ? count : 1),
+            st.outlier_fence / 1000.0);
+        if (counts != NULL && lbench_opts.counters)
+            lbench_print_counts("", counts, items, count);
+        if (num_buckets > 0) {
+            uint32_t most = 1;
+            for (uint32_t b = 0; b < num_buckets; ++b)
+                if (buckets[b] > most)
+                    most = buckets[b];
+            for (uint32_t b = 0; b < num_buckets; ++b) {
+                if (buckets[b] == 0)
+                    continue;
+                const int bar = (int)(50.0 * (double)buckets[b] / (double)most + 0.5);
+                printf("    %10.2f us %9u |%.*s\n", (double)((uint64_t)1 << b) / 1000.0,
+                    (unsigned)buckets[b], bar, "##################################################");
+            }
+        }
+        break;
+    case LBENCH_JSON:
+        printf("%s  {\"name\": \"%s\", \"items\": %u, \"samples\": %u, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, "
+            "\"min_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, "
+            "\"max_ns\": %.1f, \"outliers\": %u",
+            lbench_num_reported ? ",\n" : "",
+            name, (unsigned)items, (unsigned)count, st.mean, st.stddev,
+            st.min, st.p50, st.p90, st.p99, st.p999, st.max, (unsigned)st.outliers);
+        if (num_buckets > 0) {
+            // [bucket start in ns, count], for the buckets that aren't empty
+            const char *sep = "";
+            printf(", \"histogram\": [");
+            for (uint32_t b = 0; b < num_buckets; ++b) {
+                if (buckets[b] == 0)
+                    continue;
+                printf("%s[%llu, %u]", sep, (unsigned long long)1 << b, (unsigned)buckets[b]);
+                sep = ", ";
+            }
+            printf("]");
+        }
+        if (counts != NULL && lbench_opts.counters) {
+            // Per item, null if not available
+            printf(", \"counters\": {");
+            for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i) {
+                const double v = lbench_counter_per_item(counts, i, items, count);
+                printf(v < 0.0 ? "%s\"%s\": null" : "%s\"%s\": %.4f",
+                    i ? ", " : "", lbench_counter_names[i], v);
+            }
+            printf("}");
+        }
+        printf("}");
+        break;
+    case LBENCH_CSV:
+        printf("%s,%u,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%u",
+            name, (unsigned)items, (unsigned)count, st.mean, st.stddev,
+            st.min, st.p50, st.p90, st.p99, st.p999, st.max, (unsigned)st.outliers);
+        if (lbench_opts.counters) {
+            // Per item, empty if not available
+            for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i) {
+                const double v = counts != NULL ? lbench_counter_per_item(counts, i, items, count) : -1.0;
+                if (v < 0.0)
+                    printf(",");
+                else
+                    printf(",%.4f", v);
+            }
+        }
+        printf("\n");
+        break;
+    }
+    ++lbench_num_reported;
+    fflush(stdout);
+}
+
+static void lbench_report_begin(void)
+{
+    if (lbench_opts.format == LBENCH_JSON)
+        printf("[\n");
+    else if (lbench_opts.format == LBENCH_CSV) {
+        printf("name,items,samples,mean_ns,stddev_ns,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,outliers");
+        if (lbench_opts.counters)
+            for (int i = 0; i < LBENCH_NUM_COUNTERS; ++i)
+                printf(",%s_per_item", lbench_counter_names[i]);
+        printf("\n");
+    }
+}
+
+static void lbench_report_end(void)
+{
+    if (lbench_opts.format == LBENCH_JSON)
+        printf("\n]\n");
+}
+
+// Progress messages go to stderr in the machine-readable formats
+static FILE *lbench_log(void)
+{
+    return lbench_opts.format == LBENCH_TEXT ? stdout : stderr;
+}
+
+// Builds each shape with 10^2 .. max_items items, and times building the tree,
+// the first lay_run_context on it, and running it again. The first repetition
+// is warmup: after it, building reuses the context's buffers, like an
+// application that rebuilds its tree every frame.
+static void lbench_suite(uint32_t max_items)
+{
+    if (lbench_opts.format == LBENCH_TEXT) {
+        printf("%-8s %9s %6s %14s %14s %14s %14s %10s\n",
+            "shape", "items", "reps", "build ns/item", "run ns/item", "rerun ns/item",
+            "p99 ns/item", "bytes/item");
+    }
+    for (size_t g = 0; g < sizeof(lbench_gens) / sizeof(lbench_gens[0]); ++g) {
+        for (uint64_t n = 100; n <= max_items; n *= 10) {
+            // Roughly the same amount of work for every size, but at least a
+            // few repetitions
+            uint32_t reps = (uint32_t)(2000000 / n);
+            if (reps < 3)
+                reps = 3;
+            uint64_t *build_ticks = (uint64_t*)calloc(3 * (size_t)reps, sizeof(uint64_t));
+            uint64_t *run_ticks = build_ticks + reps;
+            uint64_t *rerun_ticks = run_ticks + reps;
+            lbench_counts counts[3];
+            memset(counts, 0, sizeof(counts));
+            lbench_snapshot snap;
+            lay_context ctx;
+            lay_init_context(&ctx);
+            lbench_gens[g].build(&ctx, (uint32_t)n);
+            lay_run_context(&ctx);
+            for (uint32_t rep = 0; rep < reps; ++rep) {
+                lay_reset_context(&ctx);
+                lbench_counters_start(&snap);
+                uint64_t t = stm_now();
+                lbench_gens[g].build(&ctx, (uint32_t)n);
+                build_ticks[rep] = stm_laptime(&t);
+                lbench_counters_lap(&snap, &counts[0]);
+                lay_run_context(&ctx);
+                run_ticks[rep] = stm_laptime(&t);
+                lbench_counters_lap(&snap, &counts[1]);
+                lay_run_context(&ctx);
+                rerun_ticks[rep] = stm_laptime(&t);
+                lbench_counters_lap(&snap, &counts[2]);
+            }
+            const uint32_t count = lay_items_count(&ctx);
+            if (lbench_opts.format == LBENCH_TEXT) {
+                const lbench_stats build = lbench_compute_stats(build_ticks, reps);
+                const lbench_stats run = lbench_compute_stats(run_ticks, reps);
+                const lbench_stats rerun = lbench_compute_stats(rerun_ticks, reps);
+                printf("%-8s %9u %6u %14.2f %14.2f %14.2f %14.2f %10.1f\n",
+                    lbench_gens[g].name, (unsigned)count, (unsigned)reps,
+                    build.mean / count, run.mean / count, rerun.mean / count, run.p99 / count,
+                    (double)lay_memory_usage(&ctx, NULL) / (double)count);
+                if (lbench_opts.counters) {
+                    static const char *const phases[3] = { "build ", "run ", "rerun " };
+                    for (int phase = 0; phase < 3; ++phase)
+                        lbench_print_counts(phases[phase], &counts[phase], count, reps);
+                }
+                fflush(stdout);
+            } else {
+                char name[64];
+                snprintf(name, sizeof(name), "suite/%s/%u/build", lbench_gens[g].name, (unsigned)n);
+                lbench_report(name, count, build_ticks, reps, &counts[0]);
+                snprintf(name, sizeof(name), "suite/%s/%u/run", lbench_gens[g].name, (unsigned)n);
+                lbench_report(name, count, run_ticks, reps, &counts[1]);
+                snprintf(name, sizeof(name), "suite/%s/%u/rerun", lbench_gens[g].name, (unsigned)n);
+                lbench_report(name, count, rerun_ticks, reps, &counts[2]);
+            }
+            lay_destroy_context(&ctx);
+            free(build_ticks);
+        }
+    }
+}
+
+// Compare mode
+//
+// Reads two CSV result files and compares the means of the benchmarks that
+// are in both with Welch's t-test. A change is reported as significant when
+// |t| is over 3.29 (p < 0.001, two-sided, for large sample counts) and the
+// means differ by more than the threshold, since with 10^5 samples even
+// meaningless differences pass the t-test.
+typedef struct lbench_result {
+    char name[64];
+    unsigned samples;
+    double mean;
+    double stddev;
+    double p99;
+} lbench_result;
+
+static lbench_result *lbench_read_csv(const char *path, uint32_t *count)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return NULL;
+    }
+    uint32_t capacity = 64;
+    lbench_result *results = (lbench_result*)malloc(capacity * sizeof(lbench_result));
+    *count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lbench_result r;
+        unsigned items;
+        double min, p50, p90;
+        if (sscanf(line, "%63[^,],%u,%u,%lf,%lf,%lf,%lf,%lf,%lf",
+                r.name, &items, &r.samples, &r.mean, &r.stddev, &min, &p50, &p90, &r.p99) != 9)
+            continue; // the header, or not a result
+        if (*count == capacity) {
+            capacity *= 2;
+            results = (lbench_result*)realloc(results, capacity * sizeof(lbench_result));
+        }
+        results[(*count)++] = r;
+    }
+    fclose(f);
+    return results;
+}
+
+static int lbench_compare(const char *old_path, const char *new_path, double threshold)
+{
+    uint32_t num_old, num_new;
+    lbench_result *olds = lbench_read_csv(old_path, &num_old);
+    lbench_result *news = lbench_read_csv(new_path, &num_new);
+    if (olds == NULL || news == NULL) {
+        free(olds);
+        free(news);
+        return 2;
+    }
+    uint32_t regressions = 0;
+    printf("%-32s %12s %12s %9s %9s %9s  %s\n",
+        "name", "old mean", "new mean", "change", "t", "p99 chg", "result");
+    for (uint32_t i = 0; i < num_new; ++i) {
+        const lbench_result *b = &news[i];
+        const lbench_result *a = NULL;
+        for (uint32_t j = 0; j < num_old && a == NULL; ++j)
+            if (strcmp(olds[j].name, b->name) == 0)
+                a = &olds[j];
+        if (a == NULL || a->mean <= 0.0 || a->samples < 2 || b->samples < 2)
+            continue;
+        const double se = sqrt(a->stddev * a->stddev / a->samples + b->stddev * b->stddev / b->samples);
+        const double t = se > 0.0 ? (b->mean - a->mean) / se : 0.0;
+        const double change = 100.0 * (b->mean - a->mean) / a->mean;
+        const double p99_change = a->p99 > 0.0 ? 100.0 * (b->p99 - a->p99) / a->p99 : 0.0;
+        const char *result = "same";
+        if (fabs(t) > 3.29 && fabs(change) > threshold) {
+            if (change > 0.0) {
+                result = "REGRESSION";
+                ++regressions;
+            } else {
+                result = "improvement";
+            }
+        }
+        printf("%-32s %9.1f ns %9.1f ns %+8.2f%% %9.2f %+8.2f%%  %s\n",
+            b->name, a->mean, b->mean, change, t, p99_change, result);
+    }
+    printf("%u significant regression%s\n", (unsigned)regressions, regressions == 1 ? "" : "s");
+    free(olds);
+    free(news);
+    return regressions > 0 ? 1 : 0;
+}
+
+// Trace replay
+//
+// Re-executes a trace of API calls recorded by an application built with
+// LAY_RECORD (see lay_record_start), so that real workloads can be
+// benchmarked without the application. The calls that run the layout are
+// timed separately from the ones that build the tree. Each repetition starts
+// from an empty context, and the first one is warmup.
+static uint8_t *lbench_read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return NULL;
+    uint8_t *data = NULL;
+    long length;
+    if (fseek(f, 0, SEEK_END) == 0 && (length = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = (uint8_t*)malloc(length > 0 ? (size_t)length : 1);
+        *size = fread(data, 1, (size_t)length, f);
+        if (*size != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+static bool lbench_replay_once(
+        lay_context *ctx, const uint8_t *data, size_t size,
+        uint64_t *build_ticks, uint64_t *run_ticks, lbench_counts *counts)
+{
+    size_t offset;
+    lay_replay_begin(data, size, &offset);
+    lay_reset_context(ctx);
+    *build_ticks = 0;
+    *run_ticks = 0;
+    bool running = false;
+    lbench_snapshot snap;
+    lbench_counters_start(&snap);
+    uint64_t t = stm_now();
+    while (offset < size) {
+        // Every call starts with its op byte
+        const bool run = data[offset] == LAY_RECORD_RUN_CONTEXT || data[offset] == LAY_RECORD_RUN_ITEM;
+        if (run != running) {
+            *(running ? run_ticks : build_ticks) += stm_laptime(&t);
+            lbench_counters_lap(&snap, counts ? &counts[running] : NULL);
+            running = run;
+        }
+        if (lay_replay_next(ctx, data, size, &offset) < 0) {
+            fprintf(stderr, "Invalid call in trace at byte %lu\n", (unsigned long)offset);
+            return false;
+        }
+    }
+    *(running ? run_ticks : build_ticks) += stm_laptime(&t);
+    lbench_counters_lap(&snap, counts ? &counts[running] : NULL);
+    return true;
+}
+
+static int lbench_replay(const char *path)
+{
+    size_t size = 0;
+    uint8_t *data = lbench_read_file(path, &size);
+    size_t offset;
+    if (data == NULL || lay_replay_begin(data, size, &offset) != 0) {
+        fprintf(stderr, "Can't read a trace from %s\n", path);
+        free(data);
+        return 1;
+    }
+    // About 50 MB of trace in total, but at least a few repetitions
+    uint32_t reps = (uint32_t)(50000000 / size);
+    if (reps > lbench_opts.runs)
+        reps = lbench_opts.runs;
+    if (reps < 3)
+        reps = 3;
+    uint64_t *ticks = (uint64_t*)calloc(3 * (size_t)reps, sizeof(uint64_t));
+    uint64_t *build_ticks = ticks;
+    uint64_t *run_ticks = ticks + reps;
+    uint64_t *total_ticks = ticks + 2 * reps;
+    // Build, run and total
+    lbench_counts counts[3];
+    memset(counts, 0, sizeof(counts));
+    lay_context ctx;
+    lay_init_context(&ctx);
+    int result = 0;
+    if (!lbench_replay_once(&ctx, data, size, &build_ticks[0], &run_ticks[0], NULL))
+        result = 1;
+    for (uint32_t rep = 0; rep < reps && result == 0; ++rep) {
+        lbench_replay_once(&ctx, data, size, &build_ticks[rep], &run_ticks[rep], counts);
+        total_ticks[rep] = build_ticks[rep] + run_ticks[rep];
+    }
+    lbench_counts_add(&counts[2], &counts[0]);
+    lbench_counts_add(&counts[2], &counts[1]);
+    if (result == 0) {
+        const uint32_t items = lay_items_count(&ctx);
+        fprintf(lbench_log(), "Replaying %s (%lu bytes)\n", path, (unsigned long)size);
+        lbench_report_begin();
+        lbench_report("replay/build", items, build_ticks, reps, &counts[0]);
+        lbench_report("replay/run", items, run_ticks, reps, &counts[1]);
+        lbench_report("replay/total", items, total_ticks, reps, &counts[2]);
+        lbench_report_end();
+    }
+    lay_destroy_context(&ctx);
+    free(ticks);
+    free(data);
+    return result;
+}
+
+// Kernel microbenchmarks
+//
+// Times the size and arrange kernels of layout.h in isolation, on a single
+// container with a controlled number of children and mix of child flags.
+// Everything up to the kernel's step of lay_run_context (sizing and arranging
+// the other dimension first, for the vertical kernels) runs once untimed, and
+// then the kernel is called directly through lay_calc_size_kernels or
+// lay_arrange_kernels. Some arrange kernels move the children relative to
+// where they are, so the rects are restored between samples, and each sample
+// calls the kernel enough times to visit about LBENCH_KERNEL_VISITS children.
+// Results are per child.
+#define LBENCH_KERNEL_VISITS 1024
+#define LBENCH_KERNEL_SAMPLES 2000
+
+typedef enum lbench_kernel_mix {
+    // Fixed size children, at the default (top left) position
+    LBENCH_MIX_FIXED,
+    // Every child fills the container
+    LBENCH_MIX_FILL,
+    // Fixed, filling, centered and right/bottom aligned children, with margins
+    LBENCH_MIX_MIXED,
+    // Like mixed, with min/max sizes and grow/shrink weights on half of them
+    LBENCH_MIX_EXT,
+    LBENCH_NUM_MIXES
+} lbench_kernel_mix;
+
+static const char *const lbench_mix_names[LBENCH_NUM_MIXES] = { "fixed", "fill", "mixed", "ext" };
+
+typedef struct lbench_kernel {
+    // After the layout.h function that does the work
+    const char *name;
+    uint32_t contain;
+    int dim;
+    bool arrange;
+} lbench_kernel;
+
+static const lbench_kernel lbench_kernels[] = {
+    { "calc_overlayed_size", LAY_LAYOUT, 0, false },
+    { "calc_stacked_size", LAY_ROW, 0, false },
+    { "calc_wrapped_stacked_size", LAY_ROW | LAY_WRAP, 0, false },
+    { "calc_wrapped_overlayed_size", LAY_ROW | LAY_WRAP, 1, false },
+    { "calc_grid_size_0", LAY_GRID, 0, false },
+    { "calc_grid_size_1", LAY_GRID, 1, false },
+    { "arrange_overlay", LAY_LAYOUT, 0, true },
+    { "arrange_stacked", LAY_ROW, 0, true },
+    { "arrange_stacked_wrap", LAY_ROW | LAY_WRAP, 0, true },
+    { "arrange_overlay_squeezed", LAY_ROW, 1, true },
+    { "arrange_wrapped_overlay_squeezed", LAY_ROW | LAY_WRAP, 1, true },
+    { "arrange_column_wrap", LAY_COLUMN | LAY_WRAP, 1, true },
+    { "arrange_grid_0", LAY_GRID, 0, true },
+    { "arrange_grid_1", LAY_GRID, 1, true },
+};
+
+static void lbench_kernel_build(lay_context *ctx, uint32_t contain, lbench_kernel_mix mix, uint32_t num_children)
+{
+    static const uint32_t behaves[] = {
+        0, LAY_HFILL, LAY_VFILL, LAY_FILL, LAY_CENTER, LAY_RIGHT | LAY_BOTTOM, LAY_HCENTER | LAY_TOP,
+    };
+    uint32_t seed = 12345;
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 600, 400);
+    lay_set_contain(ctx, root, contain);
+    if (contain == LAY_GRID) {
+        static const lay_track columns[4] = {
+            { LAY_TRACK_FIXED, 80 }, { LAY_TRACK_AUTO, 0 }, { LAY_TRACK_FILL, 0 }, { LAY_TRACK_AUTO, 0 },
+        };
+        lay_set_grid_columns(ctx, root, columns, 4);
+    }
+    lay_id last = LAY_INVALID_ID;
+    for (uint32_t i = 0; i < num_children; ++i) {
+        lay_id child = lay_item(ctx);
+        lay_set_size_xy(ctx, child,
+            (lay_scalar)(10 + lbench_rand(&seed) % 20), (lay_scalar)(8 + lbench_rand(&seed) % 12));
+        switch (mix) {
+        case LBENCH_MIX_FIXED:
+            break;
+        case LBENCH_MIX_FILL:
+            lay_set_behave(ctx, child, LAY_FILL);
+            break;
+        case LBENCH_MIX_MIXED:
+        case LBENCH_MIX_EXT:
+            lay_set_behave(ctx, child, behaves[lbench_rand(&seed) % (sizeof(behaves) / sizeof(behaves[0]))]);
+            lay_set_margins_ltrb(ctx, child,
+                (lay_scalar)(lbench_rand(&seed) % 4), (lay_scalar)(lbench_rand(&seed) % 4),
+                (lay_scalar)(lbench_rand(&seed) % 4), (lay_scalar)(lbench_rand(&seed) % 4));
+            if (mix == LBENCH_MIX_EXT && i % 2 == 0) {
+                lay_set_min_size_xy(ctx, child, 6, 4);
+                lay_set_max_size_xy(ctx, child, (lay_scalar)(40 + lbench_rand(&seed) % 40), 30);
+                lay_set_weights(ctx, child,
+                    (uint16_t)(1 + lbench_rand(&seed) % 3), (uint16_t)(1 + lbench_rand(&seed) % 3));
+            }
+            break;
+        default:
+            break;
+        }
+        lbench_add(ctx, root, &last, child);
+    }
+}
+
+// Returns the mean time per child, in nanoseconds
+static double lbench_kernel_run(
+        const lbench_kernel *k, lbench_kernel_mix mix, uint32_t num_children, uint64_t *samples)
+{
+    lay_context ctx;
+    lay_init_context(&ctx);
+    lbench_kernel_build(&ctx, k->contain, mix, num_children);
+    const lay_id root = 0;
+    const uint32_t box_model = k->contain & LAY_ITEM_BOX_MODEL_MASK;
+
+    // The steps of lay_run_context before this kernel's. For a size kernel,
+    // this includes the kernel itself, on the children.
+    lay_calc_size(&ctx, root, 0);
+    if (k->dim == 1) {
+        lay_arrange(&ctx, root, 0);
+        lay_calc_size(&ctx, root, 1);
+    }
+    const lay_id count = lay_items_count(&ctx);
+    lay_vec4 *saved = (lay_vec4*)malloc(count * sizeof(lay_vec4));
+    memcpy(saved, ctx.rects, count * sizeof(lay_vec4));
+
+    const uint32_t calls = num_children < LBENCH_KERNEL_VISITS ? LBENCH_KERNEL_VISITS / num_children : 1;
+    const lay_calc_size_kernel size_kernel = lay_calc_size_kernels[k->dim][box_model];
+    const lay_arrange_kernel arrange_kernel = lay_arrange_kernels[k->dim][box_model];
+    // Keeps the size kernels from being optimized out
+    volatile lay_scalar sink = 0;
+    const uint32_t warmup = LBENCH_KERNEL_SAMPLES / 10;
+    for (uint32_t i = 0; i < warmup + LBENCH_KERNEL_SAMPLES; ++i) {
+        memcpy(ctx.rects, saved, count * sizeof(lay_vec4));
+        uint64_t t = stm_now();
+        if (k->arrange) {
+            for (uint32_t c = 0; c < calls; ++c)
+                arrange_kernel(&ctx, root);
+        } else {
+            for (uint32_t c = 0; c < calls; ++c)
+                sink = size_kernel(&ctx, root);
+        }
+        const uint64_t ticks = stm_since(t);
+        if (i >= warmup)
+            samples[i - warmup] = ticks;
+    }
+    (void)sink;
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < LBENCH_KERNEL_SAMPLES; ++i)
+        sum += stm_ns(samples[i]);
+    free(saved);
+    lay_destroy_context(&ctx);
+    return sum / LBENCH_KERNEL_SAMPLES / ((double)calls * num_children);
+}
+
+static void lbench_kernels_all(void)
+{
+    static const uint32_t child_counts[] = { 4, 16, 64, 256, 1024 };
+    const size_t num_counts = sizeof(child_counts) / sizeof(child_counts[0]);
+    uint64_t *samples = (uint64_t*)calloc(LBENCH_KERNEL_SAMPLES, sizeof(uint64_t));
+    if (lbench_opts.format == LBENCH_TEXT) {
+        printf("%-34s %-6s", "kernel (ns/child)", "mix");
+        for (size_t n = 0; n < num_counts; ++n)
+            printf(" %8u", (unsigned)child_counts[n]);
+        printf("\n");
+    }
+    for (size_t k = 0; k < sizeof(lbench_kernels) / sizeof(lbench_kernels[0]); ++k) {
+        for (int mix = 0; mix < LBENCH_NUM_MIXES; ++mix) {
+            if (lbench_opts.format == LBENCH_TEXT)
+                printf("%-34s %-6s", lbench_kernels[k].name, lbench_mix_names[mix]);
+            for (size_t n = 0; n < num_counts; ++n) {
+                const uint32_t num_children = child_counts[n];
+                const double per_child = lbench_kernel_run(
+                    &lbench_kernels[k], (lbench_kernel_mix)mix, num_children, samples);
+                if (lbench_opts.format == LBENCH_TEXT) {
+                    printf(" %8.2f", per_child);
+                } else {
+                    char name[96];
+                    snprintf(name, sizeof(name), "kernel/%s/%s/%u",
+                        lbench_kernels[k].name, lbench_mix_names[mix], (unsigned)num_children);
+                    // Each sample visits calls * num_children children
+                    const uint32_t calls = num_children < LBENCH_KERNEL_VISITS ? LBENCH_KERNEL_VISITS / num_children : 1;
+                    lbench_report(name, calls * num_children, samples, LBENCH_KERNEL_SAMPLES, NULL);
+                }
+            }
+            if (lbench_opts.format == LBENCH_TEXT) {
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+    free(samples);
+}
+
+// Multithreaded throughput
+//
+// Like a server laying out many independent documents at once: every thread
+// owns LBENCH_DOCUMENTS contexts and lays them out in turn, building an
+// application tree of LBENCH_DOCUMENT_ITEMS items and running it each time.
+// This runs with 1, 2, 4, ... threads up to max_threads, and reports the total
+// layouts per second, how close that is to linear scaling from one thread, and
+// the distribution of the time each layout took.
+//
+// In the "reuse" mode the contexts are reset between layouts, so after the
+// first few layouts no memory is allocated. In the "fresh" mode every layout
+// gets a new context, so the buffers are allocated through LAY_REALLOC again
+// each time, which shows contention in the allocator.
+#define LBENCH_DOCUMENTS 8
+#define LBENCH_DOCUMENT_ITEMS 1000
+#define LBENCH_LAYOUTS_PER_THREAD 2000
+
+typedef struct lbench_worker {
+    bool fresh;
+    uint64_t *samples;
+} lbench_worker;
+
+static void lbench_worker_run(lbench_worker *w)
+{
+    lay_context docs[LBENCH_DOCUMENTS];
+    for (int d = 0; d < LBENCH_DOCUMENTS; ++d)
+        lay_init_context(&docs[d]);
+    for (uint32_t i = 0; i < LBENCH_LAYOUTS_PER_THREAD; ++i) {
+        lay_context *ctx = &docs[i % LBENCH_DOCUMENTS];
+        uint64_t t = stm_now();
+        if (w->fresh) {
+            lay_destroy_context(ctx);
+            lay_init_context(ctx);
+        } else {
+            lay_reset_context(ctx);
+        }
+        lbench_gen_app(ctx, LBENCH_DOCUMENT_ITEMS);
+        lay_run_context(ctx);
+        w->samples[i] = stm_since(t);
+    }
+    for (int d = 0; d < LBENCH_DOCUMENTS; ++d)
+        lay_destroy_context(&docs[d]);
+}
+
+#ifdef _WIN32
+typedef HANDLE lbench_thread;
+
+static DWORD WINAPI lbench_thread_main(LPVOID arg)
+{
+    lbench_worker_run((lbench_worker*)arg);
+    return 0;
+}
+
+static bool lbench_thread_start(lbench_thread *thread, lbench_worker *w)
+{
+    *thread = CreateThread(NULL, 0, lbench_thread_main, w, 0, NULL);
+    return *thread != NULL;
+}
+
+static void lbench_thread_join(lbench_thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static uint32_t lbench_num_cores(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t lbench_thread;
+
+static void *lbench_thread_main(void *arg)
+{
+    lbench_worker_run((lbench_worker*)arg);
+    return NULL;
+}
+
+static bool lbench_thread_start(lbench_thread *thread, lbench_worker *w)
+{
+    return pthread_create(thread, NULL, lbench_thread_main, w) == 0;
+}
+
+static void lbench_thread_join(lbench_thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static uint32_t lbench_num_cores(void)
+{
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+}
+#endif
+
+// Runs num_threads workers and returns the wall clock time until the last
+// one is done. Their samples go one after the other into samples.
+static uint64_t lbench_threads_once(uint32_t num_threads, bool fresh, uint64_t *samples)
+{
+    lbench_worker *workers = (lbench_worker*)calloc(num_threads, sizeof(lbench_worker));
+    lbench_thread *threads = (lbench_thread*)calloc(num_threads, sizeof(lbench_thread));
+    const uint64_t start = stm_now();
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        workers[i].fresh = fresh;
+        workers[i].samples = samples + (size_t)i * LBENCH_LAYOUTS_PER_THREAD;
+        if (!lbench_thread_start(&threads[i], &workers[i])) {
+            fprintf(stderr, "Can't start thread %u\n", (unsigned)i);
+            exit(1);
+        }
+    }
+    for (uint32_t i = 0; i < num_threads; ++i)
+        lbench_thread_join(threads[i]);
+    const uint64_t wall = stm_since(start);
+    free(threads);
+    free(workers);
+    return wall;
+}
+
+static void lbench_threads(uint32_t max_threads)
+{
+    FILE *log = lbench_log();
+    fprintf(log, "%-6s %8s %14s %11s %10s %10s\n",
+        "mode", "threads", "layouts/s", "efficiency", "p50 us", "p99 us");
+    uint64_t *samples = (uint64_t*)calloc((size_t)max_threads * LBENCH_LAYOUTS_PER_THREAD, sizeof(uint64_t));
+    for (int fresh = 0; fresh < 2; ++fresh) {
+        const char *mode = fresh ? "fresh" : "reuse";
+        double single = 0.0;
+        // Warmup, and to fault in the allocator's memory
+        lbench_threads_once(1, fresh != 0, samples);
+        for (uint32_t n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+            const uint64_t wall = lbench_threads_once(n, fresh != 0, samples);
+            const uint32_t count = n * LBENCH_LAYOUTS_PER_THREAD;
+            const double per_second = (double)count / stm_sec(wall);
+            if (n == 1)
+                single = per_second;
+            const double efficiency = per_second / ((double)n * single);
+            char name[64];
+            snprintf(name, sizeof(name), "threads/%s/%u", mode, (unsigned)n);
+            if (lbench_opts.format == LBENCH_TEXT) {
+                const lbench_stats st = lbench_compute_stats(samples, count);
+                printf("%-6s %8u %14.0f %10.1f%% %10.2f %10.2f\n",
+                    mode, (unsigned)n, per_second, 100.0 * efficiency, st.p50 / 1000.0, st.p99 / 1000.0);
+                fflush(stdout);
+            } else {
+                fprintf(log, "%-6s %8u %14.0f %10.1f%%\n", mode, (unsigned)n, per_second, 100.0 * efficiency);
+                lbench_report(name, LBENCH_DOCUMENT_ITEMS, samples, count, NULL);
+            }
+            if (n == max_threads)
+                break;
+        }
+    }
+    free(samples);
 }
 
 // Call in main to run a test by name
@@ -240,40 +1600,188 @@ static inline void benchmark_nested(lay_context *ctx)
     lay_reset_context(&ctx); \
     printf(" * " #testname "\n");
 
+static void print_usage(void)
+{
+    printf(
+        "Usage: lay_bench [options] [suite [max_items] | replay <trace> | threads [max_threads] | kernels]\n"
+        "       lay_bench compare <old.csv> <new.csv> [--threshold=<percent>]\n"
+        "    With no arguments, runs the nested and mixed container benchmarks.\n"
+        "    suite runs the generated trees with 10^2 up to max_items items\n"
+        "    (default 10^6, at most 10^7).\n"
+        "    replay times a trace recorded by a LAY_RECORD build, with the layout\n"
+        "    runs timed separately from building the tree.\n"
+        "    threads lays out independent contexts on 1 up to max_threads threads\n"
+        "    (default: the number of cores) and reports layouts per second.\n"
+        "    kernels times each size and arrange kernel on its own, per child, for\n"
+        "    4 to 1024 children with several mixes of child flags.\n"
+        "    compare reports significant changes between two --format=csv runs,\n"
+        "    and exits with 1 if anything got slower by more than the threshold\n"
+        "    (default 2%%).\n"
+        "Options:\n"
+        "    --format=<text|json|csv>  Output format. Default: text\n"
+        "    --runs=<n>                Timed runs per benchmark. Default: 100000\n"
+        "    --warmup=<n>              Untimed runs before those. Default: 1000\n"
+        "    --histogram               Also report a histogram of the run times\n"
+        "    --counters                Also count cycles, instructions, cache and\n"
+        "                              branch misses per item (Linux perf events)\n");
+}
+
+static bool lbench_parse_option(const char *arg)
+{
+    if (strcmp(arg, "--format=text") == 0)
+        lbench_opts.format = LBENCH_TEXT;
+    else if (strcmp(arg, "--format=json") == 0)
+        lbench_opts.format = LBENCH_JSON;
+    else if (strcmp(arg, "--format=csv") == 0)
+        lbench_opts.format = LBENCH_CSV;
+    else if (strncmp(arg, "--runs=", 7) == 0)
+        lbench_opts.runs = (uint32_t)strtoul(arg + 7, NULL, 10);
+    else if (strncmp(arg, "--warmup=", 9) == 0)
+        lbench_opts.warmup = (uint32_t)strtoul(arg + 9, NULL, 10);
+    else if (strcmp(arg, "--histogram") == 0)
+        lbench_opts.histogram = true;
+    else if (strcmp(arg, "--counters") == 0)
+        lbench_opts.counters = true;
+    else
+        return false;
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    (void)argc;
-    (void)argv;
 #ifdef _WIN32
     SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX);
     SetUnhandledExceptionFilter(LayTestUnhandledExceptionFilter);
 #endif
     stm_setup();
 
+    if (argc > 1 && strcmp(argv[1], "compare") == 0) {
+        double threshold = 2.0;
+        if (argc == 5 && strncmp(argv[4], "--threshold=", 12) == 0)
+            threshold = strtod(argv[4] + 12, NULL);
+        else if (argc != 4) {
+            print_usage();
+            return 2;
+        }
+        return lbench_compare(argv[2], argv[3], threshold);
+    }
+
+    int argi = 1;
+    while (argi < argc && strncmp(argv[argi], "--", 2) == 0) {
+        if (!lbench_parse_option(argv[argi])) {
+            print_usage();
+            return 1;
+        }
+        ++argi;
+    }
+    if (lbench_opts.runs == 0) {
+        print_usage();
+        return 1;
+    }
+    if (lbench_opts.counters && !lbench_counters_open()) {
+        fprintf(stderr, "Hardware performance counters aren't available, reporting times only\n");
+        lbench_opts.counters = false;
+    }
+
+    if (argi < argc && strcmp(argv[argi], "replay") == 0) {
+        if (argc - argi != 2) {
+            print_usage();
+            return 1;
+        }
+        return lbench_replay(argv[argi + 1]);
+    }
+
+    if (argi < argc && strcmp(argv[argi], "kernels") == 0) {
+        if (argc - argi != 1) {
+            print_usage();
+            return 1;
+        }
+        fprintf(lbench_log(), "Running kernel microbenchmarks\n");
+        lbench_report_begin();
+        lbench_kernels_all();
+        lbench_report_end();
+        return 0;
+    }
+
+    if (argi < argc && strcmp(argv[argi], "threads") == 0) {
+        unsigned long max_threads = argc - argi > 1 ? strtoul(argv[argi + 1], NULL, 10) : lbench_num_cores();
+        if (argc - argi > 2 || max_threads < 1 || max_threads > 1024) {
+            print_usage();
+            return 1;
+        }
+        fprintf(lbench_log(), "Running %d layouts of %d items per thread\n",
+            LBENCH_LAYOUTS_PER_THREAD, LBENCH_DOCUMENT_ITEMS);
+        lbench_report_begin();
+        lbench_threads((uint32_t)max_threads);
+        lbench_report_end();
+        return 0;
+    }
+
+    if (argi < argc) {
+        if (strcmp(argv[argi], "suite") != 0 || argc - argi > 2) {
+            print_usage();
+            return 1;
+        }
+        unsigned long max_items = argc - argi > 1 ? strtoul(argv[argi + 1], NULL, 10) : 1000000;
+        if (max_items < 100 || max_items > 10000000) {
+            print_usage();
+            return 1;
+        }
+        // Every item needs its own id
+        if (max_items > (unsigned long)LAY_INVALID_ID - 1)
+            max_items = (unsigned long)LAY_INVALID_ID - 1;
+        fprintf(lbench_log(), "Running benchmark suite\n");
+        lbench_report_begin();
+        lbench_suite((uint32_t)max_items);
+        lbench_report_end();
+        return 0;
+    }
+
     lay_context ctx;
     lay_init_context(&ctx);
 
-    printf("Running benchmarks\n");
+    fprintf(lbench_log(), "Running benchmarks\n");
+    lbench_report_begin();
 
     //LBENCH_RUN(benchmark_nested);
-    uint64_t total_perfc = 0;
-    const uint32_t num_runs = 100000;
+    const uint32_t warmup = lbench_opts.warmup;
+    const uint32_t num_runs = warmup + lbench_opts.runs;
     uint64_t *run_times = (uint64_t*)calloc(num_runs, sizeof(uint64_t));
+    benchmark_nested_ids nested_ids;
+    lbench_counts counts;
+    lbench_snapshot snap;
+    memset(&counts, 0, sizeof(counts));
     for (uint32_t run_n = 0; run_n < num_runs; ++run_n) {
+        if (run_n == warmup)
+            lbench_counters_start(&snap);
         lay_reset_context(&ctx);
         uint64_t t1 = stm_now();
         //printf(" * " #testname "\n");
-        benchmark_nested(&ctx);
-        uint64_t diff = stm_since(t1);
-        total_perfc += diff;
-        run_times[run_n] = diff;
+        benchmark_nested(&ctx, &nested_ids);
+        run_times[run_n] = stm_since(t1);
         //double seconds = perf_seconds(freq, diff);
         //printf("Run %d: %f microsecs\n", run_n + 1, seconds * 1000000.0);
     }
+    lbench_counters_lap(&snap, &counts);
+    benchmark_nested_check(&ctx, &nested_ids);
+    lbench_report("nested", lay_items_count(&ctx), run_times + warmup, num_runs - warmup, &counts);
 
-    double avg = stm_us(total_perfc) / (double)num_runs;
-    printf("Average time: %f usecs", avg);
+    // Mixed containers: the tree is built once, and only lay_run_context is
+    // timed, since that's where the box model dispatch happens.
+    lay_reset_context(&ctx);
+    benchmark_mixed_build(&ctx);
+    memset(&counts, 0, sizeof(counts));
+    for (uint32_t run_n = 0; run_n < num_runs; ++run_n) {
+        if (run_n == warmup)
+            lbench_counters_start(&snap);
+        uint64_t t1 = stm_now();
+        lay_run_context(&ctx);
+        run_times[run_n] = stm_since(t1);
+    }
+    lbench_counters_lap(&snap, &counts);
+    lbench_report("mixed", lay_items_count(&ctx), run_times + warmup, num_runs - warmup, &counts);
 
+    lbench_report_end();
     free(run_times);
 
     lay_destroy_context(&ctx);
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#define LAY_IMPLEMENTATION
+#include "layout.h"
+#undef LAY_IMPLEMENTATION
+
+// This program is built twice. The first build (without LAY_CODEGEN_VERIFY)
+// builds each of the trees below and writes a compiled layout function for
+// each of them to stdout. The second build includes that output and checks the
+// compiled functions against lay_run_context over a range of parameter values.
+//
+// tool.bash does both steps for you:
+//
+//   ./tool.bash build debug codegen && build/debug/lay_codegen
+
+#ifndef LAY_CODEGEN_VERIFY
+#define LAY_CODEGEN_IMPLEMENTATION
+#include "layout_codegen.h"
+#else
+#include "layout_codegen.h"
+#include "lay_codegen_out.c"
+#endif
+
+#define LCG_MAX_PARAMS 8
+
+typedef void (*lcg_build_fn)(lay_context *ctx, lay_codegen_param *params, uint32_t *num_params);
+typedef void (*lcg_compiled_fn)(const lay_scalar *params, lay_vec4 *rects);
+
+static void lcg_param(
+        lay_codegen_param *params, uint32_t *num_params, lay_id item, int dim)
+{
+    params[*num_params].item = item;
+    params[*num_params].dim = dim;
+    ++*num_params;
+}
+
+// A typical application screen: a sidebar whose width is a parameter, and a
+// content view with a header, a filling body and a footer of buttons.
+static void lcg_build_app(lay_context *ctx, lay_codegen_param *params, uint32_t *num_params)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 1280, 720);
+    lay_set_contain(ctx, root, LAY_ROW);
+    lcg_param(params, num_params, root, 0);
+    lcg_param(params, num_params, root, 1);
+
+    lay_id sidebar = lay_item(ctx);
+    lay_insert(ctx, root, sidebar);
+    lay_set_size_xy(ctx, sidebar, 200, 0);
+    lay_set_behave(ctx, sidebar, LAY_VFILL);
+    lay_set_contain(ctx, sidebar, LAY_COLUMN | LAY_START);
+    lay_set_margins_ltrb(ctx, sidebar, 4, 4, 2, 4);
+    lcg_param(params, num_params, sidebar, 0);
+    for (int i = 0; i < 6; ++i) {
+        lay_id entry = lay_item(ctx);
+        lay_insert(ctx, sidebar, entry);
+        lay_set_size_xy(ctx, entry, 0, 24);
+        lay_set_behave(ctx, entry, LAY_HFILL);
+        lay_set_margins_ltrb(ctx, entry, 2, 1, 2, 1);
+    }
+
+    lay_id content = lay_item(ctx);
+    lay_insert(ctx, root, content);
+    lay_set_behave(ctx, content, LAY_FILL);
+    lay_set_contain(ctx, content, LAY_COLUMN);
+
+    lay_id header = lay_item(ctx);
+    lay_insert(ctx, content, header);
+    lay_set_size_xy(ctx, header, 0, 40);
+    lay_set_behave(ctx, header, LAY_HFILL | LAY_TOP);
+    lcg_param(params, num_params, header, 1);
+
+    lay_id title = lay_item(ctx);
+    lay_insert(ctx, header, title);
+    lay_set_size_xy(ctx, title, 180, 20);
+
+    lay_id close = lay_item(ctx);
+    lay_insert(ctx, header, close);
+    lay_set_size_xy(ctx, close, 16, 16);
+    lay_set_behave(ctx, close, LAY_RIGHT | LAY_TOP);
+    lay_set_margins_ltrb(ctx, close, 0, 3, 5, 0);
+
+    lay_id body = lay_item(ctx);
+    lay_insert(ctx, content, body);
+    lay_set_behave(ctx, body, LAY_FILL);
+    lay_set_contain(ctx, body, LAY_ROW | LAY_JUSTIFY);
+    for (int i = 0; i < 3; ++i) {
+        lay_id card = lay_item(ctx);
+        lay_insert(ctx, body, card);
+        lay_set_size_xy(ctx, card, (lay_scalar)(90 + 30 * i), 0);
+        lay_set_behave(ctx, card, i == 1 ? LAY_VFILL : LAY_VCENTER);
+        lay_set_margins_ltrb(ctx, card, 3, 3, 3, 3);
+        lay_id inner = lay_item(ctx);
+        lay_insert(ctx, card, inner);
+        lay_set_size_xy(ctx, inner, 0, 50);
+        lay_set_behave(ctx, inner, LAY_HFILL | LAY_BOTTOM);
+    }
+
+    lay_id footer = lay_item(ctx);
+    lay_insert(ctx, content, footer);
+    lay_set_behave(ctx, footer, LAY_HFILL);
+    lay_set_contain(ctx, footer, LAY_ROW | LAY_END);
+    for (int i = 0; i < 3; ++i) {
+        lay_id button = lay_item(ctx);
+        lay_insert(ctx, footer, button);
+        lay_set_size_xy(ctx, button, 70, 24);
+        lay_set_margins_ltrb(ctx, button, 4, 4, 4, 4);
+    }
+}
+
+// Rows that are too small for their children, so that the squeezing paths are
+// exercised, plus centered and filling children of a free layout item.
+static void lcg_build_squeeze(lay_context *ctx, lay_codegen_param *params, uint32_t *num_params)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 120, 90);
+    lay_set_contain(ctx, root, LAY_COLUMN);
+    lcg_param(params, num_params, root, 0);
+    lcg_param(params, num_params, root, 1);
+
+    lay_id row = lay_item(ctx);
+    lay_insert(ctx, root, row);
+    lay_set_behave(ctx, row, LAY_HFILL);
+    lay_set_contain(ctx, row, LAY_ROW);
+    for (int i = 0; i < 5; ++i) {
+        // Squeezable: sized by an inner item, not by an explicit size
+        lay_id cell = lay_item(ctx);
+        lay_insert(ctx, row, cell);
+        lay_set_margins_ltrb(ctx, cell, 1, 0, 2, 0);
+        lay_id sizer = lay_item(ctx);
+        lay_insert(ctx, cell, sizer);
+        lay_set_size_xy(ctx, sizer, (lay_scalar)(17 + 5 * i), 9);
+        if (i == 2)
+            lcg_param(params, num_params, sizer, 0);
+    }
+
+    lay_id overlay = lay_item(ctx);
+    lay_insert(ctx, root, overlay);
+    lay_set_behave(ctx, overlay, LAY_FILL);
+    lay_set_margins_ltrb(ctx, overlay, 5, 5, 5, 5);
+    static const uint32_t behaves[] = {
+        LAY_CENTER, LAY_RIGHT | LAY_BOTTOM, LAY_HFILL | LAY_VCENTER,
+        LAY_VFILL | LAY_RIGHT, LAY_LEFT | LAY_TOP,
+    };
+    for (int i = 0; i < 5; ++i) {
+        lay_id child = lay_item(ctx);
+        lay_insert(ctx, overlay, child);
+        lay_set_size_xy(ctx, child, (lay_scalar)(11 + i * 7), (lay_scalar)(13 + i * 3));
+        lay_set_behave(ctx, child, behaves[i]);
+        lay_set_margins_ltrb(ctx, child, (lay_scalar)i, 2, (lay_scalar)(3 - i), 1);
+    }
+
+    lay_id column = lay_item(ctx);
+    lay_insert(ctx, root, column);
+    lay_set_size_xy(ctx, column, 0, 30);
+    lay_set_behave(ctx, column, LAY_HFILL);
+    lay_set_contain(ctx, column, LAY_COLUMN | LAY_MIDDLE);
+    for (int i = 0; i < 3; ++i) {
+        lay_id child = lay_item(ctx);
+        lay_insert(ctx, column, child);
+        lay_set_size_xy(ctx, child, 40, 7);
+        lay_set_behave(ctx, child, i == 0 ? LAY_LEFT : (i == 1 ? LAY_HCENTER : LAY_RIGHT));
+    }
+}
+
+typedef struct lcg_case {
+    const char *name;
+    lcg_build_fn build;
+#ifdef LAY_CODEGEN_VERIFY
+    lcg_compiled_fn compiled;
+#endif
+} lcg_case;
+
+#ifdef LAY_CODEGEN_VERIFY
+#define LCG_CASE(name) { #name, lcg_build_##name, lay_compiled_##name }
+#else
+#define LCG_CASE(name) { #name, lcg_build_##name }
+#endif
+
+static const lcg_case lcg_cases[] = {
+    LCG_CASE(app),
+    LCG_CASE(squeeze),
+};
+
+#undef LCG_CASE
+
+#ifndef LAY_CODEGEN_VERIFY
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    lay_context ctx;
+    lay_init_context(&ctx);
+
+    for (size_t i = 0; i < sizeof(lcg_cases) / sizeof(lcg_cases[0]); ++i) {
+        lay_codegen_param params[LCG_MAX_PARAMS];
+        uint32_t num_params = 0;
+        char function_name[64];
+        lay_reset_context(&ctx);
+        lcg_cases[i].build(&ctx, params, &num_params);
+        snprintf(function_name, sizeof(function_name), "lay_compiled_%s", lcg_cases[i].name);
+        if (lay_codegen_emit(stdout, &ctx, 0, params, num_params, function_name) != 0) {
+            fprintf(stderr, "Failed to compile layout %s\n", lcg_cases[i].name);
+            return 1;
+        }
+    }
+
+    lay_destroy_context(&ctx);
+    return 0;
+}
+
+#else // LAY_CODEGEN_VERIFY
+
+static bool lcg_verify(const lcg_case *c, lay_context *ctx, uint32_t *num_checked)
+{
+    lay_codegen_param params[LCG_MAX_PARAMS];
+    uint32_t num_params = 0;
+    lay_reset_context(ctx);
+    c->build(ctx, params, &num_params);
+
+    const lay_id count = lay_items_count(ctx);
+    lay_vec4 *compiled_rects = (lay_vec4*)calloc(count, sizeof(lay_vec4));
+    lay_scalar values[LCG_MAX_PARAMS];
+    bool ok = true;
+
+    for (uint32_t step = 0; step < 500 && ok; ++step) {
+        // Sweep each parameter over a different range of non-zero values, from
+        // much smaller than the children need to much larger.
+        for (uint32_t p = 0; p < num_params; ++p) {
+            uint32_t span = 40 + 97 * p;
+            lay_scalar v = (lay_scalar)(1 + (step * (7 + 2 * p)) % (span + 4 * step % 1500));
+#if LAY_FLOAT == 1
+            v += (lay_scalar)((step + p) % 4) * 0.25f;
+#endif
+            values[p] = v;
+            lay_vec2 size = lay_get_size(ctx, params[p].item);
+            size[params[p].dim] = v;
+            lay_set_size(ctx, params[p].item, size);
+        }
+
+        lay_run_context(ctx);
+        LAY_MEMSET(compiled_rects, 0, count * sizeof(lay_vec4));
+        c->compiled(values, compiled_rects);
+
+        for (lay_id i = 0; i < count; ++i) {
+            lay_vec4 a = lay_get_rect(ctx, i);
+            lay_vec4 b = compiled_rects[i];
+            if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2] || a[3] != b[3]) {
+                printf("Mismatch in %s at step %u, item %u: engine %g %g %g %g, compiled %g %g %g %g\n",
+                    c->name, (unsigned)step, (unsigned)i,
+                    (double)a[0], (double)a[1], (double)a[2], (double)a[3],
+                    (double)b[0], (double)b[1], (double)b[2], (double)b[3]);
+                ok = false;
+                break;
+            }
+        }
+        ++*num_checked;
+    }
+
+    free(compiled_rects);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    lay_context ctx;
+    lay_init_context(&ctx);
+
+    printf("Verifying compiled layouts\n");
+    int result = 0;
+    for (size_t i = 0; i < sizeof(lcg_cases) / sizeof(lcg_cases[0]); ++i) {
+        uint32_t num_checked = 0;
+        printf(" * %s\n", lcg_cases[i].name);
+        if (!lcg_verify(&lcg_cases[i], &ctx, &num_checked))
+            result = 1;
+        else
+            printf("    %u parameter sets match\n", (unsigned)num_checked);
+    }
+    printf(result ? "Failed\n" : "Finished\n");
+
+    lay_destroy_context(&ctx);
+    return result;
+}
+
+#endif // LAY_CODEGEN_VERIFY
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define LAY_IMPLEMENTATION
+#include "layout.h"
+#undef LAY_IMPLEMENTATION
+#define LAY_REFERENCE_IMPLEMENTATION
+#include "layout_reference.h"
+
+// Differential testing of layout.h against the reference implementation in
+// layout_reference.h.
+//
+// Each iteration generates a random tree, lays it out with the reference, and
+// compares the result to every way of getting layout.h to lay out the same
+// tree: building it with lay_insert, with lay_append, in reverse id order with
+// lay_push, running it twice, and (when built with LAY_RECORD) replaying a
+// recording of it into another context. Integer builds must match exactly, and
+// LAY_FLOAT builds within LDIFF_TOLERANCE.
+//
+// When a tree doesn't match, it's reduced to a smaller one that still doesn't,
+// by removing subtrees and resetting properties one at a time, and printed as C
+// code that can be pasted into a test.
+//
+//   ./tool.bash build debug differential && build/debug/lay_differential [iterations [seed]]
+//
+// Iteration i uses seed + i, so a failure can be reproduced on its own with
+// `lay_differential 1 <seed it printed>`.
+
+#define LDIFF_MAX_ITEMS 48
+#define LDIFF_TOLERANCE 0.01f
+
+typedef struct ldiff_tree {
+    lay_ref_item items[LDIFF_MAX_ITEMS];
+    int32_t count;
+} ldiff_tree;
+
+static uint64_t ldiff_rng;
+
+static uint32_t ldiff_rand(uint32_t n)
+{
+    // xorshift64*
+    ldiff_rng ^= ldiff_rng >> 12;
+    ldiff_rng ^= ldiff_rng << 25;
+    ldiff_rng ^= ldiff_rng >> 27;
+    return (uint32_t)((ldiff_rng * 2685821657736338717ull) >> 32) % n;
+}
+
+static void ldiff_default_item(lay_ref_item *it, int32_t parent)
+{
+    memset(it, 0, sizeof(*it));
+    it->parent = parent;
+    it->grow_weight = 1;
+    it->shrink_weight = 1;
+}
+
+// Sizes and margins are kept small enough that nothing overflows int16.
+static void ldiff_gen_item(lay_ref_item *it, int32_t parent)
+{
+    static const uint32_t models[] = {
+        LAY_LAYOUT, LAY_ROW, LAY_COLUMN, LAY_ROW | LAY_WRAP, LAY_COLUMN | LAY_WRAP,
+        LAY_GRID, LAY_ROW, LAY_COLUMN,
+    };
+    static const uint32_t justify[] = { LAY_MIDDLE, LAY_START, LAY_END, LAY_JUSTIFY };
+    static const uint32_t anchors[] = { 0, LAY_LEFT, LAY_RIGHT, LAY_HFILL };
+    ldiff_default_item(it, parent);
+
+    it->contain = models[ldiff_rand(8)] | justify[ldiff_rand(4)];
+    it->behave = anchors[ldiff_rand(4)] | (anchors[ldiff_rand(4)] << 1);
+    if (ldiff_rand(6) == 0)
+        it->behave |= LAY_BREAK;
+    for (int dim = 0; dim < 2; ++dim) {
+        if (parent < 0)
+            it->size[dim] = (lay_scalar)(60 + ldiff_rand(300));
+        else if (ldiff_rand(2) == 0)
+            it->size[dim] = (lay_scalar)(1 + ldiff_rand(60));
+    }
+    if (ldiff_rand(3) == 0) {
+        for (int i = 0; i < 4; ++i)
+            it->margins[i] = (lay_scalar)((int)ldiff_rand(8) - 1);
+    }
+
+    if (ldiff_rand(3) != 0)
+        return;
+    it->ext = 1;
+    for (int dim = 0; dim < 2; ++dim) {
+        if (ldiff_rand(3) == 0)
+            it->min_size[dim] = (lay_scalar)ldiff_rand(30);
+        if (ldiff_rand(4) == 0)
+            it->max_size[dim] = (lay_scalar)(it->min_size[dim] + 1 + ldiff_rand(60));
+        if (ldiff_rand(2) == 0)
+            it->gap[dim] = (lay_scalar)ldiff_rand(5);
+    }
+    if (ldiff_rand(2) == 0) {
+        it->grow_weight = (uint16_t)ldiff_rand(4);
+        it->shrink_weight = (uint16_t)ldiff_rand(4);
+    }
+    if ((it->contain & LAY_ITEM_BOX_MODEL_MASK) == LAY_GRID) {
+        it->num_columns = ldiff_rand(4);
+        for (uint32_t c = 0; c < it->num_columns; ++c) {
+            it->columns[c].kind = (lay_track_kind)ldiff_rand(3);
+            it->columns[c].size = it->columns[c].kind == LAY_TRACK_FIXED
+                ? (lay_scalar)(5 + ldiff_rand(40)) : 0;
+        }
+    }
+}
+
+// In preorder, the parent of the next item is on the path from the root to the
+// previous item.
+static void ldiff_gen_tree(ldiff_tree *t, int32_t max_items)
+{
+    int32_t path[LDIFF_MAX_ITEMS];
+    int32_t depth = 0;
+    t->count = 1 + (int32_t)ldiff_rand((uint32_t)max_items);
+    ldiff_gen_item(&t->items[0], -1);
+    path[depth++] = 0;
+    for (int32_t i = 1; i < t->count; ++i) {
+        depth = 1 + (int32_t)ldiff_rand((uint32_t)depth);
+        ldiff_gen_item(&t->items[i], path[depth - 1]);
+        path[depth++] = i;
+    }
+}
+
+// Engine variants
+// ---------------
+
+static void ldiff_apply(lay_context *ctx, lay_id id, const lay_ref_item *it)
+{
+    lay_set_contain(ctx, id, it->contain);
+    lay_set_behave(ctx, id, it->behave);
+    lay_set_size_xy(ctx, id, it->size[0], it->size[1]);
+    lay_set_margins_ltrb(ctx, id, it->margins[0], it->margins[1], it->margins[2], it->margins[3]);
+    if (!it->ext)
+        return;
+    lay_set_min_size_xy(ctx, id, it->min_size[0], it->min_size[1]);
+    lay_set_max_size_xy(ctx, id, it->max_size[0], it->max_size[1]);
+    lay_set_gap(ctx, id, it->gap[0], it->gap[1]);
+    lay_set_weights(ctx, id, it->grow_weight, it->shrink_weight);
+    if (it->num_columns > 0)
+        lay_set_grid_columns(ctx, id, it->columns, it->num_columns);
+}
+
+static void ldiff_build_insert(lay_context *ctx, const ldiff_tree *t, lay_id *ids)
+{
+    for (int32_t i = 0; i < t->count; ++i) {
+        ids[i] = lay_item(ctx);
+        ldiff_apply(ctx, ids[i], &t->items[i]);
+        if (i > 0)
+            lay_insert(ctx, ids[t->items[i].parent], ids[i]);
+    }
+}
+
+static void ldiff_build_append(lay_context *ctx, const ldiff_tree *t, lay_id *ids)
+{
+    int32_t last_child[LDIFF_MAX_ITEMS];
+    for (int32_t i = 0; i < t->count; ++i) {
+        ids[i] = lay_item(ctx);
+        ldiff_apply(ctx, ids[i], &t->items[i]);
+        last_child[i] = -1;
+        if (i == 0)
+            continue;
+        const int32_t parent = t->items[i].parent;
+        if (last_child[parent] < 0)
+            lay_insert(ctx, ids[parent], ids[i]);
+        else
+            lay_append(ctx, ids[last_child[parent]], ids[i]);
+        last_child[parent] = i;
+    }
+}
+
+// The root has to be item 0, but the other ids are in reverse order, and each
+// child is pushed in front of the ones after it.
+static void ldiff_build_push(lay_context *ctx, const ldiff_tree *t, lay_id *ids)
+{
+    ids[0] = lay_item(ctx);
+    ldiff_apply(ctx, ids[0], &t->items[0]);
+    for (int32_t i = t->count - 1; i > 0; --i) {
+        ids[i] = lay_item(ctx);
+        ldiff_apply(ctx, ids[i], &t->items[i]);
+    }
+    for (int32_t i = t->count - 1; i > 0; --i)
+        lay_push(ctx, ids[t->items[i].parent], ids[i]);
+}
+
+typedef struct ldiff_engine {
+    lay_context ctx;
+    // For replaying recordings
+    lay_context replayed;
+} ldiff_engine;
+
+enum {
+    LDIFF_INSERT,
+    LDIFF_APPEND,
+    LDIFF_PUSH,
+    LDIFF_RERUN,
+#ifdef LAY_RECORD
+    LDIFF_REPLAY,
+#endif
+    LDIFF_VARIANTS
+};
+
+static const char *const ldiff_variant_names[] = {
+    "lay_insert",
+    "lay_append",
+    "lay_push, reverse ids",
+    "lay_run_context twice",
+#ifdef LAY_RECORD
+    "replayed recording",
+#endif
+};
+
+// Lays out the tree with one of the variants, and returns the context that
+// holds the result.
+static lay_context *ldiff_run_variant(ldiff_engine *e, int variant, const ldiff_tree *t, lay_id *ids)
+{
+    lay_context *ctx = &e->ctx;
+    lay_reset_context(ctx);
+    switch (variant) {
+    case LDIFF_APPEND:
+        ldiff_build_append(ctx, t, ids);
+        break;
+    case LDIFF_PUSH:
+        ldiff_build_push(ctx, t, ids);
+        break;
+    default:
+        ldiff_build_insert(ctx, t, ids);
+        break;
+    }
+#ifdef LAY_RECORD
+    if (variant == LDIFF_REPLAY) {
+        lay_reset_context(ctx);
+        lay_record_start(ctx);
+        ldiff_build_insert(ctx, t, ids);
+        lay_run_context(ctx);
+        lay_record_stop(ctx);
+        size_t size, offset;
+        const uint8_t *data = lay_record_data(ctx, &size);
+        lay_reset_context(&e->replayed);
+        if (lay_replay_begin(data, size, &offset) == 0)
+            while (lay_replay_next(&e->replayed, data, size, &offset) > 0) {}
+        return &e->replayed;
+    }
+#endif
+    lay_run_context(ctx);
+    if (variant == LDIFF_RERUN)
+        lay_run_context(ctx);
+    return ctx;
+}
+
+static bool ldiff_scalar_eq(lay_scalar a, lay_scalar b)
+{
+#ifdef LAY_FLOAT
+    const float d = a - b;
+    return d <= LDIFF_TOLERANCE && d >= -LDIFF_TOLERANCE;
+#else
+    return a == b;
+#endif
+}
+
+typedef struct ldiff_mismatch {
+    int variant;
+    int32_t item;
+    lay_vec4 engine;
+    lay_vec4 reference;
+} ldiff_mismatch;
+
+// Returns true if every variant matches the reference. Otherwise, describes the
+// first item that doesn't in *m.
+static bool ldiff_check(ldiff_engine *e, const ldiff_tree *t, ldiff_mismatch *m)
+{
+    lay_vec4 expected[LDIFF_MAX_ITEMS];
+    lay_id ids[LDIFF_MAX_ITEMS];
+    lay_ref_run(t->items, t->count, expected);
+    for (int variant = 0; variant < LDIFF_VARIANTS; ++variant) {
+        lay_context *ctx = ldiff_run_variant(e, variant, t, ids);
+        for (int32_t i = 0; i < t->count; ++i) {
+            const lay_vec4 a = lay_get_rect(ctx, ids[i]);
+            const lay_vec4 b = expected[i];
+            if (!ldiff_scalar_eq(a[0], b[0]) || !ldiff_scalar_eq(a[1], b[1])
+                    || !ldiff_scalar_eq(a[2], b[2]) || !ldiff_scalar_eq(a[3], b[3])) {
+                m->variant = variant;
+                m->item = i;
+                m->engine = a;
+                m->reference = b;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Minimizing
+// ----------
+
+// Removes item and its descendants, which follow it in preorder.
+static void ldiff_remove_subtree(ldiff_tree *t, int32_t item)
+{
+    int32_t end = item + 1;
+    for (;;) {
+        int32_t p = end < t->count ? t->items[end].parent : -1;
+        while (p > item)
+            p = t->items[p].parent;
+        if (p != item)
+            break;
+        ++end;
+    }
+    const int32_t removed = end - item;
+    for (int32_t i = end; i < t->count; ++i) {
+        t->items[i - removed] = t->items[i];
+        if (t->items[i - removed].parent > item)
+            t->items[i - removed].parent -= removed;
+    }
+    t->count -= removed;
+}
+
+// Resets one kind of property of an item to its default. Returns false if it
+// already had the default.
+static bool ldiff_simplify(lay_ref_item *it, int kind)
+{
+    lay_ref_item before = *it;
+    lay_ref_item defaults;
+    ldiff_default_item(&defaults, it->parent);
+    switch (kind) {
+    case 0: memset(it->margins, 0, sizeof(it->margins)); break;
+    case 1: it->size[0] = 0; break;
+    case 2: it->size[1] = 0; break;
+    case 3: it->behave &= LAY_BREAK; break;
+    case 4: it->behave &= ~(uint32_t)LAY_BREAK; break;
+    case 5: it->contain &= ~(uint32_t)LAY_JUSTIFY; break;
+    case 6: it->contain &= LAY_JUSTIFY; break;
+    case 7:
+        // Everything that needs LAY_ITEM_EXT
+        defaults.parent = it->parent;
+        defaults.contain = it->contain;
+        defaults.behave = it->behave;
+        memcpy(defaults.size, it->size, sizeof(it->size));
+        memcpy(defaults.margins, it->margins, sizeof(it->margins));
+        *it = defaults;
+        break;
+    case 8: memset(it->min_size, 0, sizeof(it->min_size)); break;
+    case 9: memset(it->max_size, 0, sizeof(it->max_size)); break;
+    case 10: memset(it->gap, 0, sizeof(it->gap)); break;
+    case 11: it->grow_weight = 1; it->shrink_weight = 1; break;
+    case 12: it->num_columns = 0; break;
+    default: return false;
+    }
+    return memcmp(&before, it, sizeof(before)) != 0;
+}
+
+#define LDIFF_SIMPLIFICATIONS 13
+
+static void ldiff_minimize(ldiff_engine *e, ldiff_tree *t, ldiff_mismatch *m)
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int32_t i = t->count - 1; i > 0; --i) {
+            if (i >= t->count)
+                continue;
+            ldiff_tree smaller = *t;
+            ldiff_remove_subtree(&smaller, i);
+            if (!ldiff_check(e, &smaller, m)) {
+                *t = smaller;
+                changed = true;
+            }
+        }
+        for (int32_t i = 0; i < t->count; ++i) {
+            for (int kind = 0; kind < LDIFF_SIMPLIFICATIONS; ++kind) {
+                ldiff_tree simpler = *t;
+                if (ldiff_simplify(&simpler.items[i], kind) && !ldiff_check(e, &simpler, m)) {
+                    *t = simpler;
+                    changed = true;
+                }
+            }
+        }
+    }
+    ldiff_check(e, t, m);
+}
+
+// Printing
+// --------
+
+static void ldiff_print_flags(uint32_t flags, const char *const *names, const uint32_t *values, int count)
+{
+    bool any = false;
+    for (int i = 0; i < count; ++i) {
+        if ((flags & values[i]) == values[i] && values[i] != 0) {
+            printf("%s%s", any ? " | " : "", names[i]);
+            flags &= ~values[i];
+            any = true;
+        }
+    }
+    if (!any)
+        printf("0");
+}
+
+static void ldiff_print_scalar(lay_scalar value)
+{
+    printf("%g", (double)value);
+}
+
+static void ldiff_print_call(const char *name, int32_t item, const lay_scalar *values, int count)
+{
+    printf("    %s(ctx, items[%d]", name, (int)item);
+    for (int i = 0; i < count; ++i) {
+        printf(", ");
+        ldiff_print_scalar(values[i]);
+    }
+    printf(");\n");
+}
+
+// Prints the tree as the lay_* calls that build it
+static void ldiff_print_tree(const ldiff_tree *t)
+{
+    static const char *const contain_names[] = {
+        "LAY_COLUMN", "LAY_ROW", "LAY_GRID", "LAY_WRAP", "LAY_JUSTIFY", "LAY_START", "LAY_END",
+    };
+    static const uint32_t contain_values[] = {
+        LAY_COLUMN, LAY_ROW, LAY_GRID, LAY_WRAP, LAY_JUSTIFY, LAY_START, LAY_END,
+    };
+    static const char *const behave_names[] = {
+        "LAY_FILL", "LAY_HFILL", "LAY_VFILL", "LAY_LEFT", "LAY_TOP", "LAY_RIGHT", "LAY_BOTTOM", "LAY_BREAK",
+    };
+    static const uint32_t behave_values[] = {
+        LAY_FILL, LAY_HFILL, LAY_VFILL, LAY_LEFT, LAY_TOP, LAY_RIGHT, LAY_BOTTOM, LAY_BREAK,
+    };
+    static const char *const track_names[] = { "LAY_TRACK_FIXED", "LAY_TRACK_AUTO", "LAY_TRACK_FILL" };
+
+    printf("    lay_id items[%d];\n", (int)t->count);
+    for (int32_t i = 0; i < t->count; ++i) {
+        const lay_ref_item *it = &t->items[i];
+        printf("    items[%d] = lay_item(ctx);\n", (int)i);
+        if (i > 0)
+            printf("    lay_insert(ctx, items[%d], items[%d]);\n", (int)it->parent, (int)i);
+        if (it->contain != 0) {
+            printf("    lay_set_contain(ctx, items[%d], ", (int)i);
+            ldiff_print_flags(it->contain, contain_names, contain_values, 7);
+            printf(");\n");
+        }
+        if (it->behave != 0) {
+            printf("    lay_set_behave(ctx, items[%d], ", (int)i);
+            ldiff_print_flags(it->behave, behave_names, behave_values, 8);
+            printf(");\n");
+        }
+        if (it->size[0] != 0 || it->size[1] != 0)
+            ldiff_print_call("lay_set_size_xy", i, it->size, 2);
+        if (it->margins[0] != 0 || it->margins[1] != 0 || it->margins[2] != 0 || it->margins[3] != 0)
+            ldiff_print_call("lay_set_margins_ltrb", i, it->margins, 4);
+        if (!it->ext)
+            continue;
+        ldiff_print_call("lay_set_min_size_xy", i, it->min_size, 2);
+        ldiff_print_call("lay_set_max_size_xy", i, it->max_size, 2);
+        ldiff_print_call("lay_set_gap", i, it->gap, 2);
+        printf("    lay_set_weights(ctx, items[%d], %u, %u);\n",
+            (int)i, (unsigned)it->grow_weight, (unsigned)it->shrink_weight);
+        if (it->num_columns > 0) {
+            printf("    {\n        const lay_track columns[] = {");
+            for (uint32_t c = 0; c < it->num_columns; ++c) {
+                printf("{%s, ", track_names[it->columns[c].kind]);
+                ldiff_print_scalar(it->columns[c].size);
+                printf("}%s", c + 1 < it->num_columns ? ", " : "");
+            }
+            printf("};\n        lay_set_grid_columns(ctx, items[%d], columns, %u);\n    }\n",
+                (int)i, (unsigned)it->num_columns);
+        }
+    }
+    printf("    lay_run_context(ctx);\n");
+}
+
+static void ldiff_print_rect(const char *name, lay_vec4 rect)
+{
+    printf("  %-10s %g %g %g %g\n", name,
+        (double)rect[0], (double)rect[1], (double)rect[2], (double)rect[3]);
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 20000;
+    const uint64_t seed = argc > 2 ? (uint64_t)strtoull(argv[2], NULL, 10) : 1;
+    ldiff_engine engine;
+    lay_init_context(&engine.ctx);
+    lay_init_context(&engine.replayed);
+
+#ifdef LAY_FLOAT
+    printf("Comparing layout.h (float) with the reference\n");
+#else
+    printf("Comparing layout.h (int16) with the reference\n");
+#endif
+    int result = 0;
+    uint64_t items = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        ldiff_tree tree;
+        ldiff_mismatch mismatch;
+        // Small trees are the most interesting, and the quickest to check
+        ldiff_rng = (seed + i) * 0x9e3779b97f4a7c15ull | 1;
+        ldiff_gen_tree(&tree, 1 + (int32_t)ldiff_rand(LDIFF_MAX_ITEMS));
+        items += (uint64_t)tree.count;
+        if (ldiff_check(&engine, &tree, &mismatch))
+            continue;
+
+        const int32_t count = tree.count;
+        ldiff_minimize(&engine, &tree, &mismatch);
+        printf("Mismatch with seed %llu (%d items, minimized to %d):\n",
+            (unsigned long long)(seed + i), (int)count, (int)tree.count);
+        ldiff_print_tree(&tree);
+        printf("Item %d, built with %s:\n", (int)mismatch.item, ldiff_variant_names[mismatch.variant]);
+        ldiff_print_rect("layout.h", mismatch.engine);
+        ldiff_print_rect("reference", mismatch.reference);
+        result = 1;
+        break;
+    }
+    if (result == 0)
+        printf("    %u trees and %llu items match in %d variants\n",
+            (unsigned)iterations, (unsigned long long)items, (int)LDIFF_VARIANTS);
+    printf(result ? "Failed\n" : "Finished\n");
+
+    lay_destroy_context(&engine.ctx);
+    lay_destroy_context(&engine.replayed);
+    return result;
+}
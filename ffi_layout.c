@@ -0,0 +1,133 @@
+// Shared library for the LuaJIT FFI binding in layout_ffi.lua.
+//
+// The FFI can call every exported function of layout.h directly, except the
+// ones that pass lay_vec2 or lay_vec4 by value (those are compiler vector
+// types, which the FFI can't express) and the static inline ones (which aren't
+// in the library). This file adds the few out-parameter and non-inline
+// versions the binding needs in their place.
+//
+//   ./tool.bash build release ffi
+
+#if defined(_WIN32)
+#define LAY_EXPORT extern __declspec(dllexport)
+#define LAY_FFI_EXPORT __declspec(dllexport)
+#else
+#define LAY_EXPORT extern __attribute__((visibility("default")))
+#define LAY_FFI_EXPORT __attribute__((visibility("default")))
+#endif
+
+// The FFI looks the functions up by their C names, and layout.h doesn't
+// declare them extern "C" itself.
+#ifdef __cplusplus
+extern "C" {
+#endif
+#define LAY_IMPLEMENTATION
+#include "layout.h"
+
+// The C types this library was built with, as an ffi.cdef string, so that the
+// binding doesn't have to be told about LAY_FLOAT or LAY_ID_BITS.
+LAY_FFI_EXPORT const char *lay_ffi_types(void)
+{
+    return
+#if LAY_FLOAT == 1
+        "typedef float lay_scalar;"
+#else
+        "typedef int16_t lay_scalar;"
+#endif
+#ifdef LAY_ID_BITS
+#if LAY_ID_BITS == 16
+        "typedef uint16_t lay_id;"
+#else
+        "typedef uint32_t lay_id;"
+#endif
+#else
+        "typedef uint32_t lay_id;"
+#endif
+        ;
+}
+
+// The context is opaque to the binding, since its size depends on the build
+// options, so the library allocates it.
+LAY_FFI_EXPORT lay_context *lay_ffi_new_context(void)
+{
+    lay_context *ctx = (lay_context*)LAY_REALLOC(NULL, sizeof(lay_context));
+    if (ctx)
+        lay_init_context(ctx);
+    return ctx;
+}
+
+LAY_FFI_EXPORT void lay_ffi_free_context(lay_context *ctx)
+{
+    if (!ctx)
+        return;
+    lay_destroy_context(ctx);
+    LAY_FREE(ctx);
+}
+
+LAY_FFI_EXPORT lay_id lay_ffi_first_child(const lay_context *ctx, lay_id id)
+{
+    return lay_first_child(ctx, id);
+}
+
+LAY_FFI_EXPORT lay_id lay_ffi_next_sibling(const lay_context *ctx, lay_id id)
+{
+    return lay_next_sibling(ctx, id);
+}
+
+LAY_FFI_EXPORT lay_id lay_ffi_next_line(const lay_context *ctx, lay_id line_start)
+{
+    return lay_next_line(ctx, line_start);
+}
+
+LAY_FFI_EXPORT void lay_ffi_get_rect_xywh(
+        const lay_context *ctx, lay_id id,
+        lay_scalar *x, lay_scalar *y, lay_scalar *width, lay_scalar *height)
+{
+    lay_get_rect_xywh(ctx, id, x, y, width, height);
+}
+
+// The rect of every item, indexed by id, without copying. The binding declares
+// lay_vec4 as a struct of four lay_scalar, which has the same layout in
+// memory. Only valid until the item storage is reallocated, like
+// lay_get_rect.
+LAY_FFI_EXPORT const lay_vec4 *lay_ffi_rects(const lay_context *ctx)
+{
+    return ctx->rects;
+}
+
+LAY_FFI_EXPORT void lay_ffi_get_min_size_xy(
+        lay_context *ctx, lay_id item, lay_scalar *width, lay_scalar *height)
+{
+    lay_vec2 size = lay_get_min_size(ctx, item);
+    *width = size[0];
+    *height = size[1];
+}
+
+LAY_FFI_EXPORT void lay_ffi_get_max_size_xy(
+        lay_context *ctx, lay_id item, lay_scalar *width, lay_scalar *height)
+{
+    lay_vec2 size = lay_get_max_size(ctx, item);
+    *width = size[0];
+    *height = size[1];
+}
+
+LAY_FFI_EXPORT void lay_ffi_get_gap(
+        lay_context *ctx, lay_id item, lay_scalar *main, lay_scalar *cross)
+{
+    lay_vec2 gap = lay_get_gap(ctx, item);
+    *main = gap[0];
+    *cross = gap[1];
+}
+
+LAY_FFI_EXPORT void lay_ffi_get_grid_column(
+        lay_context *ctx, lay_id item, uint32_t column,
+        lay_scalar *position, lay_scalar *width)
+{
+    lay_vec2 span = lay_get_grid_column(ctx, item, column);
+    *position = span[0];
+    *width = span[1];
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
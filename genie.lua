@@ -27,6 +27,16 @@ newoption {
     }
 }
 
+newoption {
+    trigger = "ids",
+    value = "idbits",
+    description = "Size of item ids, which limits the number of items in a context",
+    allowed = {
+        { "32", "32-bit unsigned integer" },
+        { "16", "16-bit unsigned integer, up to 65535 items" },
+    }
+}
+
 local targetDir = path.join("./build", _ACTION, "bin")
 
 function incl_luajit()
@@ -79,6 +89,15 @@ function lay_project(project_name, as_build_type, src_file)
         configuration { "float" }
             defines { "LAY_FLOAT=1" }
 
+        -- -std=c99 hides clock_gettime, which LAY_TRACE times with
+        configuration { "linux or bsd" }
+            defines { "_POSIX_C_SOURCE=200809L" }
+
+        if _OPTIONS["ids"] == "16" then
+            configuration {}
+                defines { "LAY_ID_BITS=16" }
+        end
+
         configuration { "vs*", "windows" }
             defines { "_CRT_SECURE_NO_WARNINGS" }
             buildoptions {
@@ -165,7 +184,16 @@ solution "layout"
     configurations { "Debug", "Develop", "Release" }
     lay_project("tests", as_console_app, "test_layout.c")
     lay_project("benchmark", as_console_app, "benchmark_layout.c")
+        configuration { "linux or macosx or bsd" }
+            links { "m", "pthread" }
+    lay_project("differential", as_console_app, "differential_layout.c")
+    lay_project("async", as_console_app, "async_layout.c")
+        configuration { "linux or macosx or bsd" }
+            links { "pthread" }
     lay_project("luamodule", as_shared_lib, "luamodule_layout.c")
         incl_luajit()
         configuration {}
             targetname("layout")
+    lay_project("ffi", as_shared_lib, "ffi_layout.c")
+        configuration {}
+            targetname("layout_ffi")
@@ -12,6 +12,7 @@
 // 项目中的其他文件不应该定义 LAY_IMPLEMENTATION。
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef LAY_EXPORT
 #define LAY_EXPORT extern
@@ -33,14 +34,32 @@
 #define LAY_STATIC_INLINE inline static
 #endif
 
+// 如果用户定义 LAY_ID_BITS 为 16，lay_id 将使用 uint16_t 而不是 uint32_t。
+// 每个项的两个链接各节省 2 字节，但一个上下文最多只能容纳 65535 个项。
+#ifndef LAY_ID_BITS
+#define LAY_ID_BITS 32
+#endif
+
+#if LAY_ID_BITS == 16
+typedef uint16_t lay_id;
+#elif LAY_ID_BITS == 32
 typedef uint32_t lay_id;
+#else
+#error "LAY_ID_BITS must be 16 or 32"
+#endif
+
 #if LAY_FLOAT == 1
 typedef float lay_scalar;
 #else
 typedef int16_t lay_scalar;
 #endif
 
+// LAY_INVALID_ID 不是有效的项 id，因此上下文中的项数最多为 LAY_INVALID_ID。
+#if LAY_ID_BITS == 16
+#define LAY_INVALID_ID UINT16_MAX
+#else
 #define LAY_INVALID_ID UINT32_MAX
+#endif
 
 // GCC 和 Clang 允许我们使用 vector_size 扩展创建基于某个类型的向量。
 // 这使我们可以通过索引操作访问向量的各个组件。
@@ -86,11 +105,169 @@ typedef struct lay_item_t {
     lay_vec2 size;
 } lay_item_t;
 
+// Per-item properties that most items don't use, kept out of lay_item_t so
+// that it stays small. Only valid for items with LAY_ITEM_EXT set.
+typedef struct lay_item_ext {
+    // 0 in max_size means no maximum
+    lay_vec2 min_size;
+    lay_vec2 max_size;
+    // LAY_GRID columns, in ctx->tracks
+    uint32_t first_track;
+    uint32_t num_tracks;
+    // 0: main axis, 1: cross axis
+    lay_vec2 gap;
+    // share of a LAY_ROW/LAY_COLUMN line's extra (or missing) space
+    uint16_t grow_weight;
+    uint16_t shrink_weight;
+} lay_item_ext;
+
+#ifdef LAY_STATS
+// 如果用户定义了 LAY_STATS，上下文会统计布局所做的工作，用于解释为什么项数相近的两个界面耗时相差很多。
+// 计数一直累加，直到调用 lay_reset_stats()。未定义 LAY_STATS 时，统计代码会被完全去掉。
+typedef struct lay_stats {
+    // lay_calc_size 和 lay_arrange 访问的项数，按布局的四个阶段：
+    // [0] 计算宽度，[1] 排列水平方向，[2] 计算高度，[3] 排列垂直方向
+    uint64_t items_visited[4];
+    // lay_insert 为找到最后一个子项而遍历的兄弟项数
+    uint64_t insert_steps;
+    // 换行容器创建的行数
+    uint64_t wrap_lines;
+    // 额外空间分给填充子项（LAY_HFILL/LAY_VFILL）的行数
+    uint64_t fill_lines;
+    // 其中需要求解最小/最大尺寸或权重的行数，这种行的开销要大得多
+    uint64_t solved_fill_lines;
+    // 空间不足而压缩子项的行数
+    uint64_t squeeze_lines;
+    // 上下文调用 LAY_REALLOC 的次数，以及请求的字节数（包括 lay_item() 增长项缓冲区）
+    uint64_t reallocs;
+    uint64_t bytes_allocated;
+} lay_stats;
+#endif
+
+#ifdef LAY_TRACE
+// 如果用户定义了 LAY_TRACE，上下文可以把较大子树的 lay_calc_size 和 lay_arrange 的开始和结束时间
+// 记录到一个环形缓冲区中（参见 lay_trace_start()），并导出为 Chrome 的 trace JSON 格式，
+// 用 chrome://tracing 或 Perfetto 查看。不在记录时，每个项只多一次分支判断，因此可以在测试版本中一直开启。
+typedef struct lay_trace_event {
+    // 纳秒，来自 LAY_TRACE_NOW()
+    uint64_t start;
+    uint64_t duration;
+    lay_id item;
+    // 0: 计算宽度，1: 排列水平方向，2: 计算高度，3: 排列垂直方向
+    uint32_t phase;
+    // lay_set_trace_tag() 设置的标签，或 NULL
+    const char *tag;
+} lay_trace_event;
+
+// lay_trace_write_json() 用来输出 JSON 的回调
+typedef void (*lay_trace_write_fn)(void *user, const char *data, size_t size);
+#endif
+
+#ifdef LAY_PUBLISH
+// 如果用户定义了 LAY_PUBLISH，上下文可以把计算出的矩形发布给其他线程（例如渲染线程）读取，参见 lay_publish_rects()。
+// 读者拿到的是一个不会改变的快照，既不需要加锁，也不需要复制。
+// 快照保存在 LAY_PUBLISH_BUFFERS 个缓冲区中，默认为 3（三缓冲），可以定义为 2 到 4。
+#ifndef LAY_PUBLISH_BUFFERS
+#define LAY_PUBLISH_BUFFERS 3
+#endif
+#if LAY_PUBLISH_BUFFERS < 2 || LAY_PUBLISH_BUFFERS > 4
+#error LAY_PUBLISH_BUFFERS must be between 2 and 4
+#endif
+typedef struct lay_snapshot {
+    // 按项的 id 索引的矩形，与 lay_get_rect() 的结果相同
+    lay_vec4 *rects;
+    lay_id count;
+    // 这是第几次成功的 lay_publish_rects()，从 1 开始
+    uint64_t epoch;
+    // 以下字段仅供内部使用
+    lay_id capacity;
+    uint32_t readers;
+} lay_snapshot;
+#endif
+
+// 网格列的类型，用于 lay_track 的 kind 字段。
+typedef enum lay_track_kind {
+    // 固定宽度，由 lay_track 的 size 字段给出
+    LAY_TRACK_FIXED = 0,
+    // 与该列中最宽的单元格（包括边距）一样宽
+    LAY_TRACK_AUTO = 1,
+    // 平分网格中固定列和自动列之外的剩余空间
+    LAY_TRACK_FILL = 2
+} lay_track_kind;
+
+// 网格列的定义，传递给 lay_set_grid_columns()。
+typedef struct lay_track {
+    uint32_t kind;
+    lay_scalar size;
+} lay_track;
+
+// lay_memory_usage() 报告的上下文堆内存，以字节为单位
+typedef struct lay_memory {
+    // 项、计算出的矩形和行表，它们共用一个缓冲区
+    size_t items;
+    // 最小/最大尺寸、网格列、间距和权重等不常用的属性
+    size_t ext;
+    // 网格列的定义和计算出的位置
+    size_t tracks;
+    // LAY_RECORD 的轨迹和 LAY_TRACE 的事件等诊断用的缓冲区
+    size_t diagnostics;
+    // LAY_PUBLISH 发布的矩形快照
+    size_t snapshots;
+} lay_memory;
+
 typedef struct lay_context {
     lay_item_t *items;
     lay_vec4 *rects;
+    // Line table written by wrapping (and non-wrapping) row and column
+    // containers during layout. See lay_next_line().
+    lay_id *lines;
+    // Parallel to items, allocated the first time an item needs it
+    lay_item_ext *ext;
+    // Grid column definitions, and the position and width of each column
+    // computed during layout. Shared by all of the grids in the context.
+    lay_track *tracks;
+    lay_vec2 *track_spans;
+    uint32_t tracks_count;
+    uint32_t tracks_capacity;
     lay_id capacity;
     lay_id count;
+#ifdef LAY_RECORD
+    // Trace of the API calls made while recording, see lay_record_start()
+    uint8_t *record;
+    size_t record_size;
+    size_t record_capacity;
+    uint32_t recording;
+#endif
+#ifdef LAY_STATS
+    lay_stats stats;
+#endif
+    // Trimming after a spike, see lay_set_trim_policy(). 0 in trim_after
+    // means never.
+    uint32_t trim_after;
+    uint32_t quiet_resets;
+    lay_id trim_peak_items;
+    uint32_t trim_peak_tracks;
+#ifdef LAY_TRACE
+    // Ring buffer of the last trace_capacity events, see lay_trace_start()
+    lay_trace_event *trace_events;
+    uint32_t trace_capacity;
+    uint32_t tracing;
+    // Events written since the trace started, including overwritten ones
+    uint64_t trace_written;
+    lay_id trace_min_items;
+    // Per item, allocated while tracing: the number of items in its subtree
+    // as of the last width sizing pass, and the tags set by lay_set_trace_tag
+    lay_id *trace_sizes;
+    const char **trace_tags;
+#endif
+#ifdef LAY_PUBLISH
+    // Snapshots of the rects for other threads, see lay_publish_rects().
+    // published is the index + 1 of the newest snapshot, or 0 if there is
+    // none yet. It and each snapshot's readers are only accessed atomically.
+    lay_snapshot snapshots[LAY_PUBLISH_BUFFERS];
+    uint32_t published;
+    uint64_t publish_epoch;
+#endif
 } lay_context;
 
 // 传递给 lay_set_container() 的容器标志
@@ -108,6 +285,8 @@ typedef enum lay_box_flags {
     LAY_LAYOUT = 0x000,
     // flex model
     LAY_FLEX = 0x002,
+    // grid model, see lay_set_grid_columns()
+    LAY_GRID = 0x001,
 
     // flex-wrap (bit 2)
 
@@ -164,12 +343,12 @@ typedef enum lay_layout_flags {
     LAY_CENTER = 0x000,
     // anchor to all four directions
     LAY_FILL = 0x1e0,
-    // When in a wrapping container, put this element on a new line. Wrapping
-    // layout code auto-inserts LAY_BREAK flags as needed. See GitHub issues for
-    // TODO related to this.
+    // When in a wrapping container, put this element on a new line. This is
+    // only ever set by the user -- the line breaks computed by the wrapping
+    // layout code are stored separately, in the context's line table.
     //
-    // Drawing routines can read this via item pointers as needed after
-    // performing layout calculations.
+    // Drawing routines can find where each line starts with lay_first_line()
+    // and lay_next_line() after performing layout calculations.
     LAY_BREAK = 0x200
 } lay_layout_flags;
 
@@ -207,6 +386,8 @@ enum {
     LAY_ITEM_VFIXED      = 0x1000,
     // bit 11-12
     LAY_ITEM_FIXED_MASK  = LAY_ITEM_HFIXED | LAY_ITEM_VFIXED,
+    // item has a record in ctx->ext (bit 13)
+    LAY_ITEM_EXT         = 0x2000,
 
     // which flag bits will be compared
     LAY_ITEM_COMPARE_MASK = LAY_ITEM_BOX_MODEL_MASK
@@ -243,11 +424,30 @@ LAY_EXPORT void lay_reserve_items_capacity(lay_context *ctx, lay_id count);
 LAY_EXPORT void lay_destroy_context(lay_context *ctx);
 
 // 清除上下文中的所有项，将其计数设置为 0。
-// 当您想要从根项重新声明布局时使用此函数。此操作不会释放任何内存或执行分配。
+// 当您想要从根项重新声明布局时使用此函数。此操作不会释放任何内存或执行分配，
+// 除非用 lay_set_trim_policy() 开启了收缩。
 // 调用此函数后可以安全地再次使用上下文。
 // 如果您在循环中重新计算布局，可能应该使用此函数，而不是调用 init/destroy。
 LAY_EXPORT void lay_reset_context(lay_context *ctx);
 
+// 将 `src` 的项、计算出的矩形和网格列复制到 `dst`，替换 `dst` 中原有的项。
+// 之后两个上下文互不影响，例如可以在另一个线程中计算 `dst`，同时继续修改 `src`（参见 layout_async.h）。
+// `dst` 必须已经初始化。LAY_RECORD 的记录、LAY_TRACE 的标签和 LAY_STATS 的计数不会被复制，这次复制也不会被记录。
+LAY_EXPORT void lay_copy_context(lay_context *dst, const lay_context *src);
+
+// 返回上下文占用的堆内存字节数。如果 `detail` 不为 NULL，还会写入每种缓冲区的字节数。
+LAY_EXPORT size_t lay_memory_usage(lay_context *ctx, lay_memory *detail);
+
+// 将上下文的缓冲区缩小到刚好容纳现有的项和网格列。没有项时会释放所有缓冲区，之后仍然可以继续使用上下文。
+// 与其他重新分配一样，计算出的矩形会失效。正在进行的 LAY_RECORD 记录的缓冲区和 LAY_TRACE 的事件不会被缩小。
+// LAY_PUBLISH 的快照中，最新的和正被读者持有的会保留，其余的缓冲区会被释放。
+LAY_EXPORT void lay_shrink_to_fit(lay_context *ctx);
+
+// 让 lay_reset_context() 在短时间的峰值之后归还内存。如果连续 `quiet_resets` 次重置时，
+// 自上次重置以来使用的项都不超过容量的四分之一，容量会缩小为这期间最多项数的两倍。
+// 网格列的缓冲区也按同样的方式处理。`quiet_resets` 为 0（默认值）时从不收缩。
+LAY_EXPORT void lay_set_trim_policy(lay_context *ctx, uint32_t quiet_resets);
+
 // 执行布局计算，从根项（id 为 0）开始。
 // 在调用此函数后，您可以使用 lay_get_rect() 查询项的计算矩形。
 // 如果在调用此函数后使用 lay_append() 或 lay_insert() 等过程，若发生重新分配，您的计算数据可能会变得无效。
@@ -264,17 +464,11 @@ LAY_EXPORT void lay_run_context(lay_context *ctx);
 // 使用时要小心——如果父项尚未计算其输出矩形，或者它们已经失效（例如由于重新分配），很容易生成错误的输出。
 LAY_EXPORT void lay_run_item(lay_context *ctx, lay_id item);
 
-// 在启用换行的父容器中进行布局时，可能会在计算过程中修改标志。
-// 如果您计划多次调用 lay_run_context 或 lay_run_item，而不调用 lay_reset，
-// 并且如果容器使用了换行，且容器的宽度或高度可能已更改，您应在再次调用 lay_run_context 
-// 或 lay_run_item 之前调用 lay_clear_item_break 来清除所有子项的换行标志。
-// 如果不清除，布局计算可能会进行不必要的换行。
+// 清除项上手动指定的换行标志（LAY_BREAK）。
 //
-// 此要求未来可能会更改。
-//
-// 调用此函数还会重置所有手动指定的换行。您需要再次设置手动换行，或者干脆不在任何希望手动换行的项上调用此函数。
-//
-// 如果您每次计算布局时都清除上下文，或者如果不使用换行，则不需要调用此函数。
+// 布局计算不会修改项的标志：换行容器计算出的换行位置存储在上下文的行表中（参见 lay_next_line()），
+// 而不是写入子项的 LAY_BREAK 标志。因此，在容器尺寸改变后重新调用 lay_run_context 或 lay_run_item 之前，
+// 不再需要调用此函数。只有当您想取消之前手动设置的换行时才需要它。
 LAY_EXPORT void lay_clear_item_break(lay_context *ctx, lay_id item);
 
 // 返回在上下文中已创建项的数量。
@@ -284,6 +478,8 @@ LAY_EXPORT lay_id lay_items_count(lay_context *ctx);
 LAY_EXPORT lay_id lay_items_capacity(lay_context *ctx);
 
 // 创建一个新项，可以简单地认为它是一个矩形。返回用于标识该项的 id（句柄）。
+// 如果上下文中的项数已经达到 LAY_INVALID_ID（主要在 LAY_ID_BITS 为 16 时），
+// 不会创建新项，而是返回 LAY_INVALID_ID（调试版本中会触发断言）。
 LAY_EXPORT lay_id lay_item(lay_context *ctx);
 
 // 将项插入到另一个项中，形成父子关系。
@@ -325,6 +521,155 @@ LAY_EXPORT void lay_set_margins(lay_context *ctx, lay_id item, lay_vec4 ltrb);
 // (left, top, right, bottom).
 LAY_EXPORT void lay_set_margins_ltrb(lay_context *ctx, lay_id item, lay_scalar l, lay_scalar t, lay_scalar r, lay_scalar b);
 
+// 设置项的最小尺寸和最大尺寸。项的计算尺寸，无论来自 lay_set_size、子项，
+// 还是父项中的 LAY_HFILL/LAY_VFILL 填充或挤压，都会被限制在这个范围内。
+// 最大尺寸为 0 表示没有最大值。如果最小尺寸大于最大尺寸，则以最小尺寸为准。
+//
+// 在 LAY_ROW 或 LAY_COLUMN 中，受限制的填充项无法使用的空间会分配给同一行中其他的填充项。
+LAY_EXPORT void lay_set_min_size(lay_context *ctx, lay_id item, lay_vec2 size);
+LAY_EXPORT void lay_set_min_size_xy(lay_context *ctx, lay_id item, lay_scalar width, lay_scalar height);
+LAY_EXPORT void lay_set_max_size(lay_context *ctx, lay_id item, lay_vec2 size);
+LAY_EXPORT void lay_set_max_size_xy(lay_context *ctx, lay_id item, lay_scalar width, lay_scalar height);
+
+// 设置 LAY_GRID 容器的列。子项按顺序逐行填入单元格：第 i 个子项位于第 i / count 行、第 i % count 列。
+// 列宽在所有行之间共享；行高与该行中最高的单元格（包括边距）一样高，各行从容器顶部开始依次排列。
+// 在单元格内，子项的行为与在 LAY_LAYOUT 容器中相同（例如 LAY_HFILL 会填满整个单元格的宽度）。
+//
+// 列的定义会被复制到上下文中，直到 lay_reset_context() 为止。没有设置列的网格只有一列，宽度为整个容器。
+// 再次为同一个项设置列时（例如每次窗口大小改变时），如果列数没有增加，会覆盖原来的列；
+// 否则原来的列占用的空间要到 lay_reset_context() 时才会释放。
+// 计算之后，可以用 lay_first_line() 和 lay_next_line() 遍历网格的各行。
+LAY_EXPORT void lay_set_grid_columns(lay_context *ctx, lay_id item, const lay_track *columns, uint32_t count);
+
+// 返回网格在计算之后第 `column` 列的 x 起始位置和宽度。
+// 与 lay_get_rect 一样，只有在调用 lay_run_context 后才有效。
+LAY_EXPORT lay_vec2 lay_get_grid_column(lay_context *ctx, lay_id item, uint32_t column);
+
+// 设置容器中子项之间的间距。`main` 是沿容器方向（LAY_ROW 为水平，LAY_COLUMN 为垂直）相邻子项之间的间距，
+// `cross` 是换行容器中相邻行之间的间距。对于 LAY_GRID，`main` 是列之间的间距，`cross` 是行之间的间距。
+// 间距只加在子项之间，不加在第一个子项之前或最后一个子项之后。LAY_LAYOUT 容器会忽略间距。
+LAY_EXPORT void lay_set_gap(lay_context *ctx, lay_id item, lay_scalar main, lay_scalar cross);
+
+// 获取通过 lay_set_gap 设置的间距。向量的组件是：
+// 0: main, 1: cross
+LAY_EXPORT lay_vec2 lay_get_gap(lay_context *ctx, lay_id item);
+
+// 设置项在 LAY_ROW 或 LAY_COLUMN 中的伸缩权重，默认都为 1。
+// 同一行中的填充项（LAY_HFILL/LAY_VFILL）按 `grow` 的比例分配剩余空间，例如权重为 2 和 1 的两个填充项按 2:1 分配。
+// 空间不足时，可挤压的项按 `shrink` 的比例缩小。权重为 0 的项不会伸长或缩小。
+LAY_EXPORT void lay_set_weights(lay_context *ctx, lay_id item, uint16_t grow, uint16_t shrink);
+
+// 获取通过 lay_set_weights 设置的权重。未设置时都为 1。
+LAY_EXPORT void lay_get_weights(lay_context *ctx, lay_id item, uint16_t *grow, uint16_t *shrink);
+
+// 获取通过 lay_set_min_size 或 lay_set_max_size 设置的尺寸。未设置时返回 0。
+LAY_EXPORT lay_vec2 lay_get_min_size(lay_context *ctx, lay_id item);
+LAY_EXPORT lay_vec2 lay_get_max_size(lay_context *ctx, lay_id item);
+
+#if defined(LAY_RECORD) || defined(LAY_REPLAY)
+// 如果用户定义了 LAY_RECORD，上下文可以把对它的 API 调用记录为紧凑的二进制轨迹（参见 lay_record_start()），
+// 之后用 lay_replay_next() 在另一个上下文中重新执行，例如用于基准测试。
+// 只需要重放轨迹时，可以只定义 LAY_REPLAY。两者都没有定义时，记录的代码会被完全去掉。
+//
+// 轨迹以 6 字节的头开始："LAYT"、格式版本和坐标类型（0 为 int16，1 为 float）。
+// 之后每个调用以一个字节的类型开始，后面是它的参数：id、标志、计数和权重为 LEB128 变长整数，
+// 整数坐标为 zigzag 编码的变长整数，浮点坐标为 4 字节小端 IEEE 浮点数。
+#define LAY_RECORD_HEADER_SIZE 6
+#define LAY_RECORD_VERSION 1
+
+// 轨迹中的调用类型。lay_set_size 和 lay_set_size_xy 等成对的函数记录为同一种调用。
+typedef enum lay_record_op {
+    // 轨迹结束，只由 lay_replay_next 返回
+    LAY_RECORD_END = 0,
+    LAY_RECORD_RESERVE_ITEMS_CAPACITY, // count
+    LAY_RECORD_RESET_CONTEXT,
+    LAY_RECORD_RUN_CONTEXT,
+    LAY_RECORD_RUN_ITEM, // item
+    LAY_RECORD_CLEAR_ITEM_BREAK, // item
+    LAY_RECORD_ITEM,
+    LAY_RECORD_INSERT, // parent, child
+    LAY_RECORD_APPEND, // earlier, later
+    LAY_RECORD_PUSH, // parent, child
+    LAY_RECORD_SET_SIZE, // item, width, height
+    LAY_RECORD_SET_CONTAIN, // item, flags
+    LAY_RECORD_SET_BEHAVE, // item, flags
+    LAY_RECORD_SET_MARGINS, // item, left, top, right, bottom
+    LAY_RECORD_SET_MIN_SIZE, // item, width, height
+    LAY_RECORD_SET_MAX_SIZE, // item, width, height
+    LAY_RECORD_SET_GRID_COLUMNS, // item, count, count * (kind, size)
+    LAY_RECORD_SET_GAP, // item, main, cross
+    LAY_RECORD_SET_WEIGHTS // item, grow, shrink
+} lay_record_op;
+#endif
+
+#ifdef LAY_RECORD
+// 开始记录对上下文的 API 调用。之前记录的轨迹会被清除。
+// 轨迹只包含开始记录之后的调用，因此应该在上下文为空时（lay_init_context() 或 lay_reset_context() 之后）开始记录，
+// 这样轨迹才能在一个空的上下文中重放。轨迹存放在上下文的堆内存中，直到 lay_destroy_context() 为止。
+LAY_EXPORT void lay_record_start(lay_context *ctx);
+
+// 停止记录。轨迹保持不变，直到下一次 lay_record_start()。
+LAY_EXPORT void lay_record_stop(lay_context *ctx);
+
+// 返回记录的轨迹，并将其字节数写入 `size`。不要保留此指针——继续记录时它可能会失效。
+LAY_EXPORT const uint8_t *lay_record_data(lay_context *ctx, size_t *size);
+#endif
+
+#if defined(LAY_RECORD) || defined(LAY_REPLAY)
+// 检查轨迹 `data` 的头。成功时返回 0，并将 `offset` 设为第一个调用的位置；否则返回 -1。
+LAY_EXPORT int lay_replay_begin(const uint8_t *data, size_t size, size_t *offset);
+
+// 在 `ctx` 中执行轨迹中位于 `offset` 的调用，并将 `offset` 移到下一个调用。
+// 返回执行的调用类型（lay_record_op），到达轨迹末尾时返回 LAY_RECORD_END，
+// 遇到无效的调用时返回 -1 并且不执行它。轨迹中的 id 必须是 `ctx` 中已存在的项，
+// 因此通常应该在空的上下文中重放整个轨迹。
+LAY_EXPORT int lay_replay_next(lay_context *ctx, const uint8_t *data, size_t size, size_t *offset);
+#endif
+
+#ifdef LAY_TRACE
+// 开始记录布局的时间线。之前记录的事件会被清除。
+// 只记录包含至少 `min_items` 个项（包括自身）的子树，最多保留最近的 `capacity` 个事件。
+// 子树的大小在计算宽度的阶段中更新，因此该阶段使用的是上一次计算时的大小：开始记录后的第一次计算不会记录这一阶段。
+// 默认在 Windows 上使用 QueryPerformanceCounter()，在其他系统上使用 clock_gettime(CLOCK_MONOTONIC) 获取时间。
+// 如果 <time.h> 没有声明 CLOCK_MONOTONIC（例如 glibc 在 -std=c99 下需要定义 _POSIX_C_SOURCE=199309L 或更高），
+// 会退回到 C11 的 timespec_get()，或者只是进程 CPU 时间的 clock()。也可以将 LAY_TRACE_NOW() 定义为返回纳秒的单调时钟。
+LAY_EXPORT void lay_trace_start(lay_context *ctx, uint32_t capacity, lay_id min_items);
+
+// 停止记录。事件保持不变，直到下一次 lay_trace_start() 或 lay_destroy_context()。
+LAY_EXPORT void lay_trace_stop(lay_context *ctx);
+
+// 为项设置一个出现在其事件中的标签，例如界面中的名称。字符串不会被复制，必须在导出之后仍然有效。
+// lay_item() 创建的新项没有标签。
+LAY_EXPORT void lay_set_trace_tag(lay_context *ctx, lay_id item, const char *tag);
+
+// 将记录的事件以 Chrome trace JSON 格式分段传给 `write`。返回导出的事件数。
+LAY_EXPORT uint32_t lay_trace_write_json(lay_context *ctx, lay_trace_write_fn write, void *user);
+#endif
+
+#ifdef LAY_PUBLISH
+// 将最近一次计算出的矩形复制到一个没有读者的缓冲区中，并以一次原子操作使其成为最新的快照。
+// 返回快照的 epoch。如果其他缓冲区都还被读者持有，则不发布并返回 0，读者继续看到之前的快照。
+// 只能在修改和计算上下文的线程中调用。lay_reset_context() 不会影响已经发布的快照。
+LAY_EXPORT uint64_t lay_publish_rects(lay_context *ctx);
+
+// 获取最新发布的快照。可以在任何线程中调用，不加锁也不复制，在 lay_release_rects() 之前快照的内容不会改变。
+// 如果还没有发布过，返回 NULL。
+// 三缓冲时，一个读者线程总是可以拿到最新的快照；读者多于一个，或者一个线程同时持有多个快照时，lay_publish_rects() 可能会失败。
+// 调用 lay_destroy_context() 之前必须归还所有快照。
+LAY_EXPORT const lay_snapshot *lay_acquire_rects(lay_context *ctx);
+
+// 归还 lay_acquire_rects() 获取的快照，之后它的缓冲区可以被重新使用。
+LAY_EXPORT void lay_release_rects(lay_context *ctx, const lay_snapshot *snapshot);
+#endif
+
+#ifdef LAY_STATS
+// 将上下文的工作计数复制到 `stats`。
+LAY_EXPORT void lay_get_stats(lay_context *ctx, lay_stats *stats);
+
+// 将上下文的工作计数清零。lay_init_context() 也会清零它们，但 lay_reset_context() 不会。
+LAY_EXPORT void lay_reset_stats(lay_context *ctx);
+#endif
+
 // 通过项的 id 获取缓冲区中的项指针。
 // 不要保留此指针——一旦发生任何重新分配，它将变得无效。只需存储 id（它更小，而且查找成本为零）。
 LAY_STATIC_INLINE lay_item_t *lay_get_item(const lay_context *ctx, lay_id id)
@@ -371,6 +716,23 @@ LAY_STATIC_INLINE void lay_get_rect_xywh(
     *height = rect[3];
 }
 
+// 获取 LAY_ROW、LAY_COLUMN 或 LAY_GRID 容器中第一行的第一个项，即容器的第一个子项。
+// 如果容器没有子项，则返回 LAY_INVALID_ID。
+LAY_STATIC_INLINE lay_id lay_first_line(const lay_context *ctx, lay_id container)
+{ return lay_first_child(ctx, container); }
+
+// 给定一行的第一个项，返回下一行的第一个项。如果这是最后一行，则返回 LAY_INVALID_ID。
+// 一行由从其第一个项开始、到下一行的第一个项（不包含）为止的兄弟项组成。
+//
+// 行表在 lay_run_context 期间由 LAY_ROW、LAY_COLUMN（不换行的容器只有一行）和 LAY_GRID 容器写入，
+// 与 lay_get_rect 一样，只有在计算之后且在发生任何重新分配之前有效。
+// 例如，渲染器可以用它为每一行绘制背景。
+LAY_STATIC_INLINE lay_id lay_next_line(const lay_context *ctx, lay_id line_start)
+{
+    LAY_ASSERT(line_start != LAY_INVALID_ID && line_start < ctx->count);
+    return ctx->lines[line_start];
+}
+
 #undef LAY_EXPORT
 #undef LAY_STATIC_INLINE
 
@@ -441,66 +803,565 @@ static LAY_FORCE_INLINE float lay_float_max(float a, float b)
 static LAY_FORCE_INLINE float lay_float_min(float a, float b)
 { return a < b ? a : b; }
 
+#ifndef LAY_FLOAT
+// Fixed-denominator fractions for the integer version of lay_arrange_stacked.
+// A value is whole + rem / denom, with 0 <= rem < denom. The numerator can be
+// a weighted share of the extra space, which doesn't always fit in 32 bits.
+static LAY_FORCE_INLINE void lay_split_fraction(
+        int64_t num, int32_t denom, int32_t *whole, int32_t *rem)
+{
+    int64_t q = num / denom;
+    int64_t r = num % denom;
+    if (r < 0) {
+        r += denom;
+        --q;
+    }
+    *whole = (int32_t)q;
+    *rem = (int32_t)r;
+}
+static LAY_FORCE_INLINE void lay_add_fraction_rem(
+        int32_t *whole, int32_t *rem, int32_t add_rem, int32_t denom)
+{
+    *rem += add_rem;
+    if (*rem >= denom) {
+        *rem -= denom;
+        ++*whole;
+    }
+}
+// Rounds towards zero, like a float to int conversion.
+static LAY_FORCE_INLINE lay_scalar lay_trunc_fraction(int32_t whole, int32_t rem)
+{ return (lay_scalar)(whole + (whole < 0 && rem != 0)); }
+#endif
+
+// Work counters, see lay_stats. Without LAY_STATS, the arguments aren't even
+// evaluated.
+#ifdef LAY_STATS
+#define LAY_STATS_ADD(ctx, counter, n) ((ctx)->stats.counter += (uint64_t)(n))
+#else
+#define LAY_STATS_ADD(ctx, counter, n) ((void)0)
+#endif
+
+#ifdef LAY_TRACE
+#ifndef LAY_TRACE_NOW
+// A monotonic wall clock, so that the durations aren't affected by other
+// threads or by changes to the system time.
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+static uint64_t lay_trace_now(void)
+{
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    // Split, since count * 10^9 would overflow after a while
+    const uint64_t f = (uint64_t)freq.QuadPart, c = (uint64_t)count.QuadPart;
+    return c / f * 1000000000u + c % f * 1000000000u / f;
+}
+#else
+#include <time.h>
+static uint64_t lay_trace_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    // Not monotonic, but still wall time
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    // Processor time of the whole process, which is only a rough stand-in
+    return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+#endif
+#define LAY_TRACE_NOW() lay_trace_now()
+#endif
+
+// Whether lay_calc_size and lay_arrange should time this item's subtree.
+// Checked on every item, so it's kept to a branch when not tracing.
+static LAY_FORCE_INLINE bool lay_traced(const lay_context *ctx, lay_id item)
+{
+    return ctx->tracing && ctx->trace_sizes[item] >= ctx->trace_min_items;
+}
+
+static void lay_trace_event_end(lay_context *ctx, lay_id item, uint32_t phase, uint64_t start)
+{
+    lay_trace_event *event = &ctx->trace_events[ctx->trace_written % ctx->trace_capacity];
+    event->start = start;
+    event->duration = LAY_TRACE_NOW() - start;
+    event->item = item;
+    event->phase = phase;
+    event->tag = ctx->trace_tags != NULL ? ctx->trace_tags[item] : NULL;
+    ++ctx->trace_written;
+}
+
+// Resizes the per item trace buffers along with the items. New sizes are 0,
+// so that new items aren't traced until their size is known.
+static void lay_trace_resize(lay_context *ctx, lay_id old_capacity, lay_id capacity)
+{
+    if (ctx->trace_sizes != NULL) {
+        ctx->trace_sizes = (lay_id*)LAY_REALLOC(ctx->trace_sizes, capacity * sizeof(lay_id));
+        if (capacity > old_capacity)
+            LAY_MEMSET(ctx->trace_sizes + old_capacity, 0, (capacity - old_capacity) * sizeof(lay_id));
+    }
+    if (ctx->trace_tags != NULL) {
+        ctx->trace_tags = (const char**)LAY_REALLOC((void*)ctx->trace_tags, capacity * sizeof(const char*));
+        if (capacity > old_capacity)
+            LAY_MEMSET((void*)(ctx->trace_tags + old_capacity), 0, (capacity - old_capacity) * sizeof(const char*));
+    }
+}
+#endif // LAY_TRACE
+
+#ifdef LAY_PUBLISH
+// Atomics for handing snapshots to other threads. A reader announces itself on
+// a snapshot and then checks that it is still the newest one, while the writer
+// publishes a snapshot and later checks a buffer for readers before reusing it,
+// so both need sequentially consistent ordering.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LAY_ATOMIC_LOAD(p) ((uint32_t)_InterlockedOr((volatile long*)(p), 0))
+#define LAY_ATOMIC_STORE(p, v) ((void)_InterlockedExchange((volatile long*)(p), (long)(v)))
+#define LAY_ATOMIC_INCREMENT(p) ((void)_InterlockedIncrement((volatile long*)(p)))
+#define LAY_ATOMIC_DECREMENT(p) ((void)_InterlockedDecrement((volatile long*)(p)))
+#else
+#define LAY_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define LAY_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define LAY_ATOMIC_INCREMENT(p) ((void)__atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST))
+#define LAY_ATOMIC_DECREMENT(p) ((void)__atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST))
+#endif
+#endif // LAY_PUBLISH
+
+#ifdef LAY_RECORD
+// Call recording
+//
+// Each recorded call is its op byte followed by its integer arguments and then
+// its scalar arguments, all of them variable length. A call takes at most
+// 1 + 3 * 5 + 4 * 5 bytes, which is reserved up front.
+#define LAY_RECORD_MAX_CALL 36
+
+static uint8_t *lay_record_reserve(lay_context *ctx, size_t size)
+{
+    if (ctx->record_size + size > ctx->record_capacity) {
+        size_t capacity = ctx->record_capacity < 256 ? 256 : ctx->record_capacity * 2;
+        while (capacity < ctx->record_size + size)
+            capacity *= 2;
+        LAY_STATS_ADD(ctx, reallocs, 1);
+        LAY_STATS_ADD(ctx, bytes_allocated, capacity);
+        ctx->record = (uint8_t*)LAY_REALLOC(ctx->record, capacity);
+        ctx->record_capacity = capacity;
+    }
+    return ctx->record + ctx->record_size;
+}
+
+static LAY_FORCE_INLINE uint8_t *lay_record_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static LAY_FORCE_INLINE uint8_t *lay_record_scalar(uint8_t *p, lay_scalar value)
+{
+#ifdef LAY_FLOAT
+    union { float f; uint32_t u; } cast;
+    cast.f = value;
+    const uint32_t bits = cast.u;
+    p[0] = (uint8_t)bits;
+    p[1] = (uint8_t)(bits >> 8);
+    p[2] = (uint8_t)(bits >> 16);
+    p[3] = (uint8_t)(bits >> 24);
+    return p + 4;
+#else
+    // zigzag, so that small negative values stay small
+    const int32_t v = value;
+    return lay_record_varint(p, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+#endif
+}
+
+static void lay_record_call(
+        lay_context *ctx, lay_record_op op,
+        const uint32_t *ints, int num_ints,
+        const lay_scalar *scalars, int num_scalars)
+{
+    uint8_t *start = lay_record_reserve(ctx, LAY_RECORD_MAX_CALL);
+    uint8_t *p = start;
+    *p++ = (uint8_t)op;
+    for (int i = 0; i < num_ints; ++i)
+        p = lay_record_varint(p, ints[i]);
+    for (int i = 0; i < num_scalars; ++i)
+        p = lay_record_scalar(p, scalars[i]);
+    ctx->record_size += (size_t)(p - start);
+}
+
+static void lay_record_ints(lay_context *ctx, lay_record_op op, uint32_t a, uint32_t b, int num_ints)
+{
+    const uint32_t ints[2] = {a, b};
+    lay_record_call(ctx, op, ints, num_ints, NULL, 0);
+}
+
+static void lay_record_scalars(
+        lay_context *ctx, lay_record_op op, lay_id item,
+        lay_scalar a, lay_scalar b, lay_scalar c, lay_scalar d, int num_scalars)
+{
+    const uint32_t ints[1] = {item};
+    const lay_scalar scalars[4] = {a, b, c, d};
+    lay_record_call(ctx, op, ints, 1, scalars, num_scalars);
+}
+
+#define LAY_RECORD_CALL(ctx, call) do { if ((ctx)->recording) call; } while (0)
+#else
+#define LAY_RECORD_CALL(ctx, call) do {} while (0)
+#endif // LAY_RECORD
+
 void lay_init_context(lay_context *ctx)
 {
     ctx->capacity = 0;
     ctx->count = 0;
     ctx->items = NULL;
     ctx->rects = NULL;
+    ctx->lines = NULL;
+    ctx->ext = NULL;
+    ctx->tracks = NULL;
+    ctx->track_spans = NULL;
+    ctx->tracks_count = 0;
+    ctx->tracks_capacity = 0;
+    ctx->trim_after = 0;
+    ctx->quiet_resets = 0;
+    ctx->trim_peak_items = 0;
+    ctx->trim_peak_tracks = 0;
+#ifdef LAY_RECORD
+    ctx->record = NULL;
+    ctx->record_size = 0;
+    ctx->record_capacity = 0;
+    ctx->recording = 0;
+#endif
+#ifdef LAY_STATS
+    LAY_MEMSET(&ctx->stats, 0, sizeof(lay_stats));
+#endif
+#ifdef LAY_TRACE
+    ctx->trace_events = NULL;
+    ctx->trace_capacity = 0;
+    ctx->tracing = 0;
+    ctx->trace_written = 0;
+    ctx->trace_min_items = 1;
+    ctx->trace_sizes = NULL;
+    ctx->trace_tags = NULL;
+#endif
+#ifdef LAY_PUBLISH
+    LAY_MEMSET(ctx->snapshots, 0, sizeof(ctx->snapshots));
+    ctx->published = 0;
+    ctx->publish_epoch = 0;
+#endif
 }
 
-void lay_reserve_items_capacity(lay_context *ctx, lay_id count)
+// Items, rects and the line table share a single heap buffer, in that order.
+// Only the items are preserved when the buffer is reallocated -- rects and
+// lines are layout output, and are invalidated by reallocation anyway.
+static void lay_set_items_capacity(lay_context *ctx, lay_id capacity)
 {
-    if (count >= ctx->capacity) {
-        ctx->capacity = count;
-        const size_t item_size = sizeof(lay_item_t) + sizeof(lay_vec4);
-        ctx->items = (lay_item_t*)LAY_REALLOC(ctx->items, ctx->capacity * item_size);
-        const lay_item_t *past_last = ctx->items + ctx->capacity;
-        ctx->rects = (lay_vec4*)past_last;
+    const size_t item_size = sizeof(lay_item_t) + sizeof(lay_vec4) + sizeof(lay_id);
+#ifdef LAY_TRACE
+    lay_trace_resize(ctx, ctx->capacity, capacity);
+#endif
+    ctx->capacity = capacity;
+    LAY_STATS_ADD(ctx, reallocs, 1);
+    LAY_STATS_ADD(ctx, bytes_allocated, capacity * item_size);
+    ctx->items = (lay_item_t*)LAY_REALLOC(ctx->items, capacity * item_size);
+    const lay_item_t *past_last = ctx->items + capacity;
+    ctx->rects = (lay_vec4*)past_last;
+    ctx->lines = (lay_id*)(ctx->rects + capacity);
+    if (ctx->ext != NULL) {
+        LAY_STATS_ADD(ctx, reallocs, 1);
+        LAY_STATS_ADD(ctx, bytes_allocated, capacity * sizeof(lay_item_ext));
+        ctx->ext = (lay_item_ext*)LAY_REALLOC(ctx->ext, capacity * sizeof(lay_item_ext));
     }
 }
 
-void lay_destroy_context(lay_context *ctx)
+void lay_reserve_items_capacity(lay_context *ctx, lay_id count)
+{
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_RESERVE_ITEMS_CAPACITY, count, 0, 1));
+    if (count >= ctx->capacity)
+        lay_set_items_capacity(ctx, count);
+}
+
+// Releases the items buffer and everything parallel to it. The caller is
+// responsible for there being no items left.
+static void lay_free_items(lay_context *ctx)
 {
     if (ctx->items != NULL) {
         LAY_FREE(ctx->items);
         ctx->items = NULL;
         ctx->rects = NULL;
+        ctx->lines = NULL;
+    }
+    if (ctx->ext != NULL) {
+        LAY_FREE(ctx->ext);
+        ctx->ext = NULL;
+    }
+    ctx->capacity = 0;
+#ifdef LAY_TRACE
+    if (ctx->trace_tags != NULL) {
+        LAY_FREE((void*)ctx->trace_tags);
+        ctx->trace_tags = NULL;
+    }
+    // lay_traced() expects the sizes to exist for as long as tracing is on.
+    // lay_trace_resize() zeroes them again when items are added.
+    if (ctx->trace_sizes != NULL && !ctx->tracing) {
+        LAY_FREE(ctx->trace_sizes);
+        ctx->trace_sizes = NULL;
+    }
+#endif
+}
+
+// Like the items, the column definitions are preserved and the spans are not.
+static void lay_set_tracks_capacity(lay_context *ctx, uint32_t capacity)
+{
+    if (capacity == 0) {
+        if (ctx->tracks != NULL)
+            LAY_FREE(ctx->tracks);
+        ctx->tracks = NULL;
+        ctx->track_spans = NULL;
+        ctx->tracks_capacity = 0;
+        return;
+    }
+    const size_t track_size = sizeof(lay_track) + sizeof(lay_vec2);
+    LAY_STATS_ADD(ctx, reallocs, 1);
+    LAY_STATS_ADD(ctx, bytes_allocated, capacity * track_size);
+    ctx->tracks = (lay_track*)LAY_REALLOC(ctx->tracks, capacity * track_size);
+    ctx->track_spans = (lay_vec2*)(ctx->tracks + capacity);
+    ctx->tracks_capacity = capacity;
+}
+
+void lay_destroy_context(lay_context *ctx)
+{
+    lay_free_items(ctx);
+    lay_set_tracks_capacity(ctx, 0);
+    ctx->count = 0;
+    ctx->tracks_count = 0;
+#ifdef LAY_RECORD
+    if (ctx->record != NULL) {
+        LAY_FREE(ctx->record);
+        ctx->record = NULL;
+        ctx->record_size = 0;
+        ctx->record_capacity = 0;
+    }
+    ctx->recording = 0;
+#endif
+#ifdef LAY_TRACE
+    if (ctx->trace_events != NULL) {
+        LAY_FREE(ctx->trace_events);
+        ctx->trace_events = NULL;
+    }
+    if (ctx->trace_sizes != NULL) {
+        LAY_FREE(ctx->trace_sizes);
+        ctx->trace_sizes = NULL;
+    }
+    ctx->trace_capacity = 0;
+    ctx->tracing = 0;
+    ctx->trace_written = 0;
+#endif
+#ifdef LAY_PUBLISH
+    for (uint32_t i = 0; i < LAY_PUBLISH_BUFFERS; ++i) {
+        LAY_ASSERT(ctx->snapshots[i].readers == 0);
+        if (ctx->snapshots[i].rects != NULL)
+            LAY_FREE(ctx->snapshots[i].rects);
     }
+    LAY_MEMSET(ctx->snapshots, 0, sizeof(ctx->snapshots));
+    ctx->published = 0;
+#endif
 }
 
+// Below this many items or columns there's nothing worth giving back
+#define LAY_TRIM_MIN_ITEMS 32
+#define LAY_TRIM_MIN_TRACKS 16
+
 void lay_reset_context(lay_context *ctx)
-{ ctx->count = 0; }
+{
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_RESET_CONTEXT, 0, 0, 0));
+    if (ctx->trim_after > 0) {
+        // A reset is quiet when the layout that's being thrown away used at
+        // most a quarter of the items buffer. Any busier layout starts over.
+        if (ctx->capacity > LAY_TRIM_MIN_ITEMS && ctx->count <= ctx->capacity / 4) {
+            if (ctx->count > ctx->trim_peak_items)
+                ctx->trim_peak_items = ctx->count;
+            if (ctx->tracks_count > ctx->trim_peak_tracks)
+                ctx->trim_peak_tracks = ctx->tracks_count;
+            if (++ctx->quiet_resets >= ctx->trim_after) {
+                lay_id items = ctx->trim_peak_items * 2;
+                uint32_t tracks = ctx->trim_peak_tracks * 2;
+                if (items < LAY_TRIM_MIN_ITEMS)
+                    items = LAY_TRIM_MIN_ITEMS;
+                if (tracks < LAY_TRIM_MIN_TRACKS)
+                    tracks = LAY_TRIM_MIN_TRACKS;
+                lay_set_items_capacity(ctx, items);
+                if (ctx->tracks_capacity > tracks)
+                    lay_set_tracks_capacity(ctx, tracks);
+                ctx->quiet_resets = 0;
+                ctx->trim_peak_items = 0;
+                ctx->trim_peak_tracks = 0;
+            }
+        } else {
+            ctx->quiet_resets = 0;
+            ctx->trim_peak_items = 0;
+            ctx->trim_peak_tracks = 0;
+        }
+    }
+    ctx->count = 0;
+    ctx->tracks_count = 0;
+}
 
-static void lay_calc_size(lay_context *ctx, lay_id item, int dim);
-static void lay_arrange(lay_context *ctx, lay_id item, int dim);
+void lay_set_trim_policy(lay_context *ctx, uint32_t quiet_resets)
+{
+    LAY_ASSERT(ctx != NULL);
+    ctx->trim_after = quiet_resets;
+    ctx->quiet_resets = 0;
+    ctx->trim_peak_items = 0;
+    ctx->trim_peak_tracks = 0;
+}
 
-void lay_run_context(lay_context *ctx)
+void lay_shrink_to_fit(lay_context *ctx)
 {
     LAY_ASSERT(ctx != NULL);
+    if (ctx->count == 0)
+        lay_free_items(ctx);
+    else if (ctx->count < ctx->capacity)
+        lay_set_items_capacity(ctx, ctx->count);
+    if (ctx->tracks_count < ctx->tracks_capacity)
+        lay_set_tracks_capacity(ctx, ctx->tracks_count);
+#ifdef LAY_RECORD
+    if (!ctx->recording && ctx->record_size < ctx->record_capacity) {
+        if (ctx->record_size == 0) {
+            LAY_FREE(ctx->record);
+            ctx->record = NULL;
+        } else {
+            LAY_STATS_ADD(ctx, reallocs, 1);
+            LAY_STATS_ADD(ctx, bytes_allocated, ctx->record_size);
+            ctx->record = (uint8_t*)LAY_REALLOC(ctx->record, ctx->record_size);
+        }
+        ctx->record_capacity = ctx->record_size;
+    }
+#endif
+#ifdef LAY_PUBLISH
+    // Only the buffers that no reader can get to any more. The newest snapshot
+    // stays, so that readers still have something to show.
+    const uint32_t published = LAY_ATOMIC_LOAD(&ctx->published);
+    for (uint32_t i = 0; i < LAY_PUBLISH_BUFFERS; ++i) {
+        lay_snapshot *snapshot = &ctx->snapshots[i];
+        if (i + 1 == published || snapshot->rects == NULL
+                || LAY_ATOMIC_LOAD(&snapshot->readers) != 0)
+            continue;
+        LAY_FREE(snapshot->rects);
+        snapshot->rects = NULL;
+        snapshot->count = 0;
+        snapshot->capacity = 0;
+    }
+#endif
+}
 
-    if (ctx->count > 0) {
-        lay_run_item(ctx, 0);
+void lay_copy_context(lay_context *dst, const lay_context *src)
+{
+    LAY_ASSERT(dst != NULL && src != NULL && dst != src);
+    const lay_id count = src->count;
+    if (count > dst->capacity)
+        lay_set_items_capacity(dst, count);
+    // The rects are copied too, since they carry the position of the root and
+    // lay_run_item reads the rects of the items around the subtree.
+    for (lay_id i = 0; i < count; ++i) {
+        dst->items[i] = src->items[i];
+        dst->rects[i] = src->rects[i];
+    }
+    if (src->ext != NULL && count > 0) {
+        if (dst->ext == NULL) {
+            LAY_STATS_ADD(dst, reallocs, 1);
+            LAY_STATS_ADD(dst, bytes_allocated, dst->capacity * sizeof(lay_item_ext));
+            dst->ext = (lay_item_ext*)LAY_REALLOC(NULL, dst->capacity * sizeof(lay_item_ext));
+        }
+        for (lay_id i = 0; i < count; ++i)
+            dst->ext[i] = src->ext[i];
+    }
+    const uint32_t tracks_count = src->tracks_count;
+    if (tracks_count > dst->tracks_capacity)
+        lay_set_tracks_capacity(dst, tracks_count);
+    for (uint32_t i = 0; i < tracks_count; ++i) {
+        dst->tracks[i] = src->tracks[i];
+        dst->track_spans[i] = src->track_spans[i];
     }
+    dst->count = count;
+    dst->tracks_count = tracks_count;
+#ifdef LAY_TRACE
+    if (dst->trace_tags != NULL)
+        LAY_MEMSET((void*)dst->trace_tags, 0, dst->capacity * sizeof(const char*));
+#endif
 }
 
-void lay_run_item(lay_context *ctx, lay_id item)
+size_t lay_memory_usage(lay_context *ctx, lay_memory *detail)
 {
     LAY_ASSERT(ctx != NULL);
+    lay_memory usage;
+    usage.items = ctx->capacity * (sizeof(lay_item_t) + sizeof(lay_vec4) + sizeof(lay_id));
+    usage.ext = ctx->ext != NULL ? ctx->capacity * sizeof(lay_item_ext) : 0;
+    usage.tracks = ctx->tracks_capacity * (sizeof(lay_track) + sizeof(lay_vec2));
+    usage.diagnostics = 0;
+#ifdef LAY_RECORD
+    usage.diagnostics += ctx->record_capacity;
+#endif
+#ifdef LAY_TRACE
+    usage.diagnostics += ctx->trace_capacity * sizeof(lay_trace_event);
+    if (ctx->trace_sizes != NULL)
+        usage.diagnostics += ctx->capacity * sizeof(lay_id);
+    if (ctx->trace_tags != NULL)
+        usage.diagnostics += ctx->capacity * sizeof(const char*);
+#endif
+    usage.snapshots = 0;
+#ifdef LAY_PUBLISH
+    for (uint32_t i = 0; i < LAY_PUBLISH_BUFFERS; ++i)
+        usage.snapshots += ctx->snapshots[i].capacity * sizeof(lay_vec4);
+#endif
+    if (detail != NULL)
+        *detail = usage;
+    return usage.items + usage.ext + usage.tracks + usage.diagnostics + usage.snapshots;
+}
+
+static void lay_calc_size(lay_context *ctx, lay_id item, int dim);
+static void lay_arrange(lay_context *ctx, lay_id item, int dim);
 
+static void lay_run(lay_context *ctx, lay_id item)
+{
     lay_calc_size(ctx, item, 0);
     lay_arrange(ctx, item, 0);
     lay_calc_size(ctx, item, 1);
     lay_arrange(ctx, item, 1);
 }
 
-// Alternatively, we could use a flag bit to indicate whether an item's children
-// have already been wrapped and may need re-wrapping. If we do that, in the
-// future, this would become deprecated and we could make it a no-op.
+void lay_run_context(lay_context *ctx)
+{
+    LAY_ASSERT(ctx != NULL);
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_RUN_CONTEXT, 0, 0, 0));
+
+    if (ctx->count > 0) {
+        lay_run(ctx, 0);
+    }
+}
+
+void lay_run_item(lay_context *ctx, lay_id item)
+{
+    LAY_ASSERT(ctx != NULL);
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_RUN_ITEM, item, 0, 1));
+
+    lay_run(ctx, item);
+}
 
 void lay_clear_item_break(lay_context *ctx, lay_id item)
 {
     LAY_ASSERT(ctx != NULL);
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_CLEAR_ITEM_BREAK, item, 0, 1));
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->flags = pitem->flags & ~(uint32_t)LAY_BREAK;
 }
@@ -519,14 +1380,21 @@ lay_id lay_items_capacity(lay_context *ctx)
 
 lay_id lay_item(lay_context *ctx)
 {
+    // Running out of ids would make the new item alias LAY_INVALID_ID. This is
+    // mostly a concern with LAY_ID_BITS set to 16.
+    LAY_ASSERT(ctx->count < LAY_INVALID_ID);
+    // Without asserts, refuse instead of writing past the item storage, which
+    // can't grow beyond LAY_INVALID_ID items
+    if (ctx->count >= LAY_INVALID_ID)
+        return LAY_INVALID_ID;
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_ITEM, 0, 0, 0));
     lay_id idx = ctx->count++;
 
     if (idx >= ctx->capacity) {
-        ctx->capacity = ctx->capacity < 1 ? 32 : (ctx->capacity * 4);
-        const size_t item_size = sizeof(lay_item_t) + sizeof(lay_vec4);
-        ctx->items = (lay_item_t*)LAY_REALLOC(ctx->items, ctx->capacity * item_size);
-        const lay_item_t *past_last = ctx->items + ctx->capacity;
-        ctx->rects = (lay_vec4*)past_last;
+        uint64_t capacity = ctx->capacity < 1 ? 32 : ((uint64_t)ctx->capacity * 4);
+        if (capacity > LAY_INVALID_ID)
+            capacity = LAY_INVALID_ID;
+        lay_set_items_capacity(ctx, (lay_id)capacity);
     }
 
     lay_item_t *item = lay_get_item(ctx, idx);
@@ -536,6 +1404,10 @@ lay_id lay_item(lay_context *ctx)
     item->next_sibling = LAY_INVALID_ID;
     // hmm
     LAY_MEMSET(&ctx->rects[idx], 0, sizeof(lay_vec4));
+#ifdef LAY_TRACE
+    if (ctx->trace_tags != NULL)
+        ctx->trace_tags[idx] = NULL;
+#endif
     return idx;
 }
 
@@ -567,6 +1439,7 @@ lay_id lay_last_child(const lay_context *ctx, lay_id parent)
 
 void lay_append(lay_context *ctx, lay_id earlier, lay_id later)
 {
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_APPEND, earlier, later, 2));
     LAY_ASSERT(later != 0); // Must not be root item
     LAY_ASSERT(earlier != later); // Must not be same item id
     lay_item_t *LAY_RESTRICT pearlier = lay_get_item(ctx, earlier);
@@ -576,6 +1449,7 @@ void lay_append(lay_context *ctx, lay_id earlier, lay_id later)
 
 void lay_insert(lay_context *ctx, lay_id parent, lay_id child)
 {
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_INSERT, parent, child, 2));
     LAY_ASSERT(child != 0); // Must not be root item
     LAY_ASSERT(parent != child); // Must not be same item id
     lay_item_t *LAY_RESTRICT pparent = lay_get_item(ctx, parent);
@@ -593,6 +1467,7 @@ void lay_insert(lay_context *ctx, lay_id parent, lay_id child)
         for (;;) {
             next = pnext->next_sibling;
             if (next == LAY_INVALID_ID) break;
+            LAY_STATS_ADD(ctx, insert_steps, 1);
             pnext = lay_get_item(ctx, next);
         }
         lay_append_by_ptr(pnext, child, pchild);
@@ -601,6 +1476,7 @@ void lay_insert(lay_context *ctx, lay_id parent, lay_id child)
 
 void lay_push(lay_context *ctx, lay_id parent, lay_id new_child)
 {
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_PUSH, parent, new_child, 2));
     LAY_ASSERT(new_child != 0); // Must not be root item
     LAY_ASSERT(parent != new_child); // Must not be same item id
     lay_item_t *LAY_RESTRICT pparent = lay_get_item(ctx, parent);
@@ -630,6 +1506,7 @@ void lay_get_size_xy(
 
 void lay_set_size(lay_context *ctx, lay_id item, lay_vec2 size)
 {
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_SIZE, item, size[0], size[1], 0, 0, 2));
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->size = size;
     uint32_t flags = pitem->flags;
@@ -648,6 +1525,7 @@ void lay_set_size_xy(
         lay_context *ctx, lay_id item,
         lay_scalar width, lay_scalar height)
 {
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_SIZE, item, width, height, 0, 0, 2));
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->size[0] = width;
     pitem->size[1] = height;
@@ -666,6 +1544,7 @@ void lay_set_size_xy(
 
 void lay_set_behave(lay_context *ctx, lay_id item, uint32_t flags)
 {
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_SET_BEHAVE, item, flags, 2));
     LAY_ASSERT((flags & LAY_ITEM_LAYOUT_MASK) == flags);
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->flags = (pitem->flags & ~(uint32_t)LAY_ITEM_LAYOUT_MASK) | flags;
@@ -673,12 +1552,14 @@ void lay_set_behave(lay_context *ctx, lay_id item, uint32_t flags)
 
 void lay_set_contain(lay_context *ctx, lay_id item, uint32_t flags)
 {
+    LAY_RECORD_CALL(ctx, lay_record_ints(ctx, LAY_RECORD_SET_CONTAIN, item, flags, 2));
     LAY_ASSERT((flags & LAY_ITEM_BOX_MASK) == flags);
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->flags = (pitem->flags & ~(uint32_t)LAY_ITEM_BOX_MASK) | flags;
 }
 void lay_set_margins(lay_context *ctx, lay_id item, lay_vec4 ltrb)
 {
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MARGINS, item, ltrb[0], ltrb[1], ltrb[2], ltrb[3], 4));
     lay_item_t *pitem = lay_get_item(ctx, item);
     pitem->margins = ltrb;
 }
@@ -686,6 +1567,7 @@ void lay_set_margins_ltrb(
         lay_context *ctx, lay_id item,
         lay_scalar l, lay_scalar t, lay_scalar r, lay_scalar b)
 {
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MARGINS, item, l, t, r, b, 4));
     lay_item_t *pitem = lay_get_item(ctx, item);
     // Alternative, uses stack and addressed writes
     //pitem->margins = lay_vec4_xyzw(l, t, r, b);
@@ -713,73 +1595,273 @@ void lay_get_margins_ltrb(
     *b = margins[3];
 }
 
-// TODO restrict item ptrs correctly
-static LAY_FORCE_INLINE
-lay_scalar lay_calc_overlayed_size(
-        lay_context *ctx, lay_id item, int dim)
+// Returns the item's ext record, creating it (and the ext buffer) if needed.
+static lay_item_ext *lay_get_ext(lay_context *ctx, lay_id item)
 {
-    const int wdim = dim + 2;
-    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
-    lay_scalar need_size = 0;
-    lay_id child = pitem->first_child;
-    while (child != LAY_INVALID_ID) {
-        lay_item_t *pchild = lay_get_item(ctx, child);
-        lay_vec4 rect = ctx->rects[child];
-        // width = start margin + calculated width + end margin
-        lay_scalar child_size = rect[dim] + rect[2 + dim] + pchild->margins[wdim];
-        need_size = lay_scalar_max(need_size, child_size);
-        child = pchild->next_sibling;
+    lay_item_t *pitem = lay_get_item(ctx, item);
+    if (ctx->ext == NULL) {
+        LAY_STATS_ADD(ctx, reallocs, 1);
+        LAY_STATS_ADD(ctx, bytes_allocated, ctx->capacity * sizeof(lay_item_ext));
+        ctx->ext = (lay_item_ext*)LAY_REALLOC(NULL, ctx->capacity * sizeof(lay_item_ext));
     }
-    return need_size;
-}
-
-static LAY_FORCE_INLINE
-lay_scalar lay_calc_stacked_size(
-        lay_context *ctx, lay_id item, int dim)
-{
-    const int wdim = dim + 2;
-    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
-    lay_scalar need_size = 0;
-    lay_id child = pitem->first_child;
-    while (child != LAY_INVALID_ID) {
-        lay_item_t *pchild = lay_get_item(ctx, child);
-        lay_vec4 rect = ctx->rects[child];
-        need_size += rect[dim] + rect[2 + dim] + pchild->margins[wdim];
-        child = pchild->next_sibling;
+    lay_item_ext *pext = &ctx->ext[item];
+    if (!(pitem->flags & LAY_ITEM_EXT)) {
+        LAY_MEMSET(pext, 0, sizeof(lay_item_ext));
+        pext->grow_weight = 1;
+        pext->shrink_weight = 1;
+        pitem->flags |= LAY_ITEM_EXT;
     }
-    return need_size;
+    return pext;
 }
 
-static LAY_FORCE_INLINE
-lay_scalar lay_calc_wrapped_overlayed_size(
-        lay_context *ctx, lay_id item, int dim)
+void lay_set_min_size(lay_context *ctx, lay_id item, lay_vec2 size)
 {
-    const int wdim = dim + 2;
-    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
-    lay_scalar need_size = 0;
-    lay_scalar need_size2 = 0;
-    lay_id child = pitem->first_child;
-    while (child != LAY_INVALID_ID) {
-        lay_item_t *pchild = lay_get_item(ctx, child);
-        lay_vec4 rect = ctx->rects[child];
-        if (pchild->flags & LAY_BREAK) {
-            need_size2 += need_size;
-            need_size = 0;
-        }
-        lay_scalar child_size = rect[dim] + rect[2 + dim] + pchild->margins[wdim];
-        need_size = lay_scalar_max(need_size, child_size);
-        child = pchild->next_sibling;
-    }
-    return need_size2 + need_size;
+    LAY_ASSERT(size[0] >= 0 && size[1] >= 0);
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MIN_SIZE, item, size[0], size[1], 0, 0, 2));
+    lay_get_ext(ctx, item)->min_size = size;
+}
+
+void lay_set_min_size_xy(
+        lay_context *ctx, lay_id item,
+        lay_scalar width, lay_scalar height)
+{
+    LAY_ASSERT(width >= 0 && height >= 0);
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MIN_SIZE, item, width, height, 0, 0, 2));
+    lay_item_ext *pext = lay_get_ext(ctx, item);
+    pext->min_size[0] = width;
+    pext->min_size[1] = height;
+}
+
+void lay_set_max_size(lay_context *ctx, lay_id item, lay_vec2 size)
+{
+    LAY_ASSERT(size[0] >= 0 && size[1] >= 0);
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MAX_SIZE, item, size[0], size[1], 0, 0, 2));
+    lay_get_ext(ctx, item)->max_size = size;
+}
+
+void lay_set_max_size_xy(
+        lay_context *ctx, lay_id item,
+        lay_scalar width, lay_scalar height)
+{
+    LAY_ASSERT(width >= 0 && height >= 0);
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_MAX_SIZE, item, width, height, 0, 0, 2));
+    lay_item_ext *pext = lay_get_ext(ctx, item);
+    pext->max_size[0] = width;
+    pext->max_size[1] = height;
+}
+
+lay_vec2 lay_get_min_size(lay_context *ctx, lay_id item)
+{
+    if (lay_get_item(ctx, item)->flags & LAY_ITEM_EXT)
+        return ctx->ext[item].min_size;
+    lay_vec2 zero = {0, 0};
+    return zero;
+}
+
+lay_vec2 lay_get_max_size(lay_context *ctx, lay_id item)
+{
+    if (lay_get_item(ctx, item)->flags & LAY_ITEM_EXT)
+        return ctx->ext[item].max_size;
+    lay_vec2 zero = {0, 0};
+    return zero;
+}
+
+// Track definitions and spans share a single heap buffer, like items and rects.
+void lay_set_grid_columns(
+        lay_context *ctx, lay_id item,
+        const lay_track *columns, uint32_t count)
+{
+    LAY_ASSERT(columns != NULL || count == 0);
+#ifdef LAY_RECORD
+    if (ctx->recording) {
+        lay_record_ints(ctx, LAY_RECORD_SET_GRID_COLUMNS, item, count, 2);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint8_t *start = lay_record_reserve(ctx, LAY_RECORD_MAX_CALL);
+            uint8_t *p = lay_record_varint(start, columns[i].kind);
+            p = lay_record_scalar(p, columns[i].size);
+            ctx->record_size += (size_t)(p - start);
+        }
+    }
+#endif
+    lay_item_ext *pext = lay_get_ext(ctx, item);
+    // Setting the columns again, e.g. on every resize, reuses the item's range
+    // when the new columns fit in it, or when it's the last range and can
+    // grow. Otherwise the old range is left unused until the context is reset.
+    uint32_t first = ctx->tracks_count;
+    if (count <= pext->num_tracks || pext->first_track + pext->num_tracks == ctx->tracks_count)
+        first = pext->first_track;
+    if (first + count > ctx->tracks_capacity) {
+        uint32_t capacity = ctx->tracks_capacity < 16 ? 16 : ctx->tracks_capacity * 2;
+        if (capacity < first + count)
+            capacity = first + count;
+        lay_set_tracks_capacity(ctx, capacity);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        LAY_ASSERT(columns[i].kind <= LAY_TRACK_FILL);
+        ctx->tracks[first + i] = columns[i];
+    }
+    if (first + count > ctx->tracks_count)
+        ctx->tracks_count = first + count;
+    pext->first_track = first;
+    pext->num_tracks = count;
+}
+
+lay_vec2 lay_get_grid_column(lay_context *ctx, lay_id item, uint32_t column)
+{
+    const lay_item_t *pitem = lay_get_item(ctx, item);
+    LAY_ASSERT(pitem->flags & LAY_ITEM_EXT);
+    LAY_ASSERT(column < ctx->ext[item].num_tracks);
+    (void)pitem;
+    return ctx->track_spans[ctx->ext[item].first_track + column];
+}
+
+void lay_set_gap(lay_context *ctx, lay_id item, lay_scalar main, lay_scalar cross)
+{
+    LAY_RECORD_CALL(ctx, lay_record_scalars(ctx, LAY_RECORD_SET_GAP, item, main, cross, 0, 0, 2));
+    lay_item_ext *pext = lay_get_ext(ctx, item);
+    pext->gap[0] = main;
+    pext->gap[1] = cross;
+}
+
+lay_vec2 lay_get_gap(lay_context *ctx, lay_id item)
+{
+    if (lay_get_item(ctx, item)->flags & LAY_ITEM_EXT)
+        return ctx->ext[item].gap;
+    lay_vec2 zero = {0, 0};
+    return zero;
+}
+
+void lay_set_weights(lay_context *ctx, lay_id item, uint16_t grow, uint16_t shrink)
+{
+#ifdef LAY_RECORD
+    if (ctx->recording) {
+        const uint32_t ints[3] = {item, grow, shrink};
+        lay_record_call(ctx, LAY_RECORD_SET_WEIGHTS, ints, 3, NULL, 0);
+    }
+#endif
+    lay_item_ext *pext = lay_get_ext(ctx, item);
+    pext->grow_weight = grow;
+    pext->shrink_weight = shrink;
+}
+
+void lay_get_weights(lay_context *ctx, lay_id item, uint16_t *grow, uint16_t *shrink)
+{
+    if (lay_get_item(ctx, item)->flags & LAY_ITEM_EXT) {
+        *grow = ctx->ext[item].grow_weight;
+        *shrink = ctx->ext[item].shrink_weight;
+    } else {
+        *grow = 1;
+        *shrink = 1;
+    }
+}
+
+// Gap between the children of a container, along its main axis (0) or
+// between lines (1).
+static LAY_FORCE_INLINE
+lay_scalar lay_container_gap(
+        const lay_context *ctx, lay_id item, uint32_t item_flags, int axis)
+{
+    if (item_flags & LAY_ITEM_EXT)
+        return ctx->ext[item].gap[axis];
+    return 0;
+}
+
+// Clamps a calculated size to the item's min/max size, if it has any.
+static LAY_FORCE_INLINE
+lay_scalar lay_clamp_size(
+        const lay_context *ctx, lay_id item, uint32_t item_flags,
+        int dim, lay_scalar size)
+{
+    if (item_flags & LAY_ITEM_EXT) {
+        const lay_item_ext *pext = &ctx->ext[item];
+        if (pext->max_size[dim] != 0)
+            size = lay_scalar_min(size, pext->max_size[dim]);
+        size = lay_scalar_max(size, pext->min_size[dim]);
+    }
+    return size;
+}
+
+// TODO restrict item ptrs correctly
+static LAY_FORCE_INLINE
+lay_scalar lay_calc_overlayed_size(
+        lay_context *ctx, lay_id item, int dim)
+{
+    const int wdim = dim + 2;
+    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
+    lay_scalar need_size = 0;
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        lay_item_t *pchild = lay_get_item(ctx, child);
+        lay_vec4 rect = ctx->rects[child];
+        // width = start margin + calculated width + end margin
+        lay_scalar child_size = rect[dim] + rect[2 + dim] + pchild->margins[wdim];
+        need_size = lay_scalar_max(need_size, child_size);
+        child = pchild->next_sibling;
+    }
+    return need_size;
+}
+
+static LAY_FORCE_INLINE
+lay_scalar lay_calc_stacked_size(
+        lay_context *ctx, lay_id item, int dim)
+{
+    const int wdim = dim + 2;
+    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 0);
+    lay_scalar need_size = 0;
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        lay_item_t *pchild = lay_get_item(ctx, child);
+        lay_vec4 rect = ctx->rects[child];
+        need_size += rect[dim] + rect[2 + dim] + pchild->margins[wdim] + gap;
+        child = pchild->next_sibling;
+    }
+    // no gap after the last child
+    if (pitem->first_child != LAY_INVALID_ID)
+        need_size -= gap;
+    return need_size;
+}
+
+static LAY_FORCE_INLINE
+lay_scalar lay_calc_wrapped_overlayed_size(
+        lay_context *ctx, lay_id item, int dim)
+{
+    const int wdim = dim + 2;
+    lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 1);
+    lay_scalar need_size = 0;
+    lay_scalar need_size2 = 0;
+    lay_id child = pitem->first_child;
+    // The lines were computed by lay_arrange_stacked in the other dimension.
+    lay_id next_line = child != LAY_INVALID_ID ? ctx->lines[child] : LAY_INVALID_ID;
+    while (child != LAY_INVALID_ID) {
+        lay_item_t *pchild = lay_get_item(ctx, child);
+        lay_vec4 rect = ctx->rects[child];
+        if (child == next_line) {
+            need_size2 += need_size + gap;
+            need_size = 0;
+            next_line = ctx->lines[child];
+        }
+        lay_scalar child_size = rect[dim] + rect[2 + dim] + pchild->margins[wdim];
+        need_size = lay_scalar_max(need_size, child_size);
+        child = pchild->next_sibling;
+    }
+    return need_size2 + need_size;
 }
 
 // Equivalent to uiComputeWrappedStackedSize
+//
+// This runs before the container has been arranged in this dimension, so the
+// only line breaks known at this point are the ones set manually with
+// LAY_BREAK. (The line table still holds the previous run's lines, if any, and
+// must not be used here, or re-running the layout would not be idempotent.)
 static LAY_FORCE_INLINE
 lay_scalar lay_calc_wrapped_stacked_size(
         lay_context *ctx, lay_id item, int dim)
 {
     const int wdim = dim + 2;
     lay_item_t *LAY_RESTRICT pitem = lay_get_item(ctx, item);
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 0);
     lay_scalar need_size = 0;
     lay_scalar need_size2 = 0;
     lay_id child = pitem->first_child;
@@ -789,6 +1871,8 @@ lay_scalar lay_calc_wrapped_stacked_size(
         if (pchild->flags & LAY_BREAK) {
             need_size2 = lay_scalar_max(need_size2, need_size);
             need_size = 0;
+        } else if (child != pitem->first_child) {
+            need_size += gap;
         }
         need_size += rect[dim] + rect[2 + dim] + pchild->margins[wdim];
         child = pchild->next_sibling;
@@ -796,65 +1880,365 @@ lay_scalar lay_calc_wrapped_stacked_size(
     return lay_scalar_max(need_size2, need_size);
 }
 
+// Grids
+//
+// Cells are the children of the grid in row-major order. Column widths are
+// shared by all rows, and are measured in a single pass over the cells.
+static LAY_FORCE_INLINE
+uint32_t lay_grid_columns(const lay_context *ctx, lay_id item)
+{
+    if (lay_get_item(ctx, item)->flags & LAY_ITEM_EXT)
+        return ctx->ext[item].num_tracks;
+    return 0;
+}
+
+// Fixed columns keep their size, and auto and fill columns get the width of
+// their widest cell. The widths are stored in ctx->track_spans, for
+// lay_arrange_grid_0, and their sum is returned.
+static lay_scalar lay_measure_grid_columns(lay_context *ctx, lay_id item)
+{
+    const lay_item_t *pitem = lay_get_item(ctx, item);
+    const lay_item_ext *pext = &ctx->ext[item];
+    const lay_track *tracks = ctx->tracks + pext->first_track;
+    lay_vec2 *spans = ctx->track_spans + pext->first_track;
+    const uint32_t num_tracks = pext->num_tracks;
+
+    for (uint32_t i = 0; i < num_tracks; ++i)
+        spans[i][1] = tracks[i].kind == LAY_TRACK_FIXED ? tracks[i].size : 0;
+
+    uint32_t column = 0;
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        if (tracks[column].kind != LAY_TRACK_FIXED) {
+            const lay_vec4 rect = ctx->rects[child];
+            spans[column][1] = lay_scalar_max(
+                spans[column][1], rect[0] + rect[2] + pchild->margins[2]);
+        }
+        if (++column == num_tracks)
+            column = 0;
+        child = pchild->next_sibling;
+    }
+
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 0);
+    lay_scalar need_size = spans[0][1];
+    for (uint32_t i = 1; i < num_tracks; ++i)
+        need_size += gap + spans[i][1];
+    return need_size;
+}
+
+static lay_scalar lay_calc_grid_size_0(lay_context *ctx, lay_id item)
+{
+    // Without columns, a grid is a single column
+    if (lay_grid_columns(ctx, item) == 0)
+        return lay_calc_overlayed_size(ctx, item, 0);
+    return lay_measure_grid_columns(ctx, item);
+}
+
+// Rows are as tall as their tallest cell
+static lay_scalar lay_calc_grid_size_1(lay_context *ctx, lay_id item)
+{
+    const lay_item_t *pitem = lay_get_item(ctx, item);
+    uint32_t num_columns = lay_grid_columns(ctx, item);
+    if (num_columns == 0)
+        num_columns = 1;
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 1);
+    lay_scalar need_size = 0;
+    lay_scalar row_size = 0;
+    uint32_t column = 0;
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const lay_vec4 rect = ctx->rects[child];
+        row_size = lay_scalar_max(row_size, rect[1] + rect[3] + pchild->margins[3]);
+        if (++column == num_columns) {
+            need_size += row_size + gap;
+            row_size = 0;
+            column = 0;
+        }
+        child = pchild->next_sibling;
+    }
+    // no gap after the last row
+    if (column != 0)
+        return need_size + row_size;
+    if (pitem->first_child != LAY_INVALID_ID)
+        return need_size - gap;
+    return need_size;
+}
+
+// Specialized size kernels. Each of these is one of the lay_calc_*_size
+// procedures above with its dimension fixed at compile time, so that the
+// compiler can fold the dim/wdim indexing after inlining. lay_calc_size picks
+// the right one once per container from lay_calc_size_kernels instead of
+// switching on the box model and dimension for every item.
+typedef lay_scalar (*lay_calc_size_kernel)(lay_context *ctx, lay_id item);
+
+#define LAY_CALC_SIZE_KERNEL(name, proc, dim) \
+    static lay_scalar lay_calc_size_##name(lay_context *ctx, lay_id item) \
+    { return proc(ctx, item, dim); }
+
+LAY_CALC_SIZE_KERNEL(overlayed_0, lay_calc_overlayed_size, 0)
+LAY_CALC_SIZE_KERNEL(overlayed_1, lay_calc_overlayed_size, 1)
+LAY_CALC_SIZE_KERNEL(stacked_0, lay_calc_stacked_size, 0)
+LAY_CALC_SIZE_KERNEL(stacked_1, lay_calc_stacked_size, 1)
+LAY_CALC_SIZE_KERNEL(wrapped_stacked_0, lay_calc_wrapped_stacked_size, 0)
+LAY_CALC_SIZE_KERNEL(wrapped_overlayed_1, lay_calc_wrapped_overlayed_size, 1)
+
+static lay_scalar lay_calc_size_grid_0(lay_context *ctx, lay_id item)
+{ return lay_calc_grid_size_0(ctx, item); }
+static lay_scalar lay_calc_size_grid_1(lay_context *ctx, lay_id item)
+{ return lay_calc_grid_size_1(ctx, item); }
+
+#undef LAY_CALC_SIZE_KERNEL
+
+// Indexed by [dim][flags & LAY_ITEM_BOX_MODEL_MASK]. Box models that aren't a
+// row, column or grid (free layout, or LAY_WRAP without LAY_FLEX) use the
+// overlay kernel, same as the default case of the old switch.
+static const lay_calc_size_kernel lay_calc_size_kernels[2][8] = {
+    {
+        lay_calc_size_overlayed_0, // LAY_LAYOUT
+        lay_calc_size_grid_0, // LAY_GRID
+        lay_calc_size_stacked_0, // LAY_ROW
+        lay_calc_size_overlayed_0, // LAY_COLUMN
+        lay_calc_size_overlayed_0,
+        lay_calc_size_overlayed_0,
+        lay_calc_size_wrapped_stacked_0, // LAY_ROW | LAY_WRAP
+        lay_calc_size_overlayed_0, // LAY_COLUMN | LAY_WRAP
+    },
+    {
+        lay_calc_size_overlayed_1, // LAY_LAYOUT
+        lay_calc_size_grid_1, // LAY_GRID
+        lay_calc_size_overlayed_1, // LAY_ROW
+        lay_calc_size_stacked_1, // LAY_COLUMN
+        lay_calc_size_overlayed_1,
+        lay_calc_size_overlayed_1,
+        lay_calc_size_wrapped_overlayed_1, // LAY_ROW | LAY_WRAP
+        lay_calc_size_stacked_1, // LAY_COLUMN | LAY_WRAP
+    },
+};
+
 static void lay_calc_size(lay_context *ctx, lay_id item, int dim)
 {
     lay_item_t *pitem = lay_get_item(ctx, item);
+    LAY_STATS_ADD(ctx, items_visited[dim * 2], 1);
+#ifdef LAY_TRACE
+    const bool traced = lay_traced(ctx, item);
+    const uint64_t trace_start = traced ? LAY_TRACE_NOW() : 0;
+    lay_id subtree_items = 1;
+#endif
 
     lay_id child = pitem->first_child;
     while (child != LAY_INVALID_ID) {
         // NOTE: this is recursive and will run out of stack space if items are
         // nested too deeply.
         lay_calc_size(ctx, child, dim);
+#ifdef LAY_TRACE
+        if (ctx->trace_sizes != NULL)
+            subtree_items += ctx->trace_sizes[child];
+#endif
         lay_item_t *pchild = lay_get_item(ctx, child);
         child = pchild->next_sibling;
     }
+#ifdef LAY_TRACE
+    if (dim == 0 && ctx->trace_sizes != NULL)
+        ctx->trace_sizes[item] = subtree_items;
+#endif
 
     // Set the mutable rect output data to the starting input data
     ctx->rects[item][dim] = pitem->margins[dim];
 
     // If we have an explicit input size, just set our output size (which other
     // calc_size and arrange procedures will use) to it.
-    if (pitem->size[dim] != 0) {
-        ctx->rects[item][2 + dim] = pitem->size[dim];
-        return;
+    lay_scalar size = pitem->size[dim];
+    if (size == 0) {
+        // Calculate our size based on children items. Note that we've already
+        // called lay_calc_size on our children at this point.
+        const lay_calc_size_kernel kernel =
+            lay_calc_size_kernels[dim][pitem->flags & LAY_ITEM_BOX_MODEL_MASK];
+        size = kernel(ctx, item);
     }
 
-    // Calculate our size based on children items. Note that we've already
-    // called lay_calc_size on our children at this point.
-    lay_scalar cal_size;
-    switch (pitem->flags & LAY_ITEM_BOX_MODEL_MASK) {
-    case LAY_COLUMN|LAY_WRAP:
-        // flex model
-        if (dim) // direction
-            cal_size = lay_calc_stacked_size(ctx, item, 1);
-        else
-            cal_size = lay_calc_overlayed_size(ctx, item, 0);
-        break;
-    case LAY_ROW|LAY_WRAP:
-        // flex model
-        if (!dim) // direction
-            cal_size = lay_calc_wrapped_stacked_size(ctx, item, 0);
-        else
-            cal_size = lay_calc_wrapped_overlayed_size(ctx, item, 1);
-        break;
-    case LAY_COLUMN:
-    case LAY_ROW:
-        // flex model
-        if ((pitem->flags & 1) == (uint32_t)dim) // direction
-            cal_size = lay_calc_stacked_size(ctx, item, dim);
+    // Set our output data size. Will be used by parent calc_size procedures.,
+    // and by arrange procedures.
+    ctx->rects[item][2 + dim] = lay_clamp_size(ctx, item, pitem->flags, dim, size);
+#ifdef LAY_TRACE
+    if (traced)
+        lay_trace_event_end(ctx, item, (uint32_t)dim * 2, trace_start);
+#endif
+}
+
+// Fillers with min/max sizes and weights
+//
+// Each filler in a line gets a share of the space per unit of its grow weight,
+// clamped to its own min/max sizes, and the share is chosen so that the
+// clamped sizes add up to the space available to the fillers. Space that a
+// clamped filler can't use goes to the others. The sum is non-decreasing in
+// the share, so it can be found by bisection, and only lines that have a
+// filler with LAY_ITEM_EXT set pay for it.
+#ifdef LAY_FLOAT
+static LAY_FORCE_INLINE
+float lay_clamp_filler(const lay_context *ctx, lay_id item, int dim, float share)
+{
+    const lay_item_ext *pext = &ctx->ext[item];
+    float size = share * (float)pext->grow_weight;
+    if (pext->max_size[dim] != 0)
+        size = lay_float_min(size, pext->max_size[dim]);
+    return lay_float_max(size, pext->min_size[dim]);
+}
+
+// Total size of the fillers in [start_child, end_child) for the given share.
+// Also sums the weights of the fillers that aren't clamped, and the sizes of
+// the ones that are.
+static float lay_fillers_size(
+        const lay_context *ctx, lay_id start_child, lay_id end_child, int dim,
+        float share, float *unclamped, float *clamped_size)
+{
+    *unclamped = 0.0f;
+    *clamped_size = 0.0f;
+    lay_id child = start_child;
+    while (child != end_child) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const uint32_t flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        if ((flags & LAY_HFILL) == LAY_HFILL) {
+            float weight = 1.0f;
+            float size = share;
+            if (pchild->flags & LAY_ITEM_EXT) {
+                weight = (float)ctx->ext[child].grow_weight;
+                size = lay_clamp_filler(ctx, child, dim, share);
+            }
+            if (size == share * weight)
+                *unclamped += weight;
+            else
+                *clamped_size += size;
+        }
+        child = pchild->next_sibling;
+    }
+    return *clamped_size + share * *unclamped;
+}
+
+static float lay_solve_fillers(
+        const lay_context *ctx, lay_id start_child, lay_id end_child, int dim,
+        float avail)
+{
+    float unclamped;
+    float clamped_size;
+    float lo = 0.0f;
+    float hi = avail;
+    // Everything is at its max size, and some of the space stays unused
+    if (lay_fillers_size(ctx, start_child, end_child, dim, hi, &unclamped, &clamped_size) <= avail)
+        return hi;
+    for (int i = 0; i < 32; ++i) {
+        float mid = (lo + hi) * 0.5f;
+        if (lay_fillers_size(ctx, start_child, end_child, dim, mid, &unclamped, &clamped_size) <= avail)
+            lo = mid;
         else
-            cal_size = lay_calc_overlayed_size(ctx, item, dim);
-        break;
-    default:
-        // layout model
-        cal_size = lay_calc_overlayed_size(ctx, item, dim);
-        break;
+            hi = mid;
     }
+    lay_fillers_size(ctx, start_child, end_child, dim, lo, &unclamped, &clamped_size);
+    if (unclamped == 0.0f)
+        return lo;
+    // Around lo, the same fillers are clamped, so the share can be solved for
+    // directly
+    return (avail - clamped_size) / unclamped;
+}
+#else
+// The share is fixed point, with LAY_SHARE_BITS fraction bits. The min/max
+// sizes and weights are integers, so the total is linear in the share between
+// the points where fillers get clamped, and with small weights (always, with
+// weight 1) those points are exact in fixed point.
+#define LAY_SHARE_BITS 16
 
-    // Set our output data size. Will be used by parent calc_size procedures.,
-    // and by arrange procedures.
-    ctx->rects[item][2 + dim] = cal_size;
+// Returns the size of a filler if it's clamped at the given share, or -1.
+static LAY_FORCE_INLINE
+int32_t lay_clamp_filler(const lay_context *ctx, lay_id item, int dim, int64_t share)
+{
+    const lay_item_ext *pext = &ctx->ext[item];
+    const int64_t size = share * pext->grow_weight;
+    if (size < ((int64_t)pext->min_size[dim] << LAY_SHARE_BITS))
+        return pext->min_size[dim];
+    if (pext->max_size[dim] != 0 && size >= ((int64_t)pext->max_size[dim] << LAY_SHARE_BITS))
+        return pext->max_size[dim];
+    return -1;
+}
+
+// Total size of the fillers in [start_child, end_child) for the given share,
+// in fixed point. Stops adding once the total is over limit, so that it can't
+// overflow.
+static int64_t lay_fillers_size(
+        const lay_context *ctx, lay_id start_child, lay_id end_child, int dim,
+        int64_t share, int64_t limit)
+{
+    int64_t total = 0;
+    lay_id child = start_child;
+    while (child != end_child) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const uint32_t flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        if ((flags & LAY_HFILL) == LAY_HFILL) {
+            if (pchild->flags & LAY_ITEM_EXT) {
+                int32_t clamped = lay_clamp_filler(ctx, child, dim, share);
+                if (clamped >= 0)
+                    total += (int64_t)clamped << LAY_SHARE_BITS;
+                else
+                    total += share * ctx->ext[child].grow_weight;
+            } else {
+                total += share;
+            }
+            if (total > limit)
+                break;
+        }
+        child = pchild->next_sibling;
+    }
+    return total;
+}
+
+// Finds the largest share that fits, and the fillers that aren't clamped just
+// above it. Those split the space that the clamped fillers leave by weight,
+// exactly: each of them gets rest * weight / denom.
+static int64_t lay_solve_fillers(
+        const lay_context *ctx, lay_id start_child, lay_id end_child, int dim,
+        int32_t avail, int32_t *rest, int32_t *denom)
+{
+    const int64_t limit = (int64_t)avail << LAY_SHARE_BITS;
+    // The min sizes are included in avail, so a share of 0 always fits.
+    int64_t lo = 0;
+    int64_t hi = limit + 1;
+    while (hi - lo > 1) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (lay_fillers_size(ctx, start_child, end_child, dim, mid, limit) <= limit)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    int32_t clamped_size = 0;
+    int32_t weight = 0;
+    lay_id child = start_child;
+    while (child != end_child) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const uint32_t flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        if ((flags & LAY_HFILL) == LAY_HFILL) {
+            if (pchild->flags & LAY_ITEM_EXT) {
+                int32_t clamped = lay_clamp_filler(ctx, child, dim, lo);
+                if (clamped >= 0)
+                    clamped_size += clamped;
+                else
+                    weight += ctx->ext[child].grow_weight;
+            } else {
+                ++weight;
+            }
+        }
+        child = pchild->next_sibling;
+    }
+    if (weight > 0) {
+        *rest = avail - clamped_size;
+        *denom = weight;
+    } else {
+        // Everything is at its max size, and some of the space stays unused
+        *rest = 0;
+        *denom = 1;
+    }
+    return lo;
 }
+#endif // LAY_FLOAT
 
 static LAY_FORCE_INLINE
 void lay_arrange_stacked(
@@ -866,14 +2250,21 @@ void lay_arrange_stacked(
     const uint32_t item_flags = pitem->flags;
     lay_vec4 rect = ctx->rects[item];
     lay_scalar space = rect[2 + dim];
+    const lay_scalar gap = lay_container_gap(ctx, item, item_flags, 0);
 
+#ifdef LAY_FLOAT
     float max_x2 = (float)(rect[dim] + space);
+#else
+    int32_t max_x2 = rect[dim] + space;
+#endif
 
     lay_id start_child = pitem->first_child;
     while (start_child != LAY_INVALID_ID) {
         lay_scalar used = 0;
         uint32_t count = 0; // count of fillers
-        uint32_t squeezed_count = 0; // count of squeezable elements
+        uint32_t squeezed_count = 0; // shrink weight of squeezable elements
+        uint32_t constrained_count = 0; // count of fillers with min/max sizes or weights
+        lay_scalar fillers_min = 0; // sum of their min sizes
         uint32_t total = 0;
         bool hardbreak = false;
         // first pass: count items that need to be expanded,
@@ -887,13 +2278,18 @@ void lay_arrange_stacked(
             const uint32_t fflags = (child_flags & LAY_ITEM_FIXED_MASK) >> dim;
             const lay_vec4 child_margins = pchild->margins;
             lay_vec4 child_rect = ctx->rects[child];
-            lay_scalar extend = used;
+            // gaps go between the items of a line
+            lay_scalar extend = total ? used + gap : used;
+            lay_scalar child_min = 0;
             if ((flags & LAY_HFILL) == LAY_HFILL) {
                 ++count;
-                extend += child_rect[dim] + child_margins[wdim];
+                // a filler takes up at least its min size
+                if (child_flags & LAY_ITEM_EXT)
+                    child_min = ctx->ext[child].min_size[dim];
+                extend += child_rect[dim] + child_min + child_margins[wdim];
             } else {
                 if ((fflags & LAY_ITEM_HFIXED) != LAY_ITEM_HFIXED)
-                    ++squeezed_count;
+                    squeezed_count += (child_flags & LAY_ITEM_EXT) ? ctx->ext[child].shrink_weight : 1;
                 extend += child_rect[dim] + child_rect[2 + dim] + child_margins[wdim];
             }
             // wrap on end of line or manual flag
@@ -902,17 +2298,24 @@ void lay_arrange_stacked(
                     (child_flags & LAY_BREAK)))) {
                 end_child = child;
                 hardbreak = (child_flags & LAY_BREAK) == LAY_BREAK;
-                // add marker for subsequent queries
-                pchild->flags = child_flags | LAY_BREAK;
                 break;
             } else {
                 used = extend;
+                if ((child_flags & LAY_ITEM_EXT) && (flags & LAY_HFILL) == LAY_HFILL) {
+                    ++constrained_count;
+                    fillers_min += child_min;
+                }
                 child = pchild->next_sibling;
             }
             ++total;
         }
 
         lay_scalar extra_space = space - used;
+        LAY_STATS_ADD(ctx, fill_lines, extra_space > 0 && count > 0);
+        LAY_STATS_ADD(ctx, solved_fill_lines, extra_space > 0 && constrained_count > 0);
+        LAY_STATS_ADD(ctx, squeeze_lines, !wrap && extra_space < 0 && squeezed_count > 0);
+        LAY_STATS_ADD(ctx, wrap_lines, wrap);
+#ifdef LAY_FLOAT
         float filler = 0.0f;
         float spacer = 0.0f;
         float extra_margin = 0.0f;
@@ -940,7 +2343,6 @@ void lay_arrange_stacked(
                 }
             }
         }
-#ifdef LAY_FLOAT
         // In floating point, it's possible to end up with some small negative
         // value for extra_space, while also have a 0.0 squeezed_count. This
         // would cause divide by zero. Instead, we'll check to see if
@@ -948,11 +2350,10 @@ void lay_arrange_stacked(
         // the original oui int-only code. However, I don't have any tests for
         // it, so I'll leave it if-def'd for now.
         else if (!wrap && (squeezed_count > 0))
-#else
-        // This is the original oui code
-        else if (!wrap && (extra_space < 0))
-#endif
             eater = (float)extra_space / (float)squeezed_count;
+        // With no extra space, constrained fillers just get their min size.
+        if (constrained_count > 0 && extra_space > 0)
+            filler = lay_solve_fillers(ctx, start_child, end_child, dim, extra_space + fillers_min);
 
         // distribute width among items
         float x = (float)rect[dim];
@@ -969,12 +2370,22 @@ void lay_arrange_stacked(
             lay_vec4 child_rect = ctx->rects[child];
 
             x += (float)child_rect[dim] + extra_margin;
-            if ((flags & LAY_HFILL) == LAY_HFILL) // grow
-                x1 = x + filler;
-            else if ((fflags & LAY_ITEM_HFIXED) == LAY_ITEM_HFIXED)
+            if ((flags & LAY_HFILL) == LAY_HFILL) { // grow
+                if (child_flags & LAY_ITEM_EXT)
+                    x1 = x + lay_clamp_filler(ctx, child, dim, filler);
+                else
+                    x1 = x + filler;
+            } else if ((fflags & LAY_ITEM_HFIXED) == LAY_ITEM_HFIXED) {
                 x1 = x + (float)child_rect[2 + dim];
-            else // squeeze
-                x1 = x + lay_float_max(0.0f, (float)child_rect[2 + dim] + eater);
+            } else { // squeeze, but not below the min size
+                float min_size = 0.0f;
+                float shrink = eater;
+                if (child_flags & LAY_ITEM_EXT) {
+                    min_size = (float)ctx->ext[child].min_size[dim];
+                    shrink *= (float)ctx->ext[child].shrink_weight;
+                }
+                x1 = x + lay_float_max(min_size, (float)child_rect[2 + dim] + shrink);
+            }
 
             ix0 = (lay_scalar)x;
             if (wrap)
@@ -984,47 +2395,195 @@ void lay_arrange_stacked(
             child_rect[dim] = ix0; // pos
             child_rect[dim + 2] = ix1 - ix0; // size
             ctx->rects[child] = child_rect;
-            x = x1 + (float)child_margins[wdim];
+            x = x1 + (float)child_margins[wdim] + (float)gap;
             child = pchild->next_sibling;
             extra_margin = spacer;
         }
+#else
+        // Integer builds distribute the extra space exactly, without going
+        // through float. Everything that gets added to a position is a multiple
+        // of 1/denom, where denom is the number (or total weight) of items
+        // sharing the extra space, so positions are kept as a whole part plus a remainder
+        // (0 <= rem < denom) in units of 1/denom. The output is the truncation
+        // of the exact position, which is what the float version computes
+        // when float rounding doesn't get in the way.
+        int32_t denom = 1;
+        // numerators, in units of 1/denom
+        int32_t filler = 0;
+        int32_t spacer = 0;
+        int32_t extra_margin = 0;
+        int32_t eater = 0;
+
+        if (extra_space > 0) {
+            if (count > 0) {
+                denom = (int32_t)count;
+                filler = extra_space;
+            } else if (total > 0) {
+                switch (item_flags & LAY_JUSTIFY) {
+                case LAY_JUSTIFY:
+                    // justify when not wrapping or not in last line,
+                    // or not manually breaking
+                    if (total > 1 && (!wrap || ((end_child != LAY_INVALID_ID) && !hardbreak))) {
+                        denom = (int32_t)(total - 1);
+                        spacer = extra_space;
+                    }
+                    break;
+                case LAY_START:
+                    break;
+                case LAY_END:
+                    extra_margin = extra_space;
+                    break;
+                default:
+                    denom = 2;
+                    extra_margin = extra_space;
+                    break;
+                }
+            }
+        }
+        // This is the original oui code
+        else if (!wrap && (extra_space < 0) && (squeezed_count > 0)) {
+            denom = (int32_t)squeezed_count;
+            eater = extra_space;
+        }
+
+        // With no extra space, constrained fillers just get their min size.
+        // Otherwise, the fillers are the only thing using the extra space, and
+        // all of the other numerators are 0, so they don't care about denom.
+        int64_t share = 0;
+        if (constrained_count > 0 && extra_space > 0) {
+            share = lay_solve_fillers(ctx, start_child, end_child, dim,
+                extra_space + fillers_min, &filler, &denom);
+        }
+        // the parts of a filler or squeezed item with weight 1
+        int32_t filler_whole, filler_rem, spacer_whole, spacer_rem;
+        int32_t margin_whole, margin_rem, eater_whole, eater_rem;
+        lay_split_fraction(filler, denom, &filler_whole, &filler_rem);
+        lay_split_fraction(spacer, denom, &spacer_whole, &spacer_rem);
+        lay_split_fraction(extra_margin, denom, &margin_whole, &margin_rem);
+        lay_split_fraction(eater, denom, &eater_whole, &eater_rem);
+
+        // distribute width among items
+        int32_t x = rect[dim], x_rem = 0;
+        int32_t x1, x1_rem;
+        // second pass: distribute and rescale
+        child = start_child;
+        while (child != end_child) {
+            lay_scalar ix0, ix1;
+            lay_item_t *pchild = lay_get_item(ctx, child);
+            const uint32_t child_flags = pchild->flags;
+            const uint32_t flags = (child_flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+            const uint32_t fflags = (child_flags & LAY_ITEM_FIXED_MASK) >> dim;
+            const lay_vec4 child_margins = pchild->margins;
+            lay_vec4 child_rect = ctx->rects[child];
+
+            x += child_rect[dim] + margin_whole;
+            lay_add_fraction_rem(&x, &x_rem, margin_rem, denom);
+            x1 = x;
+            x1_rem = x_rem;
+            if ((flags & LAY_HFILL) == LAY_HFILL) { // grow
+                int32_t clamped = -1;
+                int32_t whole = filler_whole, rem = filler_rem;
+                if (child_flags & LAY_ITEM_EXT) {
+                    clamped = lay_clamp_filler(ctx, child, dim, share);
+                    lay_split_fraction((int64_t)filler * ctx->ext[child].grow_weight,
+                        denom, &whole, &rem);
+                }
+                if (clamped >= 0) {
+                    x1 += clamped;
+                } else {
+                    x1 += whole;
+                    lay_add_fraction_rem(&x1, &x1_rem, rem, denom);
+                }
+            } else if ((fflags & LAY_ITEM_HFIXED) == LAY_ITEM_HFIXED) {
+                x1 += child_rect[2 + dim];
+            } else { // squeeze
+                // max(min_size, size + eater * weight)
+                int32_t min_size = 0;
+                int32_t whole = eater_whole, rem = eater_rem;
+                if (child_flags & LAY_ITEM_EXT) {
+                    min_size = ctx->ext[child].min_size[dim];
+                    lay_split_fraction((int64_t)eater * ctx->ext[child].shrink_weight,
+                        denom, &whole, &rem);
+                }
+                int32_t squeezed = child_rect[2 + dim] + whole;
+                if (squeezed >= min_size) {
+                    x1 += squeezed;
+                    lay_add_fraction_rem(&x1, &x1_rem, rem, denom);
+                } else {
+                    x1 += min_size;
+                }
+            }
+
+            ix0 = lay_trunc_fraction(x, x_rem);
+            if (wrap) {
+                const int32_t limit = max_x2 - child_margins[wdim];
+                if (x1 > limit || (x1 == limit && x1_rem > 0))
+                    ix1 = (lay_scalar)limit;
+                else
+                    ix1 = lay_trunc_fraction(x1, x1_rem);
+            } else {
+                ix1 = lay_trunc_fraction(x1, x1_rem);
+            }
+            child_rect[dim] = ix0; // pos
+            child_rect[dim + 2] = ix1 - ix0; // size
+            ctx->rects[child] = child_rect;
+            x = x1 + child_margins[wdim] + gap;
+            x_rem = x1_rem;
+            child = pchild->next_sibling;
+            margin_whole = spacer_whole;
+            margin_rem = spacer_rem;
+        }
+#endif // LAY_FLOAT
 
+        // record the line for subsequent queries
+        ctx->lines[start_child] = end_child;
         start_child = end_child;
     }
 }
 
+// Places a child in the range [offset, offset + space) according to its behave
+// flags. Used for the children of free layout items, and for grid cells.
 static LAY_FORCE_INLINE
-void lay_arrange_overlay(lay_context *ctx, lay_id item, int dim)
+void lay_arrange_overlay_child(
+        lay_context *ctx, lay_id child, const lay_item_t *pchild, int dim,
+        lay_scalar offset, lay_scalar space)
 {
     const int wdim = dim + 2;
+    const uint32_t b_flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+    const lay_vec4 child_margins = pchild->margins;
+    lay_vec4 child_rect = ctx->rects[child];
+
+    switch (b_flags & LAY_HFILL) {
+    case LAY_HCENTER:
+        child_rect[dim] += (space - child_rect[2 + dim]) / 2 - child_margins[wdim];
+        break;
+    case LAY_RIGHT:
+        child_rect[dim] += space - child_rect[2 + dim] - child_margins[dim] - child_margins[wdim];
+        break;
+    case LAY_HFILL:
+        child_rect[2 + dim] = lay_clamp_size(ctx, child, pchild->flags, dim,
+            lay_scalar_max(0, space - child_rect[dim] - child_margins[wdim]));
+        break;
+    default:
+        break;
+    }
+
+    child_rect[dim] += offset;
+    ctx->rects[child] = child_rect;
+}
+
+static LAY_FORCE_INLINE
+void lay_arrange_overlay(lay_context *ctx, lay_id item, int dim)
+{
     lay_item_t *pitem = lay_get_item(ctx, item);
     const lay_vec4 rect = ctx->rects[item];
     const lay_scalar offset = rect[dim];
     const lay_scalar space = rect[2 + dim];
-    
+
     lay_id child = pitem->first_child;
     while (child != LAY_INVALID_ID) {
         lay_item_t *pchild = lay_get_item(ctx, child);
-        const uint32_t b_flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
-        const lay_vec4 child_margins = pchild->margins;
-        lay_vec4 child_rect = ctx->rects[child];
-
-        switch (b_flags & LAY_HFILL) {
-        case LAY_HCENTER:
-            child_rect[dim] += (space - child_rect[2 + dim]) / 2 - child_margins[wdim];
-            break;
-        case LAY_RIGHT:
-            child_rect[dim] += space - child_rect[2 + dim] - child_margins[dim] - child_margins[wdim];
-            break;
-        case LAY_HFILL:
-            child_rect[2 + dim] = lay_scalar_max(0, space - child_rect[dim] - child_margins[wdim]);
-            break;
-        default:
-            break;
-        }
-
-        child_rect[dim] += offset;
-        ctx->rects[child] = child_rect;
+        lay_arrange_overlay_child(ctx, child, pchild, dim, offset, space);
         child = pchild->next_sibling;
     }
 }
@@ -1043,20 +2602,24 @@ void lay_arrange_overlay_squeezed_range(
         const lay_vec4 margins = pitem->margins;
         lay_vec4 rect = ctx->rects[item];
         lay_scalar min_size = lay_scalar_max(0, space - rect[dim] - margins[wdim]);
+        // Squeezing doesn't go below the item's own min size
         switch (b_flags & LAY_HFILL) {
             case LAY_HCENTER:
-                rect[2 + dim] = lay_scalar_min(rect[2 + dim], min_size);
+                rect[2 + dim] = lay_clamp_size(ctx, item, pitem->flags, dim,
+                    lay_scalar_min(rect[2 + dim], min_size));
                 rect[dim] += (space - rect[2 + dim]) / 2 - margins[wdim];
                 break;
             case LAY_RIGHT:
-                rect[2 + dim] = lay_scalar_min(rect[2 + dim], min_size);
+                rect[2 + dim] = lay_clamp_size(ctx, item, pitem->flags, dim,
+                    lay_scalar_min(rect[2 + dim], min_size));
                 rect[dim] = space - rect[2 + dim] - margins[wdim];
                 break;
             case LAY_HFILL:
-                rect[2 + dim] = min_size;
+                rect[2 + dim] = lay_clamp_size(ctx, item, pitem->flags, dim, min_size);
                 break;
             default:
-                rect[2 + dim] = lay_scalar_min(rect[2 + dim], min_size);
+                rect[2 + dim] = lay_clamp_size(ctx, item, pitem->flags, dim,
+                    lay_scalar_min(rect[2 + dim], min_size));
                 break;
         }
         rect[dim] += offset;
@@ -1071,17 +2634,20 @@ lay_scalar lay_arrange_wrapped_overlay_squeezed(
 {
     const int wdim = dim + 2;
     lay_item_t *pitem = lay_get_item(ctx, item);
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 1);
     lay_scalar offset = ctx->rects[item][dim];
     lay_scalar need_size = 0;
     lay_id child = pitem->first_child;
     lay_id start_child = child;
+    lay_id next_line = child != LAY_INVALID_ID ? ctx->lines[child] : LAY_INVALID_ID;
     while (child != LAY_INVALID_ID) {
         lay_item_t *pchild = lay_get_item(ctx, child);
-        if (pchild->flags & LAY_BREAK) {
+        if (child == next_line) {
             lay_arrange_overlay_squeezed_range(ctx, dim, start_child, child, offset, need_size);
-            offset += need_size;
+            offset += need_size + gap;
             start_child = child;
             need_size = 0;
+            next_line = ctx->lines[child];
         }
         const lay_vec4 rect = ctx->rects[child];
         lay_scalar child_size = rect[dim] + rect[2 + dim] + pchild->margins[wdim];
@@ -1093,41 +2659,191 @@ lay_scalar lay_arrange_wrapped_overlay_squeezed(
     return offset;
 }
 
-static void lay_arrange(lay_context *ctx, lay_id item, int dim)
+// Specialized arrange kernels, one per (box model, dim, wrap) combination.
+// Like the size kernels, these fix dim and wrap at compile time so that the
+// branches on them inside lay_arrange_stacked and friends disappear after
+// inlining, and lay_arrange dispatches to them once per container.
+typedef void (*lay_arrange_kernel)(lay_context *ctx, lay_id item);
+
+static void lay_arrange_overlay_0(lay_context *ctx, lay_id item)
+{ lay_arrange_overlay(ctx, item, 0); }
+static void lay_arrange_overlay_1(lay_context *ctx, lay_id item)
+{ lay_arrange_overlay(ctx, item, 1); }
+
+static void lay_arrange_stacked_0(lay_context *ctx, lay_id item)
+{ lay_arrange_stacked(ctx, item, 0, false); }
+static void lay_arrange_stacked_1(lay_context *ctx, lay_id item)
+{ lay_arrange_stacked(ctx, item, 1, false); }
+
+static void lay_arrange_squeezed_0(lay_context *ctx, lay_id item)
+{
+    const lay_vec4 rect = ctx->rects[item];
+    lay_arrange_overlay_squeezed_range(
+        ctx, 0, lay_get_item(ctx, item)->first_child, LAY_INVALID_ID,
+        rect[0], rect[2]);
+}
+static void lay_arrange_squeezed_1(lay_context *ctx, lay_id item)
+{
+    const lay_vec4 rect = ctx->rects[item];
+    lay_arrange_overlay_squeezed_range(
+        ctx, 1, lay_get_item(ctx, item)->first_child, LAY_INVALID_ID,
+        rect[1], rect[3]);
+}
+
+static void lay_arrange_row_wrap_0(lay_context *ctx, lay_id item)
+{ lay_arrange_stacked(ctx, item, 0, true); }
+static void lay_arrange_row_wrap_1(lay_context *ctx, lay_id item)
+{
+    // discard return value
+    lay_arrange_wrapped_overlay_squeezed(ctx, item, 1);
+}
+
+static void lay_arrange_column_wrap_0(lay_context *ctx, lay_id item)
+{
+    // Column wrapping is done entirely during the vertical pass.
+    (void)ctx;
+    (void)item;
+}
+static void lay_arrange_column_wrap_1(lay_context *ctx, lay_id item)
+{
+    lay_arrange_stacked(ctx, item, 1, true);
+    lay_scalar offset = lay_arrange_wrapped_overlay_squeezed(ctx, item, 0);
+    ctx->rects[item][2 + 0] = offset - ctx->rects[item][0];
+}
+
+static void lay_arrange_grid_0(lay_context *ctx, lay_id item)
 {
     lay_item_t *pitem = lay_get_item(ctx, item);
+    const uint32_t num_tracks = lay_grid_columns(ctx, item);
+    if (num_tracks == 0) {
+        lay_arrange_overlay(ctx, item, 0);
+        return;
+    }
+    // lay_calc_size doesn't call the size kernel for an explicit width
+    if (pitem->size[0] != 0)
+        lay_measure_grid_columns(ctx, item);
 
-    const uint32_t flags = pitem->flags;
-    switch (flags & LAY_ITEM_BOX_MODEL_MASK) {
-    case LAY_COLUMN | LAY_WRAP:
-        if (dim != 0) {
-            lay_arrange_stacked(ctx, item, 1, true);
-            lay_scalar offset = lay_arrange_wrapped_overlay_squeezed(ctx, item, 0);
-            ctx->rects[item][2 + 0] = offset - ctx->rects[item][0];
-        }
-        break;
-    case LAY_ROW | LAY_WRAP:
-        if (dim == 0)
-            lay_arrange_stacked(ctx, item, 0, true);
+    const lay_item_ext *pext = &ctx->ext[item];
+    const lay_track *tracks = ctx->tracks + pext->first_track;
+    lay_vec2 *spans = ctx->track_spans + pext->first_track;
+    const lay_vec4 rect = ctx->rects[item];
+
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 0);
+
+    // Fill columns share what the other columns and the gaps leave
+    lay_scalar used = 0;
+    uint32_t num_fill = 0;
+    for (uint32_t i = 0; i < num_tracks; ++i) {
+        if (i > 0)
+            used += gap;
+        if (tracks[i].kind == LAY_TRACK_FILL)
+            ++num_fill;
         else
-            // discard return value
-            lay_arrange_wrapped_overlay_squeezed(ctx, item, 1);
-        break;
-    case LAY_COLUMN:
-    case LAY_ROW:
-        if ((flags & 1) == (uint32_t)dim) {
-            lay_arrange_stacked(ctx, item, dim, false);
-        } else {
-            const lay_vec4 rect = ctx->rects[item];
-            lay_arrange_overlay_squeezed_range(
-                ctx, dim, pitem->first_child, LAY_INVALID_ID,
-                rect[dim], rect[2 + dim]);
+            used += spans[i][1];
+    }
+    const lay_scalar extra_space = lay_scalar_max(0, rect[2] - used);
+
+    lay_scalar x = rect[0];
+    uint32_t fill_index = 0;
+    for (uint32_t i = 0; i < num_tracks; ++i) {
+        lay_scalar width = spans[i][1];
+        if (tracks[i].kind == LAY_TRACK_FILL) {
+#ifdef LAY_FLOAT
+            width = extra_space / (float)num_fill;
+#else
+            // Edges at floor(k * extra_space / num_fill), like the fillers in
+            // lay_arrange_stacked
+            const int32_t n = (int32_t)num_fill;
+            const int32_t k = (int32_t)fill_index;
+            width = (lay_scalar)(extra_space * (k + 1) / n - extra_space * k / n);
+#endif
+            ++fill_index;
         }
-        break;
-    default:
-        lay_arrange_overlay(ctx, item, dim);
-        break;
+        spans[i][0] = x;
+        spans[i][1] = width;
+        x += width + gap;
+    }
+
+    uint32_t column = 0;
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        lay_item_t *pchild = lay_get_item(ctx, child);
+        lay_arrange_overlay_child(ctx, child, pchild, 0, spans[column][0], spans[column][1]);
+        if (++column == num_tracks)
+            column = 0;
+        child = pchild->next_sibling;
     }
+}
+
+// Rows are stacked from the top of the grid, and recorded in the line table.
+static void lay_arrange_grid_1(lay_context *ctx, lay_id item)
+{
+    lay_item_t *pitem = lay_get_item(ctx, item);
+    uint32_t num_columns = lay_grid_columns(ctx, item);
+    if (num_columns == 0)
+        num_columns = 1;
+    const lay_scalar gap = lay_container_gap(ctx, item, pitem->flags, 1);
+    lay_scalar y = ctx->rects[item][1];
+    lay_id row_start = pitem->first_child;
+    while (row_start != LAY_INVALID_ID) {
+        // first pass: height of the row, and where the next one starts
+        lay_scalar row_size = 0;
+        lay_id child = row_start;
+        for (uint32_t column = 0; column < num_columns && child != LAY_INVALID_ID; ++column) {
+            lay_item_t *pchild = lay_get_item(ctx, child);
+            const lay_vec4 rect = ctx->rects[child];
+            row_size = lay_scalar_max(row_size, rect[1] + rect[3] + pchild->margins[3]);
+            child = pchild->next_sibling;
+        }
+        const lay_id row_end = child;
+        // second pass: place the cells
+        child = row_start;
+        while (child != row_end) {
+            lay_item_t *pchild = lay_get_item(ctx, child);
+            lay_arrange_overlay_child(ctx, child, pchild, 1, y, row_size);
+            child = pchild->next_sibling;
+        }
+        ctx->lines[row_start] = row_end;
+        y += row_size + gap;
+        row_start = row_end;
+    }
+}
+
+// Indexed by [dim][flags & LAY_ITEM_BOX_MODEL_MASK].
+static const lay_arrange_kernel lay_arrange_kernels[2][8] = {
+    {
+        lay_arrange_overlay_0, // LAY_LAYOUT
+        lay_arrange_grid_0, // LAY_GRID
+        lay_arrange_stacked_0, // LAY_ROW
+        lay_arrange_squeezed_0, // LAY_COLUMN
+        lay_arrange_overlay_0,
+        lay_arrange_overlay_0,
+        lay_arrange_row_wrap_0, // LAY_ROW | LAY_WRAP
+        lay_arrange_column_wrap_0, // LAY_COLUMN | LAY_WRAP
+    },
+    {
+        lay_arrange_overlay_1, // LAY_LAYOUT
+        lay_arrange_grid_1, // LAY_GRID
+        lay_arrange_squeezed_1, // LAY_ROW
+        lay_arrange_stacked_1, // LAY_COLUMN
+        lay_arrange_overlay_1,
+        lay_arrange_overlay_1,
+        lay_arrange_row_wrap_1, // LAY_ROW | LAY_WRAP
+        lay_arrange_column_wrap_1, // LAY_COLUMN | LAY_WRAP
+    },
+};
+
+static void lay_arrange(lay_context *ctx, lay_id item, int dim)
+{
+    lay_item_t *pitem = lay_get_item(ctx, item);
+    LAY_STATS_ADD(ctx, items_visited[dim * 2 + 1], 1);
+#ifdef LAY_TRACE
+    const bool traced = lay_traced(ctx, item);
+    const uint64_t trace_start = traced ? LAY_TRACE_NOW() : 0;
+#endif
+
+    lay_arrange_kernels[dim][pitem->flags & LAY_ITEM_BOX_MODEL_MASK](ctx, item);
+
     lay_id child = pitem->first_child;
     while (child != LAY_INVALID_ID) {
         // NOTE: this is recursive and will run out of stack space if items are
@@ -1136,6 +2852,474 @@ static void lay_arrange(lay_context *ctx, lay_id item, int dim)
         lay_item_t *pchild = lay_get_item(ctx, child);
         child = pchild->next_sibling;
     }
+#ifdef LAY_TRACE
+    if (traced)
+        lay_trace_event_end(ctx, item, (uint32_t)dim * 2 + 1, trace_start);
+#endif
+}
+
+#ifdef LAY_STATS
+void lay_get_stats(lay_context *ctx, lay_stats *stats)
+{
+    LAY_ASSERT(ctx != NULL && stats != NULL);
+    *stats = ctx->stats;
+}
+
+void lay_reset_stats(lay_context *ctx)
+{
+    LAY_ASSERT(ctx != NULL);
+    LAY_MEMSET(&ctx->stats, 0, sizeof(lay_stats));
+}
+#endif // LAY_STATS
+
+#ifdef LAY_PUBLISH
+uint64_t lay_publish_rects(lay_context *ctx)
+{
+    LAY_ASSERT(ctx != NULL);
+    // Any buffer other than the newest snapshot's will do, as long as nobody is
+    // reading it. A reader that announces itself on the chosen buffer after
+    // this check will find that it isn't the newest snapshot, and back off
+    // without reading it.
+    const uint32_t published = LAY_ATOMIC_LOAD(&ctx->published);
+    lay_snapshot *snapshot = NULL;
+    for (uint32_t i = 0; i < LAY_PUBLISH_BUFFERS; ++i) {
+        if (i + 1 != published && LAY_ATOMIC_LOAD(&ctx->snapshots[i].readers) == 0) {
+            snapshot = &ctx->snapshots[i];
+            break;
+        }
+    }
+    if (snapshot == NULL)
+        return 0;
+    if (snapshot->capacity < ctx->count) {
+        // Sized like the items buffer, so that a growing tree doesn't
+        // reallocate the snapshots on every frame
+        LAY_STATS_ADD(ctx, reallocs, 1);
+        LAY_STATS_ADD(ctx, bytes_allocated, ctx->capacity * sizeof(lay_vec4));
+        snapshot->rects = (lay_vec4*)LAY_REALLOC(snapshot->rects, ctx->capacity * sizeof(lay_vec4));
+        snapshot->capacity = ctx->capacity;
+    }
+    const lay_id count = ctx->count;
+    for (lay_id i = 0; i < count; ++i)
+        snapshot->rects[i] = ctx->rects[i];
+    snapshot->count = count;
+    snapshot->epoch = ++ctx->publish_epoch;
+    LAY_ATOMIC_STORE(&ctx->published, (uint32_t)(snapshot - ctx->snapshots) + 1);
+    return snapshot->epoch;
+}
+
+const lay_snapshot *lay_acquire_rects(lay_context *ctx)
+{
+    LAY_ASSERT(ctx != NULL);
+    for (;;) {
+        const uint32_t published = LAY_ATOMIC_LOAD(&ctx->published);
+        if (published == 0)
+            return NULL;
+        lay_snapshot *snapshot = &ctx->snapshots[published - 1];
+        LAY_ATOMIC_INCREMENT(&snapshot->readers);
+        // If it's still the newest, the writer can't have picked it since we
+        // announced ourselves, and it won't pick it until we're gone.
+        if (LAY_ATOMIC_LOAD(&ctx->published) == published)
+            return snapshot;
+        LAY_ATOMIC_DECREMENT(&snapshot->readers);
+    }
+}
+
+void lay_release_rects(lay_context *ctx, const lay_snapshot *snapshot)
+{
+    LAY_ASSERT(ctx != NULL && snapshot != NULL);
+    LAY_ASSERT(snapshot >= ctx->snapshots && snapshot < ctx->snapshots + LAY_PUBLISH_BUFFERS);
+    (void)ctx;
+    LAY_ATOMIC_DECREMENT(&((lay_snapshot*)snapshot)->readers);
+}
+#endif // LAY_PUBLISH
+
+#ifdef LAY_TRACE
+void lay_trace_start(lay_context *ctx, uint32_t capacity, lay_id min_items)
+{
+    LAY_ASSERT(capacity > 0);
+    if (capacity != ctx->trace_capacity) {
+        ctx->trace_events = (lay_trace_event*)LAY_REALLOC(
+            ctx->trace_events, capacity * sizeof(lay_trace_event));
+        ctx->trace_capacity = capacity;
+    }
+    if (ctx->trace_sizes == NULL) {
+        ctx->trace_sizes = (lay_id*)LAY_REALLOC(NULL, (ctx->capacity ? ctx->capacity : 1) * sizeof(lay_id));
+        LAY_MEMSET(ctx->trace_sizes, 0, ctx->capacity * sizeof(lay_id));
+    }
+    ctx->trace_written = 0;
+    ctx->trace_min_items = min_items > 0 ? min_items : 1;
+    ctx->tracing = 1;
+}
+
+void lay_trace_stop(lay_context *ctx)
+{
+    ctx->tracing = 0;
+}
+
+void lay_set_trace_tag(lay_context *ctx, lay_id item, const char *tag)
+{
+    LAY_ASSERT(item < ctx->count);
+    if (ctx->trace_tags == NULL) {
+        ctx->trace_tags = (const char**)LAY_REALLOC(NULL, ctx->capacity * sizeof(const char*));
+        LAY_MEMSET((void*)ctx->trace_tags, 0, ctx->capacity * sizeof(const char*));
+    }
+    ctx->trace_tags[item] = tag;
+}
+
+// JSON output, without stdio. Numbers are written backwards into the end of
+// a small buffer.
+static char *lay_trace_format_uint(char *end, uint64_t value)
+{
+    do {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+static void lay_trace_write_uint(lay_trace_write_fn write, void *user, uint64_t value)
+{
+    char buf[24];
+    char *start = lay_trace_format_uint(buf + sizeof(buf), value);
+    write(user, start, (size_t)(buf + sizeof(buf) - start));
+}
+
+// Chrome trace timestamps are in microseconds
+static void lay_trace_write_us(lay_trace_write_fn write, void *user, uint64_t ns)
+{
+    char buf[32];
+    char *end = buf + sizeof(buf);
+    char *start = lay_trace_format_uint(end, 1000 + ns % 1000);
+    *start = '.';
+    start = lay_trace_format_uint(start, ns / 1000);
+    write(user, start, (size_t)(end - start));
+}
+
+static void lay_trace_write_string(lay_trace_write_fn write, void *user, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    write(user, "\"", 1);
+    const char *run = str;
+    for (; *str != '\0'; ++str) {
+        const unsigned char c = (unsigned char)*str;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        write(user, run, (size_t)(str - run));
+        char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+        if (c == '"' || c == '\\') {
+            escape[1] = (char)c;
+            write(user, escape, 2);
+        } else {
+            write(user, escape, 6);
+        }
+        run = str + 1;
+    }
+    write(user, run, (size_t)(str - run));
+    write(user, "\"", 1);
+}
+
+#define LAY_TRACE_WRITE(text) write(user, text, sizeof(text) - 1)
+
+uint32_t lay_trace_write_json(lay_context *ctx, lay_trace_write_fn write, void *user)
+{
+    static const char *const phase_names[4] = {
+        "calc_size x", "arrange x", "calc_size y", "arrange y",
+    };
+    const uint64_t written = ctx->trace_written;
+    const uint32_t count = written < ctx->trace_capacity ? (uint32_t)written : ctx->trace_capacity;
+    LAY_TRACE_WRITE("{\"traceEvents\":[");
+    // Oldest first
+    for (uint32_t i = 0; i < count; ++i) {
+        const lay_trace_event *event = &ctx->trace_events[(written - count + i) % ctx->trace_capacity];
+        if (i > 0)
+            LAY_TRACE_WRITE(",");
+        LAY_TRACE_WRITE("\n{\"name\":");
+        lay_trace_write_string(write, user, phase_names[event->phase & 3]);
+        LAY_TRACE_WRITE(",\"cat\":\"layout\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":");
+        lay_trace_write_us(write, user, event->start);
+        LAY_TRACE_WRITE(",\"dur\":");
+        lay_trace_write_us(write, user, event->duration);
+        LAY_TRACE_WRITE(",\"args\":{\"item\":");
+        lay_trace_write_uint(write, user, event->item);
+        if (event->tag != NULL) {
+            LAY_TRACE_WRITE(",\"tag\":");
+            lay_trace_write_string(write, user, event->tag);
+        }
+        LAY_TRACE_WRITE("}}");
+    }
+    LAY_TRACE_WRITE("\n],\"otherData\":{\"dropped_events\":\"");
+    lay_trace_write_uint(write, user, written - count);
+    LAY_TRACE_WRITE("\"}}\n");
+    return count;
+}
+
+#undef LAY_TRACE_WRITE
+#endif // LAY_TRACE
+
+#ifdef LAY_RECORD
+void lay_record_start(lay_context *ctx)
+{
+    static const uint8_t header[LAY_RECORD_HEADER_SIZE] = {
+        'L', 'A', 'Y', 'T', LAY_RECORD_VERSION,
+#ifdef LAY_FLOAT
+        1,
+#else
+        0,
+#endif
+    };
+    ctx->record_size = 0;
+    uint8_t *p = lay_record_reserve(ctx, LAY_RECORD_HEADER_SIZE);
+    for (int i = 0; i < LAY_RECORD_HEADER_SIZE; ++i)
+        p[i] = header[i];
+    ctx->record_size = LAY_RECORD_HEADER_SIZE;
+    ctx->recording = 1;
+}
+
+void lay_record_stop(lay_context *ctx)
+{
+    ctx->recording = 0;
+}
+
+const uint8_t *lay_record_data(lay_context *ctx, size_t *size)
+{
+    *size = ctx->record_size;
+    return ctx->record;
+}
+#endif // LAY_RECORD
+
+#if defined(LAY_RECORD) || defined(LAY_REPLAY)
+// Replay
+//
+// The decoder checks everything it reads, so that a truncated or corrupted
+// trace makes lay_replay_next fail instead of writing out of bounds.
+typedef struct lay_replay_reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool floats;
+    bool ok;
+} lay_replay_reader;
+
+static uint32_t lay_replay_varint(lay_replay_reader *r)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->p == r->end) {
+            r->ok = false;
+            return 0;
+        }
+        const uint8_t byte = *r->p++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    r->ok = false;
+    return 0;
+}
+
+// Traces from float builds can be replayed by integer builds and the other
+// way around. Values are converted like a C cast would.
+static lay_scalar lay_replay_scalar(lay_replay_reader *r)
+{
+    if (r->floats) {
+        if (r->end - r->p < 4) {
+            r->ok = false;
+            return 0;
+        }
+        union { float f; uint32_t u; } cast;
+        cast.u = (uint32_t)r->p[0] | (uint32_t)r->p[1] << 8 |
+            (uint32_t)r->p[2] << 16 | (uint32_t)r->p[3] << 24;
+        r->p += 4;
+        return (lay_scalar)cast.f;
+    }
+    const uint32_t zigzag = lay_replay_varint(r);
+    return (lay_scalar)(int32_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+}
+
+static lay_id lay_replay_id(lay_replay_reader *r, const lay_context *ctx)
+{
+    const uint32_t id = lay_replay_varint(r);
+    if (id >= ctx->count) {
+        r->ok = false;
+        return 0;
+    }
+    return (lay_id)id;
+}
+
+// Whether item is root or one of its descendants
+static bool lay_replay_in_subtree(const lay_context *ctx, lay_id root, lay_id item)
+{
+    if (root == item)
+        return true;
+    for (lay_id child = ctx->items[root].first_child; child != LAY_INVALID_ID;
+            child = ctx->items[child].next_sibling) {
+        if (lay_replay_in_subtree(ctx, child, item))
+            return true;
+    }
+    return false;
+}
+
+// An item that can be added to a parent's list of children, or next to a
+// sibling: other must not be in its subtree, or the tree would get a cycle
+static lay_id lay_replay_child(lay_replay_reader *r, const lay_context *ctx, lay_id other)
+{
+    const lay_id child = lay_replay_id(r, ctx);
+    if (r->ok && (child == 0 || (ctx->items[child].flags & LAY_ITEM_INSERTED) ||
+            lay_replay_in_subtree(ctx, child, other)))
+        r->ok = false;
+    return child;
+}
+
+int lay_replay_begin(const uint8_t *data, size_t size, size_t *offset)
+{
+    if (size < LAY_RECORD_HEADER_SIZE || data[0] != 'L' || data[1] != 'A' ||
+            data[2] != 'Y' || data[3] != 'T' || data[4] != LAY_RECORD_VERSION || data[5] > 1)
+        return -1;
+    *offset = LAY_RECORD_HEADER_SIZE;
+    return 0;
+}
+
+int lay_replay_next(lay_context *ctx, const uint8_t *data, size_t size, size_t *offset)
+{
+    LAY_ASSERT(*offset >= LAY_RECORD_HEADER_SIZE && *offset <= size);
+    if (*offset == size)
+        return LAY_RECORD_END;
+    lay_replay_reader r;
+    r.p = data + *offset + 1;
+    r.end = data + size;
+    r.floats = data[5] == 1;
+    r.ok = true;
+    const int op = data[*offset];
+    // Everything is read and checked before the call is made
+    switch (op) {
+    case LAY_RECORD_RESERVE_ITEMS_CAPACITY: {
+        const uint32_t count = lay_replay_varint(&r);
+        if (!r.ok || count >= LAY_INVALID_ID)
+            return -1;
+        lay_reserve_items_capacity(ctx, (lay_id)count);
+        break;
+    }
+    case LAY_RECORD_RESET_CONTEXT:
+        lay_reset_context(ctx);
+        break;
+    case LAY_RECORD_RUN_CONTEXT:
+        lay_run_context(ctx);
+        break;
+    case LAY_RECORD_RUN_ITEM:
+    case LAY_RECORD_CLEAR_ITEM_BREAK: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        if (!r.ok)
+            return -1;
+        if (op == LAY_RECORD_RUN_ITEM)
+            lay_run_item(ctx, item);
+        else
+            lay_clear_item_break(ctx, item);
+        break;
+    }
+    case LAY_RECORD_ITEM:
+        if (ctx->count >= LAY_INVALID_ID)
+            return -1;
+        lay_item(ctx);
+        break;
+    case LAY_RECORD_INSERT:
+    case LAY_RECORD_APPEND:
+    case LAY_RECORD_PUSH: {
+        const lay_id a = lay_replay_id(&r, ctx);
+        const lay_id b = lay_replay_child(&r, ctx, a);
+        if (!r.ok)
+            return -1;
+        if (op == LAY_RECORD_INSERT)
+            lay_insert(ctx, a, b);
+        else if (op == LAY_RECORD_APPEND)
+            lay_append(ctx, a, b);
+        else
+            lay_push(ctx, a, b);
+        break;
+    }
+    case LAY_RECORD_SET_CONTAIN:
+    case LAY_RECORD_SET_BEHAVE: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        const uint32_t flags = lay_replay_varint(&r);
+        const uint32_t mask = op == LAY_RECORD_SET_CONTAIN ? LAY_ITEM_BOX_MASK : LAY_ITEM_LAYOUT_MASK;
+        if (!r.ok || (flags & mask) != flags)
+            return -1;
+        if (op == LAY_RECORD_SET_CONTAIN)
+            lay_set_contain(ctx, item, flags);
+        else
+            lay_set_behave(ctx, item, flags);
+        break;
+    }
+    case LAY_RECORD_SET_SIZE:
+    case LAY_RECORD_SET_MIN_SIZE:
+    case LAY_RECORD_SET_MAX_SIZE:
+    case LAY_RECORD_SET_GAP: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        const lay_scalar a = lay_replay_scalar(&r);
+        const lay_scalar b = lay_replay_scalar(&r);
+        if (!r.ok)
+            return -1;
+        if (op == LAY_RECORD_SET_SIZE) {
+            lay_set_size_xy(ctx, item, a, b);
+        } else if (op == LAY_RECORD_SET_GAP) {
+            lay_set_gap(ctx, item, a, b);
+        } else {
+            if (a < 0 || b < 0)
+                return -1;
+            if (op == LAY_RECORD_SET_MIN_SIZE)
+                lay_set_min_size_xy(ctx, item, a, b);
+            else
+                lay_set_max_size_xy(ctx, item, a, b);
+        }
+        break;
+    }
+    case LAY_RECORD_SET_MARGINS: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        const lay_scalar l = lay_replay_scalar(&r);
+        const lay_scalar t = lay_replay_scalar(&r);
+        const lay_scalar rt = lay_replay_scalar(&r);
+        const lay_scalar b = lay_replay_scalar(&r);
+        if (!r.ok)
+            return -1;
+        lay_set_margins_ltrb(ctx, item, l, t, rt, b);
+        break;
+    }
+    case LAY_RECORD_SET_GRID_COLUMNS: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        const uint32_t count = lay_replay_varint(&r);
+        // Each column takes at least two bytes
+        if (!r.ok || count > (size_t)(r.end - r.p) / 2)
+            return -1;
+        lay_track *columns = NULL;
+        if (count > 0)
+            columns = (lay_track*)LAY_REALLOC(NULL, count * sizeof(lay_track));
+        for (uint32_t i = 0; i < count; ++i) {
+            columns[i].kind = lay_replay_varint(&r);
+            columns[i].size = lay_replay_scalar(&r);
+            if (columns[i].kind > LAY_TRACK_FILL)
+                r.ok = false;
+        }
+        if (r.ok)
+            lay_set_grid_columns(ctx, item, columns, count);
+        if (columns != NULL)
+            LAY_FREE(columns);
+        if (!r.ok)
+            return -1;
+        break;
+    }
+    case LAY_RECORD_SET_WEIGHTS: {
+        const lay_id item = lay_replay_id(&r, ctx);
+        const uint32_t grow = lay_replay_varint(&r);
+        const uint32_t shrink = lay_replay_varint(&r);
+        if (!r.ok || grow > UINT16_MAX || shrink > UINT16_MAX)
+            return -1;
+        lay_set_weights(ctx, item, (uint16_t)grow, (uint16_t)shrink);
+        break;
+    }
+    default:
+        return -1;
+    }
+    *offset = (size_t)(r.p - data);
+    return op;
 }
+#endif // LAY_RECORD || LAY_REPLAY
 
 #endif // LAY_IMPLEMENTATION
@@ -0,0 +1,323 @@
+#ifndef LAY_ASYNC_INCLUDE_HEADER
+#define LAY_ASYNC_INCLUDE_HEADER
+
+// 异步布局：在库管理的工作线程上计算布局。
+//
+// 大型文档的布局可能需要几十毫秒。lay_async_submit() 把一个上下文交给工作线程计算，
+// 并立即返回一个作业，调用线程可以继续处理输入，之后用 lay_async_poll() 检查、
+// 用 lay_async_wait() 等待，或者通过完成回调得知结果已经就绪。
+//
+// 与 layout.h 一样，在项目中的一个 C 或 C++ 文件中定义 LAY_ASYNC_IMPLEMENTATION，
+// 然后包含此文件。需要先包含 layout.h。实现在 Windows 上使用 Win32 线程，在其他平台上使用 pthreads。
+
+#ifndef LAY_ASYNC_EXPORT
+#define LAY_ASYNC_EXPORT extern
+#endif
+
+typedef struct lay_async_worker lay_async_worker;
+typedef struct lay_async_job lay_async_job;
+
+// 完成回调，在工作线程上、作业被标记为完成之前调用。
+// 回调中可以读取作业的结果（lay_async_context()），但不能等待或释放这个作业。
+typedef void (*lay_async_done_fn)(lay_async_job *job, void *user);
+
+// 传递给 lay_async_submit() 的标志
+enum {
+    // 提交时复制上下文（参见 lay_copy_context()），工作线程计算的是副本，
+    // 调用线程可以立即继续修改原来的上下文。
+    // 不使用此标志时，在作业完成之前不能以任何方式访问提交的上下文。
+    LAY_ASYNC_COPY = 0x1
+};
+
+// 创建一个工作线程。同一个工作线程上的作业按提交的顺序逐个计算。
+// 如果无法创建线程，返回 NULL。
+LAY_ASYNC_EXPORT lay_async_worker *lay_async_create(void);
+
+// 等待已经提交的作业全部完成，然后结束工作线程。所有作业必须在此之前用 lay_async_free() 释放。
+LAY_ASYNC_EXPORT void lay_async_destroy(lay_async_worker *worker);
+
+// 提交上下文，在工作线程上对它调用 lay_run_context()。`done` 可以为 NULL。
+// 返回的作业必须用 lay_async_free() 释放。内存不足时返回 NULL。
+LAY_ASYNC_EXPORT lay_async_job *lay_async_submit(
+        lay_async_worker *worker, lay_context *ctx, uint32_t flags,
+        lay_async_done_fn done, void *user);
+
+// 作业已经完成时返回非零值，不会阻塞。
+LAY_ASYNC_EXPORT int lay_async_poll(lay_async_job *job);
+
+// 阻塞，直到作业完成。
+LAY_ASYNC_EXPORT void lay_async_wait(lay_async_job *job);
+
+// 返回作业计算的上下文：使用 LAY_ASYNC_COPY 时是副本，否则是提交的上下文。
+// 作业完成后，可以用 lay_get_rect() 等函数从中读取结果，直到作业被释放。
+LAY_ASYNC_EXPORT lay_context *lay_async_context(lay_async_job *job);
+
+// 释放作业。如果作业还没有完成，会先等待它完成。
+LAY_ASYNC_EXPORT void lay_async_free(lay_async_job *job);
+
+#undef LAY_ASYNC_EXPORT
+
+#endif // LAY_ASYNC_INCLUDE_HEADER
+
+#ifdef LAY_ASYNC_IMPLEMENTATION
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef CRITICAL_SECTION lay_async_mutex;
+typedef CONDITION_VARIABLE lay_async_cond;
+typedef HANDLE lay_async_thread;
+#define LAY_ASYNC_MUTEX_INIT(m) (InitializeCriticalSection(m), 1)
+#define LAY_ASYNC_MUTEX_DESTROY(m) DeleteCriticalSection(m)
+#define LAY_ASYNC_LOCK(m) EnterCriticalSection(m)
+#define LAY_ASYNC_UNLOCK(m) LeaveCriticalSection(m)
+#define LAY_ASYNC_COND_INIT(c) (InitializeConditionVariable(c), 1)
+#define LAY_ASYNC_COND_DESTROY(c) ((void)(c))
+#define LAY_ASYNC_WAIT(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define LAY_ASYNC_SIGNAL(c) WakeConditionVariable(c)
+#define LAY_ASYNC_BROADCAST(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t lay_async_mutex;
+typedef pthread_cond_t lay_async_cond;
+typedef pthread_t lay_async_thread;
+#define LAY_ASYNC_MUTEX_INIT(m) (pthread_mutex_init(m, NULL) == 0)
+#define LAY_ASYNC_MUTEX_DESTROY(m) pthread_mutex_destroy(m)
+#define LAY_ASYNC_LOCK(m) pthread_mutex_lock(m)
+#define LAY_ASYNC_UNLOCK(m) pthread_mutex_unlock(m)
+#define LAY_ASYNC_COND_INIT(c) (pthread_cond_init(c, NULL) == 0)
+#define LAY_ASYNC_COND_DESTROY(c) pthread_cond_destroy(c)
+#define LAY_ASYNC_WAIT(c, m) pthread_cond_wait(c, m)
+#define LAY_ASYNC_SIGNAL(c) pthread_cond_signal(c)
+#define LAY_ASYNC_BROADCAST(c) pthread_cond_broadcast(c)
+#endif
+
+// Freed LAY_ASYNC_COPY jobs kept by a worker, so that submitting one every
+// frame reuses the buffers of the copy instead of allocating them again
+#define LAY_ASYNC_MAX_SPARE_JOBS 4
+
+enum {
+    LAY_ASYNC_QUEUED,
+    LAY_ASYNC_RUNNING,
+    LAY_ASYNC_DONE
+};
+
+struct lay_async_job {
+    lay_async_worker *worker;
+    lay_context *ctx;
+    // The copy made by LAY_ASYNC_COPY, which the job owns
+    lay_context copy;
+    lay_async_done_fn done;
+    void *user;
+    // Written by the worker thread with the mutex held
+    uint32_t state;
+    // Next in the queue, or in the spare list
+    lay_async_job *next;
+};
+
+struct lay_async_worker {
+    lay_async_mutex mutex;
+    // Signaled when a job is queued, or the worker should stop
+    lay_async_cond queued;
+    // Broadcast when any job is done
+    lay_async_cond finished;
+    lay_async_thread thread;
+    lay_async_job *head;
+    lay_async_job *tail;
+    lay_async_job *spare;
+    uint32_t num_spare;
+    int stopping;
+};
+
+static void lay_async_run(lay_async_worker *worker)
+{
+    LAY_ASYNC_LOCK(&worker->mutex);
+    for (;;) {
+        while (worker->head == NULL && !worker->stopping)
+            LAY_ASYNC_WAIT(&worker->queued, &worker->mutex);
+        // The queue is drained before stopping
+        lay_async_job *job = worker->head;
+        if (job == NULL)
+            break;
+        worker->head = job->next;
+        if (worker->head == NULL)
+            worker->tail = NULL;
+        job->state = LAY_ASYNC_RUNNING;
+        LAY_ASYNC_UNLOCK(&worker->mutex);
+
+        lay_run_context(job->ctx);
+        if (job->done != NULL)
+            job->done(job, job->user);
+
+        LAY_ASYNC_LOCK(&worker->mutex);
+        job->state = LAY_ASYNC_DONE;
+        LAY_ASYNC_BROADCAST(&worker->finished);
+    }
+    LAY_ASYNC_UNLOCK(&worker->mutex);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI lay_async_thread_main(LPVOID arg)
+{
+    lay_async_run((lay_async_worker*)arg);
+    return 0;
+}
+#else
+static void *lay_async_thread_main(void *arg)
+{
+    lay_async_run((lay_async_worker*)arg);
+    return NULL;
+}
+#endif
+
+lay_async_worker *lay_async_create(void)
+{
+    lay_async_worker *worker = (lay_async_worker*)calloc(1, sizeof(lay_async_worker));
+    if (worker == NULL)
+        return NULL;
+    if (!LAY_ASYNC_MUTEX_INIT(&worker->mutex)) {
+        free(worker);
+        return NULL;
+    }
+    if (!LAY_ASYNC_COND_INIT(&worker->queued)) {
+        LAY_ASYNC_MUTEX_DESTROY(&worker->mutex);
+        free(worker);
+        return NULL;
+    }
+    if (!LAY_ASYNC_COND_INIT(&worker->finished)) {
+        LAY_ASYNC_COND_DESTROY(&worker->queued);
+        LAY_ASYNC_MUTEX_DESTROY(&worker->mutex);
+        free(worker);
+        return NULL;
+    }
+#if defined(_WIN32)
+    worker->thread = CreateThread(NULL, 0, lay_async_thread_main, worker, 0, NULL);
+    const int started = worker->thread != NULL;
+#else
+    const int started = pthread_create(&worker->thread, NULL, lay_async_thread_main, worker) == 0;
+#endif
+    if (!started) {
+        LAY_ASYNC_COND_DESTROY(&worker->finished);
+        LAY_ASYNC_COND_DESTROY(&worker->queued);
+        LAY_ASYNC_MUTEX_DESTROY(&worker->mutex);
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+void lay_async_destroy(lay_async_worker *worker)
+{
+    LAY_ASYNC_LOCK(&worker->mutex);
+    worker->stopping = 1;
+    LAY_ASYNC_SIGNAL(&worker->queued);
+    LAY_ASYNC_UNLOCK(&worker->mutex);
+#if defined(_WIN32)
+    WaitForSingleObject(worker->thread, INFINITE);
+    CloseHandle(worker->thread);
+#else
+    pthread_join(worker->thread, NULL);
+#endif
+    while (worker->spare != NULL) {
+        lay_async_job *job = worker->spare;
+        worker->spare = job->next;
+        lay_destroy_context(&job->copy);
+        free(job);
+    }
+    LAY_ASYNC_COND_DESTROY(&worker->finished);
+    LAY_ASYNC_COND_DESTROY(&worker->queued);
+    LAY_ASYNC_MUTEX_DESTROY(&worker->mutex);
+    free(worker);
+}
+
+lay_async_job *lay_async_submit(
+        lay_async_worker *worker, lay_context *ctx, uint32_t flags,
+        lay_async_done_fn done, void *user)
+{
+    LAY_ASSERT(worker != NULL && ctx != NULL);
+    lay_async_job *job = NULL;
+    if (flags & LAY_ASYNC_COPY) {
+        LAY_ASYNC_LOCK(&worker->mutex);
+        if (worker->spare != NULL) {
+            job = worker->spare;
+            worker->spare = job->next;
+            --worker->num_spare;
+        }
+        LAY_ASYNC_UNLOCK(&worker->mutex);
+    }
+    if (job == NULL) {
+        job = (lay_async_job*)malloc(sizeof(lay_async_job));
+        if (job == NULL)
+            return NULL;
+        lay_init_context(&job->copy);
+    }
+    job->worker = worker;
+    // The copy is made here, on the calling thread, so that the caller is free
+    // to change its context as soon as this returns
+    if (flags & LAY_ASYNC_COPY) {
+        lay_copy_context(&job->copy, ctx);
+        job->ctx = &job->copy;
+    } else {
+        job->ctx = ctx;
+    }
+    job->done = done;
+    job->user = user;
+    job->state = LAY_ASYNC_QUEUED;
+    job->next = NULL;
+
+    LAY_ASYNC_LOCK(&worker->mutex);
+    if (worker->tail != NULL)
+        worker->tail->next = job;
+    else
+        worker->head = job;
+    worker->tail = job;
+    LAY_ASYNC_SIGNAL(&worker->queued);
+    LAY_ASYNC_UNLOCK(&worker->mutex);
+    return job;
+}
+
+int lay_async_poll(lay_async_job *job)
+{
+    lay_async_worker *worker = job->worker;
+    LAY_ASYNC_LOCK(&worker->mutex);
+    const int done = job->state == LAY_ASYNC_DONE;
+    LAY_ASYNC_UNLOCK(&worker->mutex);
+    return done;
+}
+
+void lay_async_wait(lay_async_job *job)
+{
+    lay_async_worker *worker = job->worker;
+    LAY_ASYNC_LOCK(&worker->mutex);
+    while (job->state != LAY_ASYNC_DONE)
+        LAY_ASYNC_WAIT(&worker->finished, &worker->mutex);
+    LAY_ASYNC_UNLOCK(&worker->mutex);
+}
+
+lay_context *lay_async_context(lay_async_job *job)
+{
+    return job->ctx;
+}
+
+void lay_async_free(lay_async_job *job)
+{
+    lay_async_worker *worker = job->worker;
+    lay_async_wait(job);
+    if (job->ctx == &job->copy) {
+        LAY_ASYNC_LOCK(&worker->mutex);
+        if (worker->num_spare < LAY_ASYNC_MAX_SPARE_JOBS) {
+            job->next = worker->spare;
+            worker->spare = job;
+            ++worker->num_spare;
+            job = NULL;
+        }
+        LAY_ASYNC_UNLOCK(&worker->mutex);
+    }
+    if (job != NULL) {
+        lay_destroy_context(&job->copy);
+        free(job);
+    }
+}
+
+#endif // LAY_ASYNC_IMPLEMENTATION
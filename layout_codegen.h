@@ -0,0 +1,455 @@
+#ifndef LAY_CODEGEN_INCLUDE_HEADER
+#define LAY_CODEGEN_INCLUDE_HEADER
+
+// 布局编译器：为结构固定的布局树生成直线式 C 代码。
+//
+// 许多界面的结构是固定的，运行时只有根项的尺寸和少数叶子项的尺寸会变化。
+// 对于这样的树，lay_codegen_emit() 会读取一个已经构建好的 lay_context，
+// 把选定的尺寸标记为运行时参数，并生成一个专用的 C 函数。
+// 这个函数直接计算所有项的矩形，没有树遍历、没有标志解码，也没有针对盒模型的分支。
+//
+// 与 layout.h 一样，在项目中的一个 C 或 C++ 文件中定义 LAY_CODEGEN_IMPLEMENTATION，
+// 然后包含此文件。需要先包含 layout.h。
+//
+// 生成的代码本身只依赖 layout.h 中的类型（lay_scalar 和 lay_vec4），
+// 并且必须使用与生成器相同的坐标类型（LAY_FLOAT 或 int16）编译。
+
+#include <stdio.h>
+
+#ifndef LAY_CODEGEN_EXPORT
+#define LAY_CODEGEN_EXPORT extern
+#endif
+
+// 运行时参数：某个项在某个维度上的尺寸（0: 宽度，1: 高度）。
+typedef struct lay_codegen_param {
+    lay_id item;
+    int dim;
+} lay_codegen_param;
+
+// 为以 `root` 为根的子树生成一个名为 `function_name` 的函数，写入 `out`。
+// 生成的函数的签名为：
+//
+//   void function_name(const lay_scalar *params, lay_vec4 *rects);
+//
+// params[i] 是 params 数组中第 i 个参数的值，它会代替该项通过 lay_set_size 设置的尺寸。
+// 参数值在运行时必须非零，就像使用 lay_set_size 设置的显式尺寸一样。
+// rects 的布局与 lay_context 的 rects 相同（按项 id 索引），生成的函数只写入从根项可达的项。
+//
+// 如果树中使用了生成器不支持的功能（例如换行容器，其换行位置依赖于运行时尺寸，或者最小/最大尺寸和网格），
+// 则返回非零值，并且不会写入任何内容。成功时返回 0。
+//
+// 可以将多个函数写入同一个文件，辅助定义只会生成一次。
+LAY_CODEGEN_EXPORT int lay_codegen_emit(
+        FILE *out, const lay_context *ctx, lay_id root,
+        const lay_codegen_param *params, uint32_t num_params,
+        const char *function_name);
+
+#undef LAY_CODEGEN_EXPORT
+
+#endif // LAY_CODEGEN_INCLUDE_HEADER
+
+#ifdef LAY_CODEGEN_IMPLEMENTATION
+
+#include <stdlib.h>
+
+// The emitted code mirrors, statement for statement, what lay_calc_size and
+// lay_arrange would do for each item. All of the decisions that depend only on
+// flags (box model, behave flags, whether a size is fixed, how many fillers a
+// row has) are made here, at generation time. The only things left in the
+// output are the arithmetic on rects and a handful of conditional expressions
+// on values that depend on the runtime parameters, like the sign of a row's
+// extra space.
+//
+// Everything is written to the same rects array, in the same order, with the
+// same types and conversions as the real engine, so the results are identical
+// and not merely close.
+
+typedef struct lay_codegen {
+    FILE *out;
+    const lay_context *ctx;
+    // Per item and dim, the index of the runtime parameter that provides the
+    // size, or -1.
+    int32_t *param_index;
+} lay_codegen;
+
+static void lay_codegen_scalar(FILE *out, lay_scalar value)
+{
+#if LAY_FLOAT == 1
+    // 9 significant digits round-trip any float.
+    fprintf(out, "((lay_scalar)%.9g)", (double)value);
+#else
+    fprintf(out, "%d", (int)value);
+#endif
+}
+
+static int lay_codegen_param_of(const lay_codegen *cg, lay_id item, int dim)
+{ return cg->param_index[item * 2 + dim]; }
+
+// Writes the expression for an item's input size along dim.
+static void lay_codegen_size(const lay_codegen *cg, lay_id item, int dim)
+{
+    int param = lay_codegen_param_of(cg, item, dim);
+    if (param >= 0)
+        fprintf(cg->out, "params[%d]", param);
+    else
+        lay_codegen_scalar(cg->out, lay_get_item(cg->ctx, item)->size[dim]);
+}
+
+static bool lay_codegen_has_size(const lay_codegen *cg, lay_id item, int dim)
+{
+    return lay_codegen_param_of(cg, item, dim) >= 0
+        || lay_get_item(cg->ctx, item)->size[dim] != 0;
+}
+
+static bool lay_codegen_supported(const lay_context *ctx, lay_id item)
+{
+    const lay_item_t *pitem = lay_get_item(ctx, item);
+    // Min/max sizes and grids aren't supported yet
+    if (pitem->flags & LAY_ITEM_EXT)
+        return false;
+    if ((pitem->flags & LAY_ITEM_BOX_MODEL_MASK) == LAY_GRID)
+        return false;
+    if (pitem->flags & LAY_WRAP) {
+        uint32_t model = pitem->flags & LAY_ITEM_BOX_MODEL_MASK;
+        if (model == (LAY_ROW | LAY_WRAP) || model == (LAY_COLUMN | LAY_WRAP))
+            return false;
+    }
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        if (!lay_codegen_supported(ctx, child))
+            return false;
+        child = lay_get_item(ctx, child)->next_sibling;
+    }
+    return true;
+}
+
+// Emits "need = max(need, start + size + end margin)" or the stacked sum for
+// each child, leaving the result in `need`.
+static void lay_codegen_children_extent(
+        const lay_codegen *cg, lay_id item, int dim, bool stacked)
+{
+    FILE *out = cg->out;
+    const int wdim = dim + 2;
+    lay_id child = lay_get_item(cg->ctx, item)->first_child;
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(cg->ctx, child);
+        if (stacked)
+            fprintf(out, "        need = (lay_scalar)(need + (rects[%u][%d] + rects[%u][%d] + ",
+                (unsigned)child, dim, (unsigned)child, wdim);
+        else
+            fprintf(out, "        need = lay_cg_max(need, (lay_scalar)(rects[%u][%d] + rects[%u][%d] + ",
+                (unsigned)child, dim, (unsigned)child, wdim);
+        lay_codegen_scalar(out, pchild->margins[wdim]);
+        fputs("));\n", out);
+        child = pchild->next_sibling;
+    }
+}
+
+static void lay_codegen_calc_size(const lay_codegen *cg, lay_id item, int dim)
+{
+    FILE *out = cg->out;
+    const lay_item_t *pitem = lay_get_item(cg->ctx, item);
+
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        lay_codegen_calc_size(cg, child, dim);
+        child = lay_get_item(cg->ctx, child)->next_sibling;
+    }
+
+    fprintf(out, "    rects[%u][%d] = ", (unsigned)item, dim);
+    lay_codegen_scalar(out, pitem->margins[dim]);
+    fputs(";\n", out);
+
+    if (lay_codegen_has_size(cg, item, dim)) {
+        fprintf(out, "    rects[%u][%d] = ", (unsigned)item, 2 + dim);
+        lay_codegen_size(cg, item, dim);
+        fputs(";\n", out);
+        return;
+    }
+
+    if (pitem->first_child == LAY_INVALID_ID) {
+        fprintf(out, "    rects[%u][%d] = 0;\n", (unsigned)item, 2 + dim);
+        return;
+    }
+
+    const uint32_t model = pitem->flags & LAY_ITEM_BOX_MODEL_MASK;
+    const bool stacked =
+        (model == LAY_ROW || model == LAY_COLUMN) && (model & 1) == (uint32_t)dim;
+    fputs("    {\n        lay_scalar need = 0;\n", out);
+    lay_codegen_children_extent(cg, item, dim, stacked);
+    fprintf(out, "        rects[%u][%d] = need;\n    }\n", (unsigned)item, 2 + dim);
+}
+
+// Equivalent of lay_arrange_stacked for non-wrapping rows and columns.
+static void lay_codegen_arrange_stacked(const lay_codegen *cg, lay_id item, int dim)
+{
+    FILE *out = cg->out;
+    const lay_context *ctx = cg->ctx;
+    const int wdim = dim + 2;
+    const lay_item_t *pitem = lay_get_item(ctx, item);
+
+    uint32_t count = 0;
+    uint32_t squeezed_count = 0;
+    uint32_t total = 0;
+    lay_id child = pitem->first_child;
+
+    fputs("    {\n        lay_scalar used = 0;\n", out);
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const uint32_t flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        if ((flags & LAY_HFILL) == LAY_HFILL) {
+            ++count;
+            fprintf(out, "        used = (lay_scalar)(used + (rects[%u][%d] + ",
+                (unsigned)child, dim);
+        } else {
+            if (!lay_codegen_has_size(cg, child, dim))
+                ++squeezed_count;
+            fprintf(out, "        used = (lay_scalar)(used + (rects[%u][%d] + rects[%u][%d] + ",
+                (unsigned)child, dim, (unsigned)child, wdim);
+        }
+        lay_codegen_scalar(out, pchild->margins[wdim]);
+        fputs("));\n", out);
+        ++total;
+        child = pchild->next_sibling;
+    }
+
+    fprintf(out, "        const lay_scalar extra = (lay_scalar)(rects[%u][%d] - used);\n",
+        (unsigned)item, wdim);
+
+    // Same priority as lay_arrange_stacked: fillers take all of the extra
+    // space, otherwise it's distributed according to the justify flags, and
+    // negative extra space is eaten by the squeezable items.
+#ifdef LAY_FLOAT
+    fputs("        float filler = 0.0f, spacer = 0.0f, extra_margin = 0.0f, eater = 0.0f;\n", out);
+    if (count > 0) {
+        fprintf(out, "        if (extra > 0) filler = (float)extra / (float)%u;\n", count);
+    } else {
+        switch (pitem->flags & LAY_JUSTIFY) {
+        case LAY_JUSTIFY:
+            if (total > 1)
+                fprintf(out, "        if (extra > 0) spacer = (float)extra / (float)%u;\n", total - 1);
+            break;
+        case LAY_START:
+            break;
+        case LAY_END:
+            fputs("        if (extra > 0) extra_margin = extra;\n", out);
+            break;
+        default:
+            fputs("        if (extra > 0) extra_margin = extra / 2.0f;\n", out);
+            break;
+        }
+    }
+    if (squeezed_count > 0)
+        fprintf(out, "        if (!(extra > 0)) eater = (float)extra / (float)%u;\n", squeezed_count);
+    fprintf(out, "        float x = (float)rects[%u][%d];\n        float x1;\n", (unsigned)item, dim);
+#else
+    // The integer engine keeps exact positions in units of 1/denom. Here they
+    // are kept as a single scaled numerator, and truncated by dividing, which
+    // gives the same results.
+    fputs("        int32_t denom = 1, filler = 0, spacer = 0, extra_margin = 0, eater = 0;\n", out);
+    if (count > 0) {
+        fprintf(out, "        if (extra > 0) { denom = %u; filler = extra; }\n", count);
+    } else {
+        switch (pitem->flags & LAY_JUSTIFY) {
+        case LAY_JUSTIFY:
+            if (total > 1)
+                fprintf(out, "        if (extra > 0) { denom = %u; spacer = extra; }\n", total - 1);
+            break;
+        case LAY_START:
+            break;
+        case LAY_END:
+            fputs("        if (extra > 0) extra_margin = extra;\n", out);
+            break;
+        default:
+            fputs("        if (extra > 0) { denom = 2; extra_margin = extra; }\n", out);
+            break;
+        }
+    }
+    if (squeezed_count > 0)
+        fprintf(out, "        if (extra < 0) { denom = %u; eater = extra; }\n", squeezed_count);
+    fprintf(out, "        int64_t x = (int64_t)rects[%u][%d] * denom;\n        int64_t x1;\n", (unsigned)item, dim);
+#endif
+
+    bool first = true;
+    child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(ctx, child);
+        const uint32_t flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        const unsigned c = (unsigned)child;
+#ifdef LAY_FLOAT
+        fprintf(out, "        x += (float)rects[%u][%d] + %s;\n",
+            c, dim, first ? "extra_margin" : "spacer");
+        if ((flags & LAY_HFILL) == LAY_HFILL)
+            fputs("        x1 = x + filler;\n", out);
+        else if (lay_codegen_has_size(cg, child, dim))
+            fprintf(out, "        x1 = x + (float)rects[%u][%d];\n", c, wdim);
+        else
+            fprintf(out, "        x1 = x + lay_cg_fmax(0.0f, (float)rects[%u][%d] + eater);\n",
+                c, wdim);
+        fprintf(out,
+            "        rects[%u][%d] = (lay_scalar)x;\n"
+            "        rects[%u][%d] = (lay_scalar)((lay_scalar)x1 - rects[%u][%d]);\n"
+            "        x = x1 + (float)",
+            c, dim, c, wdim, c, dim);
+#else
+        fprintf(out, "        x += (int64_t)rects[%u][%d] * denom + %s;\n",
+            c, dim, first ? "extra_margin" : "spacer");
+        if ((flags & LAY_HFILL) == LAY_HFILL)
+            fputs("        x1 = x + filler;\n", out);
+        else if (lay_codegen_has_size(cg, child, dim))
+            fprintf(out, "        x1 = x + (int64_t)rects[%u][%d] * denom;\n", c, wdim);
+        else
+            fprintf(out, "        x1 = x + lay_cg_max64(0, (int64_t)rects[%u][%d] * denom + eater);\n",
+                c, wdim);
+        fprintf(out,
+            "        rects[%u][%d] = (lay_scalar)(x / denom);\n"
+            "        rects[%u][%d] = (lay_scalar)((lay_scalar)(x1 / denom) - rects[%u][%d]);\n"
+            "        x = x1 + denom * (int64_t)",
+            c, dim, c, wdim, c, dim);
+#endif
+        lay_codegen_scalar(out, pchild->margins[wdim]);
+        fputs(";\n", out);
+        first = false;
+        child = pchild->next_sibling;
+    }
+    fputs("        (void)extra; (void)x1; (void)filler; (void)spacer; (void)extra_margin; (void)eater;\n    }\n", out);
+}
+
+// Equivalent of lay_arrange_overlay (squeezed == false) and
+// lay_arrange_overlay_squeezed_range (squeezed == true) over all children.
+static void lay_codegen_arrange_overlay(
+        const lay_codegen *cg, lay_id item, int dim, bool squeezed)
+{
+    FILE *out = cg->out;
+    const int wdim = dim + 2;
+    const unsigned it = (unsigned)item;
+    lay_id child = lay_get_item(cg->ctx, item)->first_child;
+    while (child != LAY_INVALID_ID) {
+        const lay_item_t *pchild = lay_get_item(cg->ctx, child);
+        const uint32_t b_flags = (pchild->flags & LAY_ITEM_LAYOUT_MASK) >> dim;
+        const unsigned c = (unsigned)child;
+        if (squeezed) {
+            fprintf(out,
+                "    {\n        const lay_scalar min_size = lay_cg_max(0, (lay_scalar)(rects[%u][%d] - rects[%u][%d] - ",
+                it, wdim, c, dim);
+            lay_codegen_scalar(out, pchild->margins[wdim]);
+            fputs("));\n", out);
+            if ((b_flags & LAY_HFILL) == LAY_HFILL)
+                fprintf(out, "        rects[%u][%d] = min_size;\n", c, wdim);
+            else
+                fprintf(out, "        rects[%u][%d] = lay_cg_min(rects[%u][%d], min_size);\n",
+                    c, wdim, c, wdim);
+            switch (b_flags & LAY_HFILL) {
+            case LAY_HCENTER:
+                fprintf(out, "        rects[%u][%d] = (lay_scalar)(rects[%u][%d] + ((rects[%u][%d] - rects[%u][%d]) / 2 - ",
+                    c, dim, c, dim, it, wdim, c, wdim);
+                lay_codegen_scalar(out, pchild->margins[wdim]);
+                fputs("));\n", out);
+                break;
+            case LAY_RIGHT:
+                fprintf(out, "        rects[%u][%d] = (lay_scalar)(rects[%u][%d] - rects[%u][%d] - ",
+                    c, dim, it, wdim, c, wdim);
+                lay_codegen_scalar(out, pchild->margins[wdim]);
+                fputs(");\n", out);
+                break;
+            default:
+                break;
+            }
+            fputs("    }\n", out);
+        } else {
+            switch (b_flags & LAY_HFILL) {
+            case LAY_HCENTER:
+                fprintf(out, "    rects[%u][%d] = (lay_scalar)(rects[%u][%d] + ((rects[%u][%d] - rects[%u][%d]) / 2 - ",
+                    c, dim, c, dim, it, wdim, c, wdim);
+                lay_codegen_scalar(out, pchild->margins[wdim]);
+                fputs("));\n", out);
+                break;
+            case LAY_RIGHT:
+                fprintf(out, "    rects[%u][%d] = (lay_scalar)(rects[%u][%d] + (rects[%u][%d] - rects[%u][%d] - ",
+                    c, dim, c, dim, it, wdim, c, wdim);
+                lay_codegen_scalar(out, pchild->margins[dim]);
+                fputs(" - ", out);
+                lay_codegen_scalar(out, pchild->margins[wdim]);
+                fputs("));\n", out);
+                break;
+            case LAY_HFILL:
+                fprintf(out, "    rects[%u][%d] = lay_cg_max(0, (lay_scalar)(rects[%u][%d] - rects[%u][%d] - ",
+                    c, wdim, it, wdim, c, dim);
+                lay_codegen_scalar(out, pchild->margins[wdim]);
+                fputs("));\n", out);
+                break;
+            default:
+                break;
+            }
+        }
+        fprintf(out, "    rects[%u][%d] = (lay_scalar)(rects[%u][%d] + rects[%u][%d]);\n",
+            c, dim, c, dim, it, dim);
+        child = pchild->next_sibling;
+    }
+}
+
+static void lay_codegen_arrange(const lay_codegen *cg, lay_id item, int dim)
+{
+    const lay_item_t *pitem = lay_get_item(cg->ctx, item);
+    if (pitem->first_child == LAY_INVALID_ID)
+        return;
+
+    const uint32_t model = pitem->flags & LAY_ITEM_BOX_MODEL_MASK;
+    if (model == LAY_ROW || model == LAY_COLUMN) {
+        if ((model & 1) == (uint32_t)dim)
+            lay_codegen_arrange_stacked(cg, item, dim);
+        else
+            lay_codegen_arrange_overlay(cg, item, dim, true);
+    } else {
+        lay_codegen_arrange_overlay(cg, item, dim, false);
+    }
+
+    lay_id child = pitem->first_child;
+    while (child != LAY_INVALID_ID) {
+        lay_codegen_arrange(cg, child, dim);
+        child = lay_get_item(cg->ctx, child)->next_sibling;
+    }
+}
+
+int lay_codegen_emit(
+        FILE *out, const lay_context *ctx, lay_id root,
+        const lay_codegen_param *params, uint32_t num_params,
+        const char *function_name)
+{
+    LAY_ASSERT(out != NULL && ctx != NULL && function_name != NULL);
+    if (!lay_codegen_supported(ctx, root))
+        return 1;
+
+    lay_codegen cg;
+    cg.out = out;
+    cg.ctx = ctx;
+    cg.param_index = (int32_t*)malloc(sizeof(int32_t) * 2 * ctx->count);
+    for (lay_id i = 0; i < 2 * ctx->count; ++i)
+        cg.param_index[i] = -1;
+    for (uint32_t i = 0; i < num_params; ++i) {
+        LAY_ASSERT(params[i].item < ctx->count && (params[i].dim & ~1) == 0);
+        cg.param_index[params[i].item * 2 + params[i].dim] = (int32_t)i;
+    }
+
+    fputs(
+        "#ifndef LAY_CODEGEN_PRELUDE\n"
+        "#define LAY_CODEGEN_PRELUDE\n"
+        "static inline lay_scalar lay_cg_max(lay_scalar a, lay_scalar b) { return a > b ? a : b; }\n"
+        "static inline lay_scalar lay_cg_min(lay_scalar a, lay_scalar b) { return a < b ? a : b; }\n"
+        "static inline float lay_cg_fmax(float a, float b) { return a > b ? a : b; }\n"
+        "static inline int64_t lay_cg_max64(int64_t a, int64_t b) { return a > b ? a : b; }\n"
+        "#endif\n\n", out);
+    fprintf(out, "// Generated by lay_codegen_emit from a tree of %u items.\n", (unsigned)ctx->count);
+    fprintf(out, "void %s(const lay_scalar *params, lay_vec4 *rects)\n{\n    (void)params;\n", function_name);
+    for (int dim = 0; dim < 2; ++dim) {
+        fprintf(out, "    // %s\n", dim ? "vertical" : "horizontal");
+        lay_codegen_calc_size(&cg, root, dim);
+        lay_codegen_arrange(&cg, root, dim);
+    }
+    fputs("}\n\n", out);
+
+    free(cg.param_index);
+    return 0;
+}
+
+#endif // LAY_CODEGEN_IMPLEMENTATION
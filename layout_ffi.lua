@@ -0,0 +1,216 @@
+-- LuaJIT FFI binding for layout.h, using the shared library built from
+-- ffi_layout.c. Unlike the Lua C module in luamodule_layout.c, calls through
+-- the FFI can be compiled into JIT traces.
+--
+--   local Layout = require("layout_ffi")
+--   local ctx = Layout.new()
+--   local root = ctx:item()
+--   ctx:set_size(root, 640, 480)
+--   ctx:set_contain(root, Layout.ROW)
+--   ...
+--   ctx:run()
+--   local x, y, w, h = ctx:rect(root)
+--
+-- The library is loaded as "layout_ffi", or from the path in the LAYOUT_FFI_LIB
+-- environment variable. As with the C API, item ids are not checked: an
+-- invalid id is caught by LAY_ASSERT in debug builds of the library only.
+
+local ffi = require("ffi")
+local bit = require("bit")
+
+local lib = ffi.load(os.getenv("LAYOUT_FFI_LIB") or "layout_ffi")
+
+ffi.cdef[[
+const char *lay_ffi_types(void);
+]]
+ffi.cdef(ffi.string(lib.lay_ffi_types()))
+
+-- lay_vec2 and lay_vec4 are compiler vector types in C. Here they are structs
+-- with the same layout, and only ever used through pointers; the functions that
+-- pass them by value are replaced by out-parameter versions.
+ffi.cdef[[
+typedef struct lay_context lay_context;
+typedef struct { lay_scalar x, y; } lay_vec2;
+typedef struct { lay_scalar x, y, w, h; } lay_vec4;
+typedef struct lay_track { uint32_t kind; lay_scalar size; } lay_track;
+typedef struct lay_memory { size_t items, ext, tracks, diagnostics, snapshots; } lay_memory;
+
+lay_context *lay_ffi_new_context(void);
+void lay_ffi_free_context(lay_context *ctx);
+lay_id lay_ffi_first_child(const lay_context *ctx, lay_id id);
+lay_id lay_ffi_next_sibling(const lay_context *ctx, lay_id id);
+lay_id lay_ffi_next_line(const lay_context *ctx, lay_id line_start);
+void lay_ffi_get_rect_xywh(const lay_context *ctx, lay_id id, lay_scalar *x, lay_scalar *y, lay_scalar *width, lay_scalar *height);
+const lay_vec4 *lay_ffi_rects(const lay_context *ctx);
+void lay_ffi_get_min_size_xy(lay_context *ctx, lay_id item, lay_scalar *width, lay_scalar *height);
+void lay_ffi_get_max_size_xy(lay_context *ctx, lay_id item, lay_scalar *width, lay_scalar *height);
+void lay_ffi_get_gap(lay_context *ctx, lay_id item, lay_scalar *main, lay_scalar *cross);
+void lay_ffi_get_grid_column(lay_context *ctx, lay_id item, uint32_t column, lay_scalar *position, lay_scalar *width);
+
+void lay_reserve_items_capacity(lay_context *ctx, lay_id count);
+void lay_reset_context(lay_context *ctx);
+size_t lay_memory_usage(lay_context *ctx, lay_memory *detail);
+void lay_shrink_to_fit(lay_context *ctx);
+void lay_set_trim_policy(lay_context *ctx, uint32_t quiet_resets);
+void lay_run_context(lay_context *ctx);
+void lay_run_item(lay_context *ctx, lay_id item);
+void lay_clear_item_break(lay_context *ctx, lay_id item);
+lay_id lay_items_count(lay_context *ctx);
+lay_id lay_items_capacity(lay_context *ctx);
+lay_id lay_item(lay_context *ctx);
+void lay_insert(lay_context *ctx, lay_id parent, lay_id child);
+void lay_append(lay_context *ctx, lay_id earlier, lay_id later);
+void lay_push(lay_context *ctx, lay_id parent, lay_id child);
+void lay_get_size_xy(lay_context *ctx, lay_id item, lay_scalar *x, lay_scalar *y);
+void lay_set_size_xy(lay_context *ctx, lay_id item, lay_scalar width, lay_scalar height);
+void lay_set_contain(lay_context *ctx, lay_id item, uint32_t flags);
+void lay_set_behave(lay_context *ctx, lay_id item, uint32_t flags);
+void lay_get_margins_ltrb(lay_context *ctx, lay_id item, lay_scalar *l, lay_scalar *t, lay_scalar *r, lay_scalar *b);
+void lay_set_margins_ltrb(lay_context *ctx, lay_id item, lay_scalar l, lay_scalar t, lay_scalar r, lay_scalar b);
+void lay_set_min_size_xy(lay_context *ctx, lay_id item, lay_scalar width, lay_scalar height);
+void lay_set_max_size_xy(lay_context *ctx, lay_id item, lay_scalar width, lay_scalar height);
+void lay_set_grid_columns(lay_context *ctx, lay_id item, const lay_track *columns, uint32_t count);
+void lay_set_gap(lay_context *ctx, lay_id item, lay_scalar main, lay_scalar cross);
+void lay_set_weights(lay_context *ctx, lay_id item, uint16_t grow, uint16_t shrink);
+void lay_get_weights(lay_context *ctx, lay_id item, uint16_t *grow, uint16_t *shrink);
+]]
+
+local invalid_id = tonumber(ffi.cast("lay_id", -1))
+-- Out-parameter scratch space, so that getters don't allocate
+local scalars = ffi.new("lay_scalar[4]")
+local weights = ffi.new("uint16_t[2]")
+
+-- Turns LAY_INVALID_ID into -1, like the Lua C module does
+local function id_or_none(id)
+    if id == invalid_id then return -1 end
+    return tonumber(id)
+end
+
+local Context = {}
+Context.__index = Context
+
+function Context:destroy()
+    lib.lay_ffi_free_context(ffi.gc(self, nil))
+end
+
+function Context:run() lib.lay_run_context(self) end
+function Context:run_item(item) lib.lay_run_item(self, item) end
+function Context:reset() lib.lay_reset_context(self) end
+function Context:count() return tonumber(lib.lay_items_count(self)) end
+function Context:capacity() return tonumber(lib.lay_items_capacity(self)) end
+function Context:reserve(count) lib.lay_reserve_items_capacity(self, count) end
+function Context:shrink() lib.lay_shrink_to_fit(self) end
+function Context:set_trim_policy(quiet_resets) lib.lay_set_trim_policy(self, quiet_resets) end
+
+-- Returns the total heap size of the context in bytes, and the lay_memory
+-- breakdown
+function Context:memory()
+    local detail = ffi.new("lay_memory")
+    local total = lib.lay_memory_usage(self, detail)
+    return tonumber(total), detail
+end
+
+function Context:item() return tonumber(lib.lay_item(self)) end
+function Context:insert(parent, child) lib.lay_insert(self, parent, child) end
+function Context:append(earlier, later) lib.lay_append(self, earlier, later) end
+function Context:push(parent, child) lib.lay_push(self, parent, child) end
+function Context:clear_break(item) lib.lay_clear_item_break(self, item) end
+function Context:first_child(item) return id_or_none(lib.lay_ffi_first_child(self, item)) end
+function Context:next_sibling(item) return id_or_none(lib.lay_ffi_next_sibling(self, item)) end
+function Context:next_line(line_start) return id_or_none(lib.lay_ffi_next_line(self, line_start)) end
+
+-- Flags can be passed as several arguments, which are combined
+function Context:set_contain(item, ...) lib.lay_set_contain(self, item, bit.bor(0, ...)) end
+function Context:set_behave(item, ...) lib.lay_set_behave(self, item, bit.bor(0, ...)) end
+
+function Context:set_size(item, w, h) lib.lay_set_size_xy(self, item, w, h) end
+function Context:set_margins(item, l, t, r, b) lib.lay_set_margins_ltrb(self, item, l, t, r, b) end
+function Context:set_min_size(item, w, h) lib.lay_set_min_size_xy(self, item, w, h) end
+function Context:set_max_size(item, w, h) lib.lay_set_max_size_xy(self, item, w, h) end
+function Context:set_gap(item, main, cross) lib.lay_set_gap(self, item, main, cross) end
+function Context:set_weights(item, grow, shrink) lib.lay_set_weights(self, item, grow, shrink) end
+
+-- columns is a list of {kind, size} pairs, where kind is one of the
+-- Layout.TRACK_ values
+function Context:set_grid_columns(item, columns)
+    local n = #columns
+    local tracks = ffi.new("lay_track[?]", n)
+    for i = 1, n do
+        tracks[i - 1].kind = columns[i][1]
+        tracks[i - 1].size = columns[i][2] or 0
+    end
+    lib.lay_set_grid_columns(self, item, tracks, n)
+end
+
+function Context:size(item)
+    lib.lay_get_size_xy(self, item, scalars, scalars + 1)
+    return scalars[0], scalars[1]
+end
+
+function Context:margins(item)
+    lib.lay_get_margins_ltrb(self, item, scalars, scalars + 1, scalars + 2, scalars + 3)
+    return scalars[0], scalars[1], scalars[2], scalars[3]
+end
+
+function Context:min_size(item)
+    lib.lay_ffi_get_min_size_xy(self, item, scalars, scalars + 1)
+    return scalars[0], scalars[1]
+end
+
+function Context:max_size(item)
+    lib.lay_ffi_get_max_size_xy(self, item, scalars, scalars + 1)
+    return scalars[0], scalars[1]
+end
+
+function Context:gap(item)
+    lib.lay_ffi_get_gap(self, item, scalars, scalars + 1)
+    return scalars[0], scalars[1]
+end
+
+function Context:weights(item)
+    lib.lay_get_weights(self, item, weights, weights + 1)
+    return weights[0], weights[1]
+end
+
+function Context:grid_column(item, column)
+    lib.lay_ffi_get_grid_column(self, item, column, scalars, scalars + 1)
+    return scalars[0], scalars[1]
+end
+
+function Context:rect(item)
+    lib.lay_ffi_get_rect_xywh(self, item, scalars, scalars + 1, scalars + 2, scalars + 3)
+    return scalars[0], scalars[1], scalars[2], scalars[3]
+end
+
+-- Returns a pointer to the rects of all items, indexed by id from 0, and the
+-- number of items. rects[id].x, .y, .w and .h are read in place without
+-- copying. The pointer is only valid until items are added to the context or
+-- its capacity changes.
+function Context:rects()
+    return lib.lay_ffi_rects(self), tonumber(lib.lay_items_count(self))
+end
+
+ffi.metatype("lay_context", Context)
+
+local Layout = {
+    ROW = 0x002, COLUMN = 0x003, OVERLAY = 0x000, FLEX = 0x002, GRID = 0x001,
+    NOWRAP = 0x000, WRAP = 0x004,
+    START = 0x008, MIDDLE = 0x000, END = 0x010, JUSTIFY = 0x018,
+
+    LEFT = 0x020, TOP = 0x040, RIGHT = 0x080, BOTTOM = 0x100,
+    HFILL = 0x0a0, VFILL = 0x140, HCENTER = 0x000, VCENTER = 0x000,
+    CENTER = 0x000, FILL = 0x1e0, BREAK = 0x200,
+
+    TRACK_FIXED = 0, TRACK_AUTO = 1, TRACK_FILL = 2,
+
+    lib = lib,
+}
+
+-- Creates a context. It is destroyed when collected, or by ctx:destroy().
+function Layout.new()
+    local ctx = lib.lay_ffi_new_context()
+    if ctx == nil then error("Out of memory") end
+    return ffi.gc(ctx, lib.lay_ffi_free_context)
+end
+
+return Layout
@@ -0,0 +1,680 @@
+#ifndef LAY_REFERENCE_INCLUDE_HEADER
+#define LAY_REFERENCE_INCLUDE_HEADER
+
+// 参考实现：layout.h 布局算法的一个刻意写得简单的版本，用于差分测试。
+//
+// 它不使用 lay_context，而是直接读取一个按先序排列的树描述（lay_ref_item 数组），
+// 并且在结构上尽量直接：按盒模型 switch，用数组保存子项，整数版本用精确的分数
+// 计算位置，填充项的份额通过枚举分段点直接求解，而不是二分查找。
+// 它不考虑速度，只用来与 layout.h 的结果比较（见 differential_layout.c）。
+//
+// 与 layout.h 一样，在一个 C 或 C++ 文件中定义 LAY_REFERENCE_IMPLEMENTATION，
+// 然后包含此文件。需要先包含 layout.h，并且使用相同的坐标类型（LAY_FLOAT 或 int16）。
+
+#ifndef LAY_REFERENCE_EXPORT
+#define LAY_REFERENCE_EXPORT extern
+#endif
+
+// 参考实现支持的最多网格列数
+#define LAY_REF_MAX_COLUMNS 8
+
+// 树中的一个项。数组按先序排列：父项总是在子项之前，兄弟项按插入顺序排列。
+typedef struct lay_ref_item {
+    // 父项的下标，根项为 -1
+    int32_t parent;
+    // 传递给 lay_set_contain() 和 lay_set_behave() 的标志，behave 可以包含 LAY_BREAK
+    uint32_t contain;
+    uint32_t behave;
+    lay_scalar size[2];
+    lay_scalar margins[4];
+    // 项是否有 LAY_ITEM_EXT 记录，也就是是否调用过 lay_set_min_size()、lay_set_gap() 等函数。
+    // 为 0 时，下面的字段必须是默认值：尺寸和间距为 0，权重为 1，没有网格列。
+    uint32_t ext;
+    lay_scalar min_size[2];
+    lay_scalar max_size[2];
+    lay_scalar gap[2];
+    uint16_t grow_weight;
+    uint16_t shrink_weight;
+    uint32_t num_columns;
+    lay_track columns[LAY_REF_MAX_COLUMNS];
+} lay_ref_item;
+
+// 计算 `count` 个项的布局，相当于构建同样的树后调用 lay_run_context()。
+// 结果按项的下标写入 `rects`。
+LAY_REFERENCE_EXPORT void lay_ref_run(const lay_ref_item *items, int32_t count, lay_vec4 *rects);
+
+#undef LAY_REFERENCE_EXPORT
+
+#endif // LAY_REFERENCE_INCLUDE_HEADER
+
+#ifdef LAY_REFERENCE_IMPLEMENTATION
+
+#include <stdlib.h>
+
+// Positions along a row or column are kept as numerators over a per line
+// denominator. In integer builds they are exact, and the output is the
+// truncation of the exact position. Float builds divide up front and add in
+// the same order as layout.h, because a wrapping child whose content exactly
+// fits its width would otherwise wrap on a difference in the last bit. Only
+// the shares of fillers with min/max sizes, which layout.h finds by bisection,
+// are slightly different.
+#ifdef LAY_FLOAT
+typedef float lay_ref_num;
+#else
+typedef int64_t lay_ref_num;
+#endif
+
+typedef struct lay_ref {
+    const lay_ref_item *items;
+    lay_vec4 *rects;
+    // Children of each item, as a range of `kids`
+    int32_t *kids;
+    int32_t *first_kid;
+    int32_t *num_kids;
+    // For each child that starts a line of a wrapping container, the index in
+    // its parent's children where the next line starts
+    int32_t *line_end;
+} lay_ref;
+
+static lay_scalar lay_ref_min(lay_scalar a, lay_scalar b) { return a < b ? a : b; }
+static lay_scalar lay_ref_max(lay_scalar a, lay_scalar b) { return a > b ? a : b; }
+
+// Only items with an ext record are clamped, so an item without one can end up
+// with a negative size, as with lay_clamp_size in layout.h.
+static lay_scalar lay_ref_clamp(const lay_ref_item *it, int dim, lay_scalar size)
+{
+    if (!it->ext)
+        return size;
+    if (it->max_size[dim] != 0)
+        size = lay_ref_min(size, it->max_size[dim]);
+    return lay_ref_max(size, it->min_size[dim]);
+}
+
+// The behave flags for dim, shifted so that they can be compared to LAY_LEFT,
+// LAY_RIGHT and LAY_HFILL in either dimension.
+static uint32_t lay_ref_anchors(const lay_ref_item *it, int dim)
+{
+    return (it->behave >> dim) & LAY_HFILL;
+}
+
+// Margin box of a child along dim: start margin + size + end margin
+static lay_scalar lay_ref_extent(const lay_ref *r, int32_t child, int dim)
+{
+    const lay_vec4 rect = r->rects[child];
+    return rect[dim] + rect[2 + dim] + r->items[child].margins[2 + dim];
+}
+
+static int32_t lay_ref_kid(const lay_ref *r, int32_t item, int32_t i)
+{
+    return r->kids[r->first_kid[item] + i];
+}
+
+// Content sizes
+// -------------
+
+static lay_scalar lay_ref_overlay_size(const lay_ref *r, int32_t item, int dim)
+{
+    lay_scalar size = 0;
+    for (int32_t i = 0; i < r->num_kids[item]; ++i)
+        size = lay_ref_max(size, lay_ref_extent(r, lay_ref_kid(r, item, i), dim));
+    return size;
+}
+
+static lay_scalar lay_ref_stacked_size(const lay_ref *r, int32_t item, int dim)
+{
+    const lay_scalar gap = r->items[item].gap[0];
+    lay_scalar size = 0;
+    for (int32_t i = 0; i < r->num_kids[item]; ++i) {
+        if (i > 0)
+            size += gap;
+        size += lay_ref_extent(r, lay_ref_kid(r, item, i), dim);
+    }
+    return size;
+}
+
+// Width of a wrapping row before it has been arranged: only the manual breaks
+// are known, so this is its longest run of children between LAY_BREAKs.
+static lay_scalar lay_ref_wrapped_row_width(const lay_ref *r, int32_t item)
+{
+    const lay_scalar gap = r->items[item].gap[0];
+    lay_scalar widest = 0;
+    lay_scalar line = 0;
+    for (int32_t i = 0; i < r->num_kids[item]; ++i) {
+        const int32_t child = lay_ref_kid(r, item, i);
+        if (r->items[child].behave & LAY_BREAK) {
+            widest = lay_ref_max(widest, line);
+            line = 0;
+        } else if (i > 0) {
+            line += gap;
+        }
+        line += lay_ref_extent(r, child, 0);
+    }
+    return lay_ref_max(widest, line);
+}
+
+// Height of a wrapping row after its lines are known: the sum of the tallest
+// child in each line, with the cross gap between lines.
+static lay_scalar lay_ref_wrapped_row_height(const lay_ref *r, int32_t item)
+{
+    const lay_scalar gap = r->items[item].gap[1];
+    lay_scalar size = 0;
+    int32_t start = 0;
+    while (start < r->num_kids[item]) {
+        const int32_t end = r->line_end[lay_ref_kid(r, item, start)];
+        lay_scalar line = 0;
+        for (int32_t i = start; i < end; ++i)
+            line = lay_ref_max(line, lay_ref_extent(r, lay_ref_kid(r, item, i), 1));
+        if (start > 0)
+            size += gap;
+        size += line;
+        start = end;
+    }
+    return size;
+}
+
+// Fixed columns have their own width, and the others the width of their widest
+// cell. Returns the sum, with gaps.
+static lay_scalar lay_ref_grid_widths(const lay_ref *r, int32_t item, lay_scalar *widths)
+{
+    const lay_ref_item *it = &r->items[item];
+    const uint32_t n = it->num_columns;
+    for (uint32_t c = 0; c < n; ++c)
+        widths[c] = it->columns[c].kind == LAY_TRACK_FIXED ? it->columns[c].size : 0;
+    for (int32_t i = 0; i < r->num_kids[item]; ++i) {
+        const uint32_t c = (uint32_t)i % n;
+        if (it->columns[c].kind != LAY_TRACK_FIXED)
+            widths[c] = lay_ref_max(widths[c], lay_ref_extent(r, lay_ref_kid(r, item, i), 0));
+    }
+    lay_scalar total = 0;
+    for (uint32_t c = 0; c < n; ++c) {
+        if (c > 0)
+            total += it->gap[0];
+        total += widths[c];
+    }
+    return total;
+}
+
+static lay_scalar lay_ref_grid_height(const lay_ref *r, int32_t item)
+{
+    const lay_ref_item *it = &r->items[item];
+    const int32_t n = it->num_columns > 0 ? (int32_t)it->num_columns : 1;
+    lay_scalar size = 0;
+    for (int32_t row = 0; row * n < r->num_kids[item]; ++row) {
+        lay_scalar height = 0;
+        for (int32_t i = row * n; i < (row + 1) * n && i < r->num_kids[item]; ++i)
+            height = lay_ref_max(height, lay_ref_extent(r, lay_ref_kid(r, item, i), 1));
+        if (row > 0)
+            size += it->gap[1];
+        size += height;
+    }
+    return size;
+}
+
+static lay_scalar lay_ref_content_size(const lay_ref *r, int32_t item, int dim)
+{
+    const lay_ref_item *it = &r->items[item];
+    lay_scalar widths[LAY_REF_MAX_COLUMNS];
+    switch (it->contain & LAY_ITEM_BOX_MODEL_MASK) {
+    case LAY_GRID:
+        if (dim == 1)
+            return lay_ref_grid_height(r, item);
+        if (it->num_columns == 0)
+            return lay_ref_overlay_size(r, item, 0);
+        return lay_ref_grid_widths(r, item, widths);
+    case LAY_ROW:
+        return dim == 0 ? lay_ref_stacked_size(r, item, 0) : lay_ref_overlay_size(r, item, 1);
+    case LAY_COLUMN:
+    case LAY_COLUMN | LAY_WRAP:
+        return dim == 1 ? lay_ref_stacked_size(r, item, 1) : lay_ref_overlay_size(r, item, 0);
+    case LAY_ROW | LAY_WRAP:
+        return dim == 0 ? lay_ref_wrapped_row_width(r, item) : lay_ref_wrapped_row_height(r, item);
+    default:
+        return lay_ref_overlay_size(r, item, dim);
+    }
+}
+
+static void lay_ref_calc_size(lay_ref *r, int32_t item, int dim)
+{
+    const lay_ref_item *it = &r->items[item];
+    for (int32_t i = 0; i < r->num_kids[item]; ++i)
+        lay_ref_calc_size(r, lay_ref_kid(r, item, i), dim);
+    r->rects[item][dim] = it->margins[dim];
+    lay_scalar size = it->size[dim];
+    if (size == 0)
+        size = lay_ref_content_size(r, item, dim);
+    r->rects[item][2 + dim] = lay_ref_clamp(it, dim, size);
+}
+
+// Free layout
+// -----------
+
+// Places a child in [offset, offset + space) by its anchors
+static void lay_ref_place(lay_ref *r, int32_t child, int dim, lay_scalar offset, lay_scalar space)
+{
+    const lay_ref_item *it = &r->items[child];
+    lay_vec4 rect = r->rects[child];
+    switch (lay_ref_anchors(it, dim)) {
+    case LAY_HCENTER:
+        rect[dim] += (space - rect[2 + dim]) / 2 - it->margins[2 + dim];
+        break;
+    case LAY_RIGHT:
+        rect[dim] += space - rect[2 + dim] - it->margins[dim] - it->margins[2 + dim];
+        break;
+    case LAY_HFILL:
+        rect[2 + dim] = lay_ref_clamp(it, dim,
+            lay_ref_max(0, space - rect[dim] - it->margins[2 + dim]));
+        break;
+    default:
+        break;
+    }
+    rect[dim] += offset;
+    r->rects[child] = rect;
+}
+
+// Like lay_ref_place, but children that don't fit in the space are shrunk to
+// it, down to their min size. Used across the main axis of rows and columns.
+static void lay_ref_place_squeezed(lay_ref *r, int32_t child, int dim, lay_scalar offset, lay_scalar space)
+{
+    const lay_ref_item *it = &r->items[child];
+    lay_vec4 rect = r->rects[child];
+    const lay_scalar fit = lay_ref_max(0, space - rect[dim] - it->margins[2 + dim]);
+    const uint32_t anchors = lay_ref_anchors(it, dim);
+    if (anchors == LAY_HFILL)
+        rect[2 + dim] = lay_ref_clamp(it, dim, fit);
+    else
+        rect[2 + dim] = lay_ref_clamp(it, dim, lay_ref_min(rect[2 + dim], fit));
+    if (anchors == LAY_HCENTER)
+        rect[dim] += (space - rect[2 + dim]) / 2 - it->margins[2 + dim];
+    else if (anchors == LAY_RIGHT)
+        rect[dim] = space - rect[2 + dim] - it->margins[2 + dim];
+    rect[dim] += offset;
+    r->rects[child] = rect;
+}
+
+// Squeezes each line of a wrapping container into the height (or width) of
+// its tallest child, and stacks the lines. Returns where the last line ends.
+static lay_scalar lay_ref_squeeze_lines(lay_ref *r, int32_t item, int dim)
+{
+    const lay_scalar gap = r->items[item].gap[1];
+    lay_scalar offset = r->rects[item][dim];
+    int32_t start = 0;
+    while (start < r->num_kids[item]) {
+        const int32_t end = r->line_end[lay_ref_kid(r, item, start)];
+        lay_scalar line = 0;
+        for (int32_t i = start; i < end; ++i)
+            line = lay_ref_max(line, lay_ref_extent(r, lay_ref_kid(r, item, i), dim));
+        for (int32_t i = start; i < end; ++i)
+            lay_ref_place_squeezed(r, lay_ref_kid(r, item, i), dim, offset, line);
+        offset += line;
+        if (end < r->num_kids[item])
+            offset += gap;
+        start = end;
+    }
+    return offset;
+}
+
+// Rows and columns
+// ----------------
+
+static bool lay_ref_fills(const lay_ref_item *it, int dim)
+{
+    return lay_ref_anchors(it, dim) == LAY_HFILL;
+}
+
+// A filler's size for a share of the extra space per unit of grow weight, if
+// its min or max size applies at that share. The share is num / den.
+static bool lay_ref_filler_clamped(
+        const lay_ref_item *it, int dim, lay_ref_num num, lay_ref_num den, lay_scalar *size)
+{
+    const lay_ref_num want = num * it->grow_weight;
+    if (want < (lay_ref_num)it->min_size[dim] * den) {
+        *size = it->min_size[dim];
+        return true;
+    }
+    if (it->max_size[dim] != 0 && want >= (lay_ref_num)it->max_size[dim] * den) {
+        *size = it->max_size[dim];
+        return true;
+    }
+    return false;
+}
+
+// Whether the fillers in kids [start, end) fit in avail at the given share
+static bool lay_ref_fillers_fit(
+        const lay_ref *r, int32_t item, int32_t start, int32_t end, int dim,
+        lay_ref_num num, lay_ref_num den, lay_scalar avail)
+{
+    lay_ref_num total = 0;
+    for (int32_t i = start; i < end; ++i) {
+        const lay_ref_item *it = &r->items[lay_ref_kid(r, item, i)];
+        lay_scalar size;
+        if (!lay_ref_fills(it, dim))
+            continue;
+        if (lay_ref_filler_clamped(it, dim, num, den, &size))
+            total += (lay_ref_num)size * den;
+        else
+            total += num * it->grow_weight;
+    }
+    return total <= (lay_ref_num)avail * den;
+}
+
+// Shares the space in avail between the fillers in kids [start, end) by grow
+// weight, respecting their min and max sizes. The total size is piecewise
+// linear in the share, with a corner wherever a filler reaches its min or max
+// size, so this tries each corner and picks the last one that still fits.
+// Between that corner and the next, the same fillers are clamped, and the
+// others split what's left. Returns that share as *num / *den.
+static void lay_ref_solve_fillers(
+        const lay_ref *r, int32_t item, int32_t start, int32_t end, int dim,
+        lay_scalar avail, lay_ref_num *num, lay_ref_num *den)
+{
+    lay_ref_num best_num = 0, best_den = 1;
+    for (int32_t i = start; i < end; ++i) {
+        const lay_ref_item *it = &r->items[lay_ref_kid(r, item, i)];
+        if (!lay_ref_fills(it, dim) || it->grow_weight == 0)
+            continue;
+        for (int k = 0; k < 2; ++k) {
+            const lay_scalar corner = k == 0 ? it->min_size[dim] : it->max_size[dim];
+            if (k == 1 && corner == 0)
+                continue;
+            const lay_ref_num c_num = corner, c_den = it->grow_weight;
+            if (c_num * best_den > best_num * c_den
+                    && lay_ref_fillers_fit(r, item, start, end, dim, c_num, c_den, avail)) {
+                best_num = c_num;
+                best_den = c_den;
+            }
+        }
+    }
+    lay_ref_num rest = avail;
+    lay_ref_num weight = 0;
+    for (int32_t i = start; i < end; ++i) {
+        const lay_ref_item *it = &r->items[lay_ref_kid(r, item, i)];
+        lay_scalar size;
+        if (!lay_ref_fills(it, dim))
+            continue;
+        if (lay_ref_filler_clamped(it, dim, best_num, best_den, &size))
+            rest -= size;
+        else
+            weight += it->grow_weight;
+    }
+    if (weight == 0) {
+        // Everything is clamped, at the best corner or past it
+        *num = best_num;
+        *den = best_den;
+        return;
+    }
+    *num = rest;
+    *den = weight;
+}
+
+static void lay_ref_stack(lay_ref *r, int32_t item, int dim, bool wrap)
+{
+    const lay_ref_item *it = &r->items[item];
+    const lay_vec4 rect = r->rects[item];
+    const lay_scalar space = rect[2 + dim];
+    const lay_scalar gap = it->gap[0];
+    const lay_ref_num max_x2 = (lay_ref_num)rect[dim] + space;
+    const int32_t num_kids = r->num_kids[item];
+
+    int32_t start = 0;
+    while (start < num_kids) {
+        // Which children fit on this line, and how much space they use. The
+        // child that starts the next line has already been counted as a
+        // filler or as squeezable, like layout.h does.
+        lay_scalar used = 0;
+        uint32_t fillers = 0;
+        uint32_t shrink = 0;
+        bool constrained = false;
+        lay_scalar fillers_min = 0;
+        int32_t end = start;
+        bool hardbreak = false;
+        while (end < num_kids) {
+            const int32_t child = lay_ref_kid(r, item, end);
+            const lay_ref_item *c = &r->items[child];
+            const lay_vec4 crect = r->rects[child];
+            lay_scalar extend = end > start ? used + gap : used;
+            if (lay_ref_fills(c, dim)) {
+                ++fillers;
+                extend += crect[dim] + c->min_size[dim] + c->margins[2 + dim];
+            } else {
+                if (c->size[dim] == 0)
+                    shrink += c->shrink_weight;
+                extend += crect[dim] + crect[2 + dim] + c->margins[2 + dim];
+            }
+            if (wrap && end > start && (extend > space || (c->behave & LAY_BREAK))) {
+                hardbreak = (c->behave & LAY_BREAK) != 0;
+                break;
+            }
+            used = extend;
+            if (c->ext && lay_ref_fills(c, dim)) {
+                constrained = true;
+                fillers_min += c->min_size[dim];
+            }
+            ++end;
+        }
+        const int32_t count = end - start;
+        const lay_scalar extra = space - used;
+
+        // Everything below is in units of 1 / den
+        lay_ref_num den = 1;
+        lay_ref_num share = 0; // per unit of grow weight
+        lay_ref_num first_margin = 0;
+        lay_ref_num spacer = 0;
+        lay_ref_num eater = 0; // per unit of shrink weight
+        if (extra > 0 && fillers > 0) {
+            if (constrained) {
+                lay_ref_solve_fillers(r, item, start, end, dim, extra + fillers_min, &share, &den);
+            } else {
+                share = extra;
+                den = fillers;
+            }
+        } else if (extra > 0) {
+            switch (it->contain & LAY_JUSTIFY) {
+            case LAY_JUSTIFY:
+                // Not on the last line of a wrapping container, or before a
+                // manual break
+                if (count > 1 && (!wrap || (end < num_kids && !hardbreak))) {
+                    spacer = extra;
+                    den = count - 1;
+                }
+                break;
+            case LAY_START:
+                break;
+            case LAY_END:
+                first_margin = extra;
+                break;
+            default:
+                first_margin = extra;
+                den = 2;
+                break;
+            }
+        } else if (!wrap && extra < 0 && shrink > 0) {
+            eater = extra;
+            den = shrink;
+        }
+#ifdef LAY_FLOAT
+        share /= den;
+        first_margin /= den;
+        spacer /= den;
+        eater /= den;
+        den = 1;
+#endif
+
+        lay_ref_num x = (lay_ref_num)rect[dim] * den;
+        for (int32_t i = start; i < end; ++i) {
+            const int32_t child = lay_ref_kid(r, item, i);
+            const lay_ref_item *c = &r->items[child];
+            lay_vec4 crect = r->rects[child];
+            x += (lay_ref_num)crect[dim] * den + (i == start ? first_margin : spacer);
+            lay_ref_num x1;
+            if (lay_ref_fills(c, dim)) {
+                lay_scalar clamped;
+                if (extra <= 0)
+                    x1 = x + (lay_ref_num)c->min_size[dim] * den;
+                else if (lay_ref_filler_clamped(c, dim, share, den, &clamped))
+                    x1 = x + (lay_ref_num)clamped * den;
+                else
+                    x1 = x + share * c->grow_weight;
+            } else if (c->size[dim] != 0) {
+                x1 = x + (lay_ref_num)crect[2 + dim] * den;
+            } else {
+                lay_ref_num squeezed = (lay_ref_num)crect[2 + dim] * den + eater * c->shrink_weight;
+                lay_ref_num min_size = (lay_ref_num)c->min_size[dim] * den;
+                x1 = x + (squeezed > min_size ? squeezed : min_size);
+            }
+            lay_ref_num x1_clipped = x1;
+            const lay_ref_num limit = (max_x2 - c->margins[2 + dim]) * den;
+            if (wrap && x1_clipped > limit)
+                x1_clipped = limit;
+            const lay_scalar ix0 = (lay_scalar)(x / den);
+            const lay_scalar ix1 = (lay_scalar)(x1_clipped / den);
+            crect[dim] = ix0;
+            crect[2 + dim] = ix1 - ix0;
+            r->rects[child] = crect;
+            x = x1 + (lay_ref_num)c->margins[2 + dim] * den + (lay_ref_num)gap * den;
+        }
+        r->line_end[lay_ref_kid(r, item, start)] = end;
+        start = end;
+    }
+}
+
+// Grids
+// -----
+
+static void lay_ref_grid_columns(lay_ref *r, int32_t item)
+{
+    const lay_ref_item *it = &r->items[item];
+    const uint32_t n = it->num_columns;
+    lay_scalar widths[LAY_REF_MAX_COLUMNS];
+    lay_scalar offsets[LAY_REF_MAX_COLUMNS];
+    lay_ref_grid_widths(r, item, widths);
+
+    // Fill columns share what the other columns and the gaps leave
+    lay_scalar used = 0;
+    uint32_t fills = 0;
+    for (uint32_t c = 0; c < n; ++c) {
+        if (c > 0)
+            used += it->gap[0];
+        if (it->columns[c].kind == LAY_TRACK_FILL)
+            ++fills;
+        else
+            used += widths[c];
+    }
+    const lay_scalar extra = lay_ref_max(0, r->rects[item][2] - used);
+    lay_scalar x = r->rects[item][0];
+    uint32_t fill = 0;
+    for (uint32_t c = 0; c < n; ++c) {
+        if (it->columns[c].kind == LAY_TRACK_FILL) {
+#ifdef LAY_FLOAT
+            widths[c] = extra / (lay_scalar)fills;
+#else
+            widths[c] = (lay_scalar)(extra * (int32_t)(fill + 1) / (int32_t)fills
+                - extra * (int32_t)fill / (int32_t)fills);
+#endif
+            ++fill;
+        }
+        offsets[c] = x;
+        x += widths[c] + it->gap[0];
+    }
+    for (int32_t i = 0; i < r->num_kids[item]; ++i) {
+        const uint32_t c = (uint32_t)i % n;
+        lay_ref_place(r, lay_ref_kid(r, item, i), 0, offsets[c], widths[c]);
+    }
+}
+
+static void lay_ref_grid_rows(lay_ref *r, int32_t item)
+{
+    const lay_ref_item *it = &r->items[item];
+    const int32_t n = it->num_columns > 0 ? (int32_t)it->num_columns : 1;
+    lay_scalar y = r->rects[item][1];
+    for (int32_t row = 0; row * n < r->num_kids[item]; ++row) {
+        const int32_t end = (row + 1) * n < r->num_kids[item] ? (row + 1) * n : r->num_kids[item];
+        lay_scalar height = 0;
+        for (int32_t i = row * n; i < end; ++i)
+            height = lay_ref_max(height, lay_ref_extent(r, lay_ref_kid(r, item, i), 1));
+        for (int32_t i = row * n; i < end; ++i)
+            lay_ref_place(r, lay_ref_kid(r, item, i), 1, y, height);
+        y += height + it->gap[1];
+    }
+}
+
+static void lay_ref_arrange(lay_ref *r, int32_t item, int dim)
+{
+    const lay_ref_item *it = &r->items[item];
+    const lay_vec4 rect = r->rects[item];
+    int32_t i;
+    switch (it->contain & LAY_ITEM_BOX_MODEL_MASK) {
+    case LAY_GRID:
+        if (dim == 1)
+            lay_ref_grid_rows(r, item);
+        else if (it->num_columns > 0)
+            lay_ref_grid_columns(r, item);
+        else
+            for (i = 0; i < r->num_kids[item]; ++i)
+                lay_ref_place(r, lay_ref_kid(r, item, i), 0, rect[0], rect[2]);
+        break;
+    case LAY_ROW:
+    case LAY_COLUMN:
+        // Stacked along the main axis, squeezed across it
+        if (dim == (int)(it->contain & 1))
+            lay_ref_stack(r, item, dim, false);
+        else
+            for (i = 0; i < r->num_kids[item]; ++i)
+                lay_ref_place_squeezed(r, lay_ref_kid(r, item, i), dim, rect[dim], rect[2 + dim]);
+        break;
+    case LAY_ROW | LAY_WRAP:
+        if (dim == 0)
+            lay_ref_stack(r, item, 0, true);
+        else
+            lay_ref_squeeze_lines(r, item, 1);
+        break;
+    case LAY_COLUMN | LAY_WRAP:
+        // Everything happens in the vertical pass, and the column's width
+        // becomes the width of its lines.
+        if (dim == 1) {
+            lay_ref_stack(r, item, 1, true);
+            r->rects[item][2] = lay_ref_squeeze_lines(r, item, 0) - r->rects[item][0];
+        }
+        break;
+    default:
+        for (i = 0; i < r->num_kids[item]; ++i)
+            lay_ref_place(r, lay_ref_kid(r, item, i), dim, rect[dim], rect[2 + dim]);
+        break;
+    }
+    for (i = 0; i < r->num_kids[item]; ++i)
+        lay_ref_arrange(r, lay_ref_kid(r, item, i), dim);
+}
+
+void lay_ref_run(const lay_ref_item *items, int32_t count, lay_vec4 *rects)
+{
+    if (count == 0)
+        return;
+    lay_ref r;
+    r.items = items;
+    r.rects = rects;
+    r.kids = (int32_t*)calloc((size_t)count * 4, sizeof(int32_t));
+    r.first_kid = r.kids + count;
+    r.num_kids = r.first_kid + count;
+    r.line_end = r.num_kids + count;
+
+    // Preorder means that a parent's children are in order in the array
+    for (int32_t i = 1; i < count; ++i)
+        ++r.num_kids[items[i].parent];
+    int32_t next = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        r.first_kid[i] = next;
+        next += r.num_kids[i];
+        r.num_kids[i] = 0;
+    }
+    for (int32_t i = 1; i < count; ++i) {
+        const int32_t parent = items[i].parent;
+        r.kids[r.first_kid[parent] + r.num_kids[parent]++] = i;
+    }
+
+    lay_ref_calc_size(&r, 0, 0);
+    lay_ref_arrange(&r, 0, 0);
+    lay_ref_calc_size(&r, 0, 1);
+    lay_ref_arrange(&r, 0, 1);
+    free(r.kids);
+}
+
+#endif // LAY_REFERENCE_IMPLEMENTATION
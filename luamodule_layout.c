@@ -11,16 +11,43 @@ extern "C" {
 #if LAY_FLOAT == 1
 #define LUALAY_CHECK_SCALAR luaL_checknumber
 #define LUALAY_PUSH_SCALAR lua_pushnumber
+#define LUALAY_TO_SCALAR lua_tonumber
 #else
 #define LUALAY_CHECK_SCALAR luaL_checkinteger
 #define LUALAY_PUSH_SCALAR lua_pushinteger
+#define LUALAY_TO_SCALAR lua_tointeger
 #endif
 
+// The userdata of a context. The item storage is allocated by LAY_REALLOC,
+// which can't go through the Lua allocator (it doesn't get the lua_State or the
+// old size), so the collector doesn't know about it. Instead, each time the
+// storage grows, the growth is reported to the collector as a GC step of the
+// same size, so that garbage contexts are found at a pace that matches the
+// memory they hold.
+typedef struct lualay_context {
+    lay_context ctx;
+    // lay_memory_usage() as of the last report
+    size_t reported;
+} lualay_context;
+
+static void lualay_report_memory(lua_State *L, lay_context *ctx)
+{
+    lualay_context *ud = (lualay_context*)ctx;
+    size_t usage = lay_memory_usage(ctx, NULL);
+    if (usage > ud->reported) {
+        size_t kb = (usage - ud->reported) / 1024;
+        lua_gc(L, LUA_GCSTEP, kb > (size_t)INT_MAX ? INT_MAX : (int)kb);
+    }
+    ud->reported = usage;
+}
+
 int lualay_context_new(lua_State* L)
 {
     lua_settop(L, 0);
-    lay_context *ctx = (lay_context*)lua_newuserdata(L, sizeof(lay_context));
+    lualay_context *ud = (lualay_context*)lua_newuserdata(L, sizeof(lualay_context));
+    lay_context *ctx = &ud->ctx;
     lay_init_context(ctx);
+    ud->reported = 0;
 
     luaL_getmetatable(L, "Layout");
     lua_setmetatable(L, -2);
@@ -38,7 +65,7 @@ lay_id lualay_id_check(lua_State *L, lay_context *ctx, int pos)
 {
     int n = (int)luaL_checkinteger(L, pos);
     luaL_argcheck(L, n >= 0, pos, "Item id must be non-negative");
-    luaL_argcheck(L, (lay_id)n <= ctx->count, pos, "Item id is not in valid range for layout context");
+    luaL_argcheck(L, (uint32_t)n < (uint32_t)ctx->count, pos, "Item id is not in valid range for layout context");
     return (lay_id)n;
 }
 
@@ -75,14 +102,70 @@ int lualay_reserve_items_capacity(lua_State* L)
     lay_context *ctx = lualay_context_check(L);
     int n = (int)luaL_checkinteger(L, 2);
     luaL_argcheck(L, n >= 0, 2, "Zero or positive integer capacity expected");
+    luaL_argcheck(L, (uint32_t)n <= (uint32_t)LAY_INVALID_ID, 2, "Capacity is larger than the maximum number of items");
     lay_reserve_items_capacity(ctx, (lay_id)n);
+    lualay_report_memory(L, ctx);
+    return 0;
+}
+
+// ctx:shrink() releases the unused capacity of the context, see
+// lay_shrink_to_fit().
+int lualay_shrink_to_fit(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lay_shrink_to_fit(ctx);
+    lualay_report_memory(L, ctx);
+    return 0;
+}
+
+// ctx:destroy() frees all of the context's storage right away instead of
+// waiting for the collector. The context is left empty, as if newly created,
+// and can still be used.
+int lualay_context_destroy(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lay_destroy_context(ctx);
+    lay_init_context(ctx);
+    lualay_report_memory(L, ctx);
+    return 0;
+}
+
+// ctx:memory() returns the heap size of the context in bytes, followed by the
+// items, ext, tracks, diagnostics and snapshots parts of it (see lay_memory).
+int lualay_memory_usage(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lay_memory detail;
+    size_t total = lay_memory_usage(ctx, &detail);
+    lua_settop(L, 0);
+    lua_pushnumber(L, (lua_Number)total);
+    lua_pushnumber(L, (lua_Number)detail.items);
+    lua_pushnumber(L, (lua_Number)detail.ext);
+    lua_pushnumber(L, (lua_Number)detail.tracks);
+    lua_pushnumber(L, (lua_Number)detail.diagnostics);
+    lua_pushnumber(L, (lua_Number)detail.snapshots);
+    return 6;
+}
+
+// ctx:set_trim_policy(quiet_resets), see lay_set_trim_policy(). 0 disables
+// trimming.
+int lualay_set_trim_policy(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lua_Integer n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "Zero or positive number of resets expected");
+    lay_set_trim_policy(ctx, (uint32_t)n);
     return 0;
 }
 
 int lualay_item_new(lua_State* L)
 {
     lay_context *ctx = lualay_context_check(L);
-    lua_pushinteger(L, lay_item(ctx));
+    if (lay_items_count(ctx) == LAY_INVALID_ID)
+        luaL_error(L, "Too many items in layout context");
+    lay_id item = lay_item(ctx);
+    lualay_report_memory(L, ctx);
+    lua_pushinteger(L, item);
     return 1;
 }
 
@@ -97,6 +180,8 @@ int lualay_reset_context(lua_State* L)
 {
     lay_context *ctx = lualay_context_check(L);
     lay_reset_context(ctx);
+    // The trim policy may have released storage
+    lualay_report_memory(L, ctx);
     return 0;
 }
 
@@ -161,6 +246,69 @@ int lualay_get_rect(lua_State* L)
     return 4;
 }
 
+// ctx:rects([first [, count [, out]]]) returns the rects of count items
+// starting at id first as one flat list x, y, w, h, x, y, w, h, ... so that the
+// rect of item id is at (id - first) * 4 + 1. By default it returns the rects
+// of all items. If the table out is given, it is filled and returned instead
+// of a new table, so that reading back every frame doesn't create garbage.
+int lualay_get_rects(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lua_Integer first = luaL_optinteger(L, 2, 0);
+    luaL_argcheck(L, first >= 0 && first <= (lua_Integer)ctx->count, 2, "Item id is not in valid range for layout context");
+    lua_Integer count = luaL_optinteger(L, 3, (lua_Integer)ctx->count - first);
+    luaL_argcheck(L, count >= 0 && count <= (lua_Integer)ctx->count - first, 3, "Item range is not in valid range for layout context");
+    luaL_argcheck(L, count <= INT_MAX / 4, 3, "Too many items for one table");
+    if (lua_isnoneornil(L, 4)) {
+        // The context stays on the stack, since the new table may run the
+        // collector and this call can hold the only reference to it
+        lua_settop(L, 1);
+        lua_createtable(L, (int)count * 4, 0);
+    } else {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        lua_settop(L, 4);
+    }
+    const int out = lua_gettop(L);
+    int n = 0;
+    for (lua_Integer i = first; i < first + count; ++i) {
+        lay_vec4 rect = ctx->rects[i];
+        LUALAY_PUSH_SCALAR(L, rect[0]);
+        lua_rawseti(L, out, ++n);
+        LUALAY_PUSH_SCALAR(L, rect[1]);
+        lua_rawseti(L, out, ++n);
+        LUALAY_PUSH_SCALAR(L, rect[2]);
+        lua_rawseti(L, out, ++n);
+        LUALAY_PUSH_SCALAR(L, rect[3]);
+        lua_rawseti(L, out, ++n);
+    }
+    return 1;
+}
+
+// ctx:rects_ptr() returns a light userdata pointing at the context's rect
+// array, the number of items, and the C type of one coordinate. With LuaJIT
+// the rects can then be read without copying:
+//
+//   local ptr, count, ctype = ctx:rects_ptr()
+//   local p = ffi.cast("const " .. ctype .. "*", ptr)
+//   -- item id is at p[id * 4] .. p[id * 4 + 3]
+//
+// The pointer is only valid until items are added to the context, its
+// capacity changes or it is collected, so it should be fetched again after
+// building each frame.
+int lualay_get_rects_ptr(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    lua_settop(L, 0);
+    lua_pushlightuserdata(L, (void*)ctx->rects);
+    lua_pushinteger(L, (lua_Integer)ctx->count);
+#if LAY_FLOAT == 1
+    lua_pushstring(L, "float");
+#else
+    lua_pushstring(L, "int16_t");
+#endif
+    return 3;
+}
+
 // TODO make varargs
 
 int lualay_item_contain_set(lua_State* L)
@@ -218,12 +366,160 @@ int lualay_item_first_child(lua_State* L)
     return 1;
 }
 
+// Reads a flags field of the description table on top of the stack. The field
+// can be a single flag value or a list of flags to combine, since Lua 5.1 has
+// no bitwise operators.
+static uint32_t lualay_build_flags(lua_State *L, const char *field, uint32_t mask)
+{
+    uint32_t flags = 0;
+    lua_getfield(L, -1, field);
+    if (lua_isnumber(L, -1)) {
+        flags = (uint32_t)lua_tointeger(L, -1);
+    } else if (lua_istable(L, -1)) {
+        const int n = (int)lua_objlen(L, -1);
+        for (int i = 1; i <= n; ++i) {
+            lua_rawgeti(L, -1, i);
+            if (!lua_isnumber(L, -1))
+                luaL_error(L, "`%s` must be a flag or a list of flags", field);
+            flags |= (uint32_t)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+    } else if (!lua_isnil(L, -1)) {
+        luaL_error(L, "`%s` must be a flag or a list of flags", field);
+    }
+    if ((flags & mask) != flags)
+        luaL_error(L, "Invalid `%s` flag", field);
+    lua_pop(L, 1);
+    return flags;
+}
+
+// Reads a list of count scalars from a field of the description table on top
+// of the stack. Returns false if the field is not set.
+static bool lualay_build_scalars(lua_State *L, const char *field, lay_scalar *out, int count)
+{
+    lua_getfield(L, -1, field);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return false;
+    }
+    if (!lua_istable(L, -1))
+        luaL_error(L, "`%s` must be a list of %d numbers", field, count);
+    for (int i = 0; i < count; ++i) {
+        lua_rawgeti(L, -1, i + 1);
+        if (!lua_isnumber(L, -1))
+            luaL_error(L, "`%s` must be a list of %d numbers", field, count);
+        out[i] = (lay_scalar)LUALAY_TO_SCALAR(L, -1);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+// Creates an item, and then its children, from the description table on top of
+// the stack. The ids are stored in the table at ids_idx in the order the
+// descriptions are visited.
+static lay_id lualay_build_item(lua_State *L, lay_context *ctx, int ids_idx, int *num_ids)
+{
+    luaL_checkstack(L, 4, "Layout description is nested too deeply");
+    if (!lua_istable(L, -1))
+        luaL_error(L, "Item description must be a table");
+    if (lay_items_count(ctx) == LAY_INVALID_ID)
+        luaL_error(L, "Too many items in layout context");
+
+    lay_id item = lay_item(ctx);
+    lua_pushinteger(L, (lua_Integer)item);
+    lua_rawseti(L, ids_idx, ++*num_ids);
+    lua_getfield(L, -1, "name");
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        lua_pushinteger(L, (lua_Integer)item);
+        lua_settable(L, ids_idx);
+    } else if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+    } else {
+        luaL_error(L, "`name` must be a string");
+    }
+
+    uint32_t contain = lualay_build_flags(L, "contain", LAY_ITEM_BOX_MASK);
+    if (contain)
+        lay_set_contain(ctx, item, contain);
+    uint32_t behave = lualay_build_flags(L, "behave", LAY_ITEM_LAYOUT_MASK);
+    if (behave)
+        lay_set_behave(ctx, item, behave);
+    lay_scalar values[4];
+    if (lualay_build_scalars(L, "size", values, 2))
+        lay_set_size_xy(ctx, item, values[0], values[1]);
+    if (lualay_build_scalars(L, "margins", values, 4))
+        lay_set_margins_ltrb(ctx, item, values[0], values[1], values[2], values[3]);
+
+    lua_getfield(L, -1, "children");
+    if (!lua_isnil(L, -1)) {
+        if (!lua_istable(L, -1))
+            luaL_error(L, "`children` must be a list of item descriptions");
+        // Link each child after the previous one, instead of walking the
+        // sibling list again for every lay_insert.
+        lay_id prev = LAY_INVALID_ID;
+        const int n = (int)lua_objlen(L, -1);
+        for (int i = 1; i <= n; ++i) {
+            lua_rawgeti(L, -1, i);
+            lay_id child = lualay_build_item(L, ctx, ids_idx, num_ids);
+            lua_pop(L, 1);
+            if (prev == LAY_INVALID_ID)
+                lay_insert(ctx, item, child);
+            else
+                lay_append(ctx, prev, child);
+            prev = child;
+        }
+    }
+    lua_pop(L, 1);
+    return item;
+}
+
+// ctx:build(desc [, parent]) creates a whole tree of items from a nested table
+// in a single call:
+//
+//   local ids = ctx:build{
+//       contain = Layout.COLUMN, size = {640, 480},
+//       children = {
+//           {name = "title", behave = Layout.HFILL, size = {0, 24}},
+//           {behave = {Layout.FILL}, margins = {4, 4, 4, 4}},
+//       },
+//   }
+//
+// Every field is optional. The returned table holds the new ids in depth-first
+// order, so ids[1] is the root of the new tree, and also maps each `name` to
+// its id. If parent is given, the new root is inserted into it; it must be an
+// item that already exists, which is checked before anything is built. An
+// invalid description raises an error, and the items created before it are left in
+// the context without a parent.
+int lualay_build(lua_State* L)
+{
+    lay_context *ctx = lualay_context_check(L);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lay_id parent = LAY_INVALID_ID;
+    if (!lua_isnoneornil(L, 3))
+        parent = lualay_id_check(L, ctx, 3);
+    lua_settop(L, 2);
+    lua_newtable(L);
+    lua_pushvalue(L, 2);
+    int num_ids = 0;
+    lay_id root = lualay_build_item(L, ctx, 3, &num_ids);
+    lua_pop(L, 1);
+    if (parent != LAY_INVALID_ID)
+        lay_insert(ctx, parent, root);
+    lualay_report_memory(L, ctx);
+    return 1;
+}
+
 static const struct luaL_reg laylib[] = {
     {"new", lualay_context_new},
     {"run", lualay_run_context},
     {"reset", lualay_reset_context},
     {"capacity", lualay_context_capacity},
     {"reserve", lualay_reserve_items_capacity},
+    {"shrink", lualay_shrink_to_fit},
+    {"destroy", lualay_context_destroy},
+    {"memory", lualay_memory_usage},
+    {"set_trim_policy", lualay_set_trim_policy},
     {"item", lualay_item_new},
     {"insert", lualay_item_insert},
     {"append", lualay_item_append},
@@ -233,8 +529,11 @@ static const struct luaL_reg laylib[] = {
     {"set_contain", lualay_item_contain_set},
     {"set_behave", lualay_item_behave_set},
     {"rect", lualay_get_rect},
+    {"rects", lualay_get_rects},
+    {"rects_ptr", lualay_get_rects_ptr},
     {"next_sibling", lualay_item_next_sibling},
     {"first_child", lualay_item_first_child},
+    {"build", lualay_build},
     {"__gc", lualay_context_gc},
     {NULL, NULL}
 };
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #define LAY_IMPLEMENTATION
 #include "layout.h"
 
@@ -251,6 +252,107 @@ LTEST_DECLARE(row_even_fill)
     LTEST_VEC4EQ(lay_get_rect(ctx, child_c), 60, 2, 30, 1);
 }
 
+#ifndef LAY_FLOAT
+// The integer build works out positions exactly and truncates them, which is
+// what converting float positions to integers did before, minus the float
+// rounding errors. The float build keeps the fractions.
+LTEST_DECLARE(row_uneven_fill)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 10, 1);
+    lay_set_contain(ctx, root, LAY_ROW);
+
+    lay_id children[3];
+    for (int i = 0; i < 3; ++i) {
+        children[i] = lay_item(ctx);
+        lay_set_behave(ctx, children[i], LAY_HFILL);
+        lay_set_size_xy(ctx, children[i], 0, 1);
+        lay_insert(ctx, root, children[i]);
+    }
+
+    lay_run_context(ctx);
+
+    // Edges are at floor(k * 10 / 3), so the last filler gets the remainder.
+    // Truncating float positions gives the same result here, but summing 10/3
+    // in float can end just below 10 for other sizes.
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[0]), 0, 0, 3, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[1]), 3, 0, 3, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[2]), 6, 0, 4, 1);
+}
+
+LTEST_DECLARE(justify_uneven)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 37, 1);
+    lay_set_contain(ctx, root, LAY_ROW | LAY_JUSTIFY);
+
+    lay_id children[3];
+    for (int i = 0; i < 3; ++i) {
+        children[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, children[i], 10, 1);
+        lay_insert(ctx, root, children[i]);
+    }
+
+    lay_run_context(ctx);
+
+    // 7 units of spacing over 2 gaps: the middle item sits at 13.5, which is
+    // truncated, but it keeps its width
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[0]), 0, 0, 10, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[1]), 13, 0, 10, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[2]), 27, 0, 10, 1);
+}
+
+LTEST_DECLARE(squeeze_uneven)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 20, 1);
+    lay_set_contain(ctx, root, LAY_ROW);
+
+    // Squeezable children: sized by their contents instead of explicitly
+    lay_id children[3];
+    for (int i = 0; i < 3; ++i) {
+        children[i] = lay_item(ctx);
+        lay_insert(ctx, root, children[i]);
+        lay_id inner = lay_item(ctx);
+        lay_set_size_xy(ctx, inner, 9, 1);
+        lay_insert(ctx, children[i], inner);
+    }
+
+    lay_run_context(ctx);
+
+    // 27 units squeezed into 20: each child loses 7/3
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[0]), 0, 0, 6, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[1]), 6, 0, 7, 1);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[2]), 13, 0, 7, 1);
+}
+
+// The edges of n fillers in a row of width w are always at floor(k * w / n), and
+// the last one always ends at w.
+LTEST_DECLARE(row_fill_exact)
+{
+    lay_id children[13];
+    for (int16_t n = 1; n <= 13; ++n) {
+        lay_reset_context(ctx);
+        lay_id root = lay_item(ctx);
+        lay_set_contain(ctx, root, LAY_ROW);
+        for (int16_t i = 0; i < n; ++i) {
+            children[i] = lay_item(ctx);
+            lay_set_behave(ctx, children[i], LAY_HFILL);
+            lay_insert(ctx, root, children[i]);
+        }
+        for (int16_t w = 0; w < 400; w += 7) {
+            lay_set_size_xy(ctx, root, w, 1);
+            lay_run_context(ctx);
+            for (int16_t i = 0; i < n; ++i) {
+                lay_vec4 r = lay_get_rect(ctx, children[i]);
+                LTEST_TRUE(r[0] == i * w / n);
+                LTEST_TRUE(r[0] + r[2] == (i + 1) * w / n);
+            }
+        }
+    }
+}
+#endif
+
 LTEST_DECLARE(fixed_and_fill)
 {
     lay_id root = lay_item(ctx);
@@ -886,6 +988,101 @@ LTEST_DECLARE(wrap_column_4)
     free(items);
 }
 
+// Re-running a wrapping container after changing its size should give the same
+// result as laying it out from scratch, without clearing any breaks first.
+LTEST_DECLARE(wrap_row_rerun)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 50, 50);
+    lay_set_contain(ctx, root, LAY_ROW | LAY_WRAP | LAY_START);
+
+    const int16_t num_items = 5 * 5;
+    lay_id *items = (lay_id*)calloc(num_items, sizeof(lay_id));
+
+    for (int16_t i = 0; i < num_items; ++i) {
+        lay_id item = lay_item(ctx);
+        lay_set_size_xy(ctx, item, 10, 10);
+        lay_insert(ctx, root, item);
+        items[i] = item;
+    }
+
+    lay_run_context(ctx);
+
+    // Layout must not have written any break flags into the children
+    for (int16_t i = 0; i < num_items; ++i) {
+        LTEST_FALSE(lay_get_item(ctx, items[i])->flags & LAY_BREAK);
+    }
+
+    // Narrower: 3 items per line
+    lay_set_size_xy(ctx, root, 30, 90);
+    lay_run_context(ctx);
+    for (int16_t i = 0; i < num_items; ++i) {
+        int16_t x, y;
+        x = i % 3;
+        y = i / 3;
+        LTEST_VEC4EQ(lay_get_rect(ctx, items[i]), x * 10, y * 10, 10, 10);
+    }
+
+    // And back to 5 items per line
+    lay_set_size_xy(ctx, root, 50, 50);
+    lay_run_context(ctx);
+    for (int16_t i = 0; i < num_items; ++i) {
+        int16_t x, y;
+        x = i % 5;
+        y = i / 5;
+        LTEST_VEC4EQ(lay_get_rect(ctx, items[i]), x * 10, y * 10, 10, 10);
+    }
+
+    free(items);
+}
+
+LTEST_DECLARE(wrap_lines)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 50, 60);
+    lay_set_contain(ctx, root, LAY_ROW | LAY_WRAP | LAY_START);
+
+    const int16_t num_items = 5 * 5;
+    lay_id *items = (lay_id*)calloc(num_items, sizeof(lay_id));
+
+    for (int16_t i = 0; i < num_items; ++i) {
+        lay_id item = lay_item(ctx);
+        lay_set_size_xy(ctx, item, 10, 10);
+        lay_insert(ctx, root, item);
+        items[i] = item;
+    }
+    // Manual break in the middle of the second line
+    lay_set_behave(ctx, items[7], LAY_BREAK);
+
+    // Run twice to make sure the line table doesn't accumulate anything
+    lay_run_context(ctx);
+    lay_run_context(ctx);
+
+    const int16_t expected_starts[] = {0, 5, 7, 12, 17, 22};
+    const int16_t num_lines = sizeof(expected_starts) / sizeof(expected_starts[0]);
+    int16_t line = 0;
+    for (lay_id start = lay_first_line(ctx, root);
+            start != LAY_INVALID_ID;
+            start = lay_next_line(ctx, start)) {
+        LTEST_TRUE(line < num_lines);
+        LTEST_TRUE(start == items[expected_starts[line]]);
+        ++line;
+    }
+    LTEST_TRUE(line == num_lines);
+
+    // Items after the manual break start a new line at the left edge
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[6]), 10, 10, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[7]), 0, 20, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[24]), 20, 50, 10, 10);
+
+    // The manual break is still there, and it's the only one
+    for (int16_t i = 0; i < num_items; ++i) {
+        LTEST_TRUE(!!(lay_get_item(ctx, items[i])->flags & LAY_BREAK) == (i == 7));
+    }
+
+    free(items);
+}
+
 LTEST_DECLARE(anchor_right_margin1)
 {
     lay_id root = lay_item(ctx);
@@ -920,6 +1117,889 @@ LTEST_DECLARE(anchor_right_margin2)
     LTEST_VEC4EQ(lay_get_rect(ctx, child), 40, 40, 50, 50);
 }
 
+LTEST_DECLARE(min_max_size)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 100);
+
+    // Explicit size is clamped to the max size
+    lay_id fixed = lay_item(ctx);
+    lay_set_size_xy(ctx, fixed, 50, 50);
+    lay_set_max_size_xy(ctx, fixed, 30, 0);
+    lay_insert(ctx, root, fixed);
+
+    // Size from children is raised to the min size
+    lay_id parent = lay_item(ctx);
+    lay_set_min_size_xy(ctx, parent, 40, 0);
+    lay_set_behave(ctx, parent, LAY_LEFT | LAY_TOP);
+    lay_insert(ctx, root, parent);
+    lay_id child = lay_item(ctx);
+    lay_set_size_xy(ctx, child, 10, 10);
+    lay_insert(ctx, parent, child);
+
+    // Filling a free layout item stops at the max size
+    lay_id filler = lay_item(ctx);
+    lay_set_behave(ctx, filler, LAY_FILL);
+    lay_set_max_size_xy(ctx, filler, 50, 0);
+    lay_insert(ctx, root, filler);
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, fixed), 35, 25, 30, 50);
+    LTEST_VEC4EQ(lay_get_rect(ctx, parent), 0, 0, 40, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, filler), 0, 0, 50, 100);
+
+    lay_vec2 min_size = lay_get_min_size(ctx, parent);
+    lay_vec2 max_size = lay_get_max_size(ctx, parent);
+    LTEST_TRUE(min_size[0] == 40 && min_size[1] == 0);
+    LTEST_TRUE(max_size[0] == 0 && max_size[1] == 0);
+    max_size = lay_get_max_size(ctx, root);
+    LTEST_TRUE(max_size[0] == 0 && max_size[1] == 0);
+}
+
+LTEST_DECLARE(fill_min_max)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 20);
+    lay_set_contain(ctx, root, LAY_COLUMN);
+
+    lay_id rows[4];
+    lay_id cells[4][3];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, rows[i], 0, 5);
+        lay_set_behave(ctx, rows[i], LAY_HFILL);
+        lay_set_contain(ctx, rows[i], LAY_ROW);
+        lay_insert(ctx, root, rows[i]);
+        for (int j = 0; j < 3; ++j) {
+            cells[i][j] = lay_item(ctx);
+            lay_set_behave(ctx, cells[i][j], LAY_FILL);
+            lay_insert(ctx, rows[i], cells[i][j]);
+        }
+    }
+    // Space that a filler can't take goes to the other fillers
+    lay_set_max_size_xy(ctx, cells[0][0], 20, 0);
+    lay_set_min_size_xy(ctx, cells[1][1], 60, 0);
+    // Everything at max size: the rest of the row stays empty
+    lay_set_max_size_xy(ctx, cells[2][0], 30, 0);
+    lay_set_max_size_xy(ctx, cells[2][1], 30, 0);
+    lay_set_max_size_xy(ctx, cells[2][2], 10, 0);
+    // Both ends constrained
+    lay_set_min_size_xy(ctx, cells[3][0], 50, 0);
+    lay_set_max_size_xy(ctx, cells[3][2], 14, 0);
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][0]), 0, 0, 20, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][1]), 20, 0, 40, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][2]), 60, 0, 40, 5);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][0]), 0, 5, 20, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][1]), 20, 5, 60, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][2]), 80, 5, 20, 5);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2][0]), 0, 10, 30, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2][1]), 30, 10, 30, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2][2]), 60, 10, 10, 5);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[3][0]), 0, 15, 50, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[3][1]), 50, 15, 36, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[3][2]), 86, 15, 14, 5);
+}
+
+LTEST_DECLARE(squeeze_min)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 21, 20);
+    lay_set_contain(ctx, root, LAY_ROW);
+
+    lay_id children[3];
+    for (int i = 0; i < 3; ++i) {
+        children[i] = lay_item(ctx);
+        lay_set_behave(ctx, children[i], LAY_TOP);
+        lay_insert(ctx, root, children[i]);
+        lay_id inner = lay_item(ctx);
+        lay_set_size_xy(ctx, inner, 10, 40);
+        lay_insert(ctx, children[i], inner);
+    }
+    // Not squeezed below its min width, or its min height by the row
+    lay_set_min_size_xy(ctx, children[0], 10, 30);
+    // Squeezed by the row, then raised back up
+    lay_set_min_size_xy(ctx, children[1], 0, 25);
+
+    lay_run_context(ctx);
+
+    // The other two are squeezed by their share only, so the row overflows
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[0]), 0, 0, 10, 30);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[1]), 10, 0, 7, 25);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[2]), 17, 0, 7, 20);
+}
+
+LTEST_DECLARE(grid_tracks)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 201, 0);
+    lay_set_contain(ctx, root, LAY_GRID);
+    const lay_track columns[] = {
+        {LAY_TRACK_FIXED, 30},
+        {LAY_TRACK_AUTO, 0},
+        {LAY_TRACK_FILL, 0},
+        {LAY_TRACK_FILL, 0},
+    };
+    lay_set_grid_columns(ctx, root, columns, 4);
+
+    static const lay_scalar sizes[8][2] = {
+        {10, 10}, {21, 11}, {0, 15}, {5, 5},
+        {10, 20}, {40, 10}, {10, 10}, {11, 10},
+    };
+    static const uint32_t behaves[8] = {
+        LAY_FILL, LAY_CENTER, LAY_HFILL | LAY_TOP, LAY_RIGHT | LAY_BOTTOM,
+        LAY_LEFT | LAY_TOP, LAY_LEFT | LAY_TOP, LAY_FILL, LAY_CENTER,
+    };
+    lay_id cells[8];
+    for (int i = 0; i < 8; ++i) {
+        cells[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, cells[i], sizes[i][0], sizes[i][1]);
+        lay_set_behave(ctx, cells[i], behaves[i]);
+        lay_insert(ctx, root, cells[i]);
+    }
+    // The auto column is as wide as this cell and its margins
+    lay_set_margins_ltrb(ctx, cells[5], 2, 0, 3, 0);
+
+    lay_run_context(ctx);
+
+    // Columns are 30, 45, 63 and 63 wide, rows are 15 and 20 tall
+    LTEST_VEC4EQ(lay_get_rect(ctx, root), 0, 0, 201, 35);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0]), 0, 0, 30, 15);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1]), 42, 2, 21, 11);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2]), 75, 0, 63, 15);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[3]), 196, 10, 5, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[4]), 0, 15, 10, 20);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[5]), 32, 15, 40, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[6]), 75, 15, 63, 20);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[7]), 164, 20, 11, 10);
+
+    lay_vec2 column = lay_get_grid_column(ctx, root, 3);
+    LTEST_TRUE(column[0] == 138 && column[1] == 63);
+
+    // Each row is a line
+    LTEST_TRUE(lay_first_line(ctx, root) == cells[0]);
+    LTEST_TRUE(lay_next_line(ctx, cells[0]) == cells[4]);
+    LTEST_TRUE(lay_next_line(ctx, cells[4]) == LAY_INVALID_ID);
+
+    // Setting the columns again, as an app might on every resize, reuses the
+    // item's tracks instead of adding more, even when they aren't the last
+    lay_id other = lay_item(ctx);
+    lay_set_grid_columns(ctx, other, columns, 2);
+    lay_memory memory;
+    lay_memory_usage(ctx, &memory);
+    const size_t tracks_bytes = memory.tracks;
+    lay_track wider[4];
+    for (int i = 0; i < 100; ++i) {
+        for (int c = 0; c < 4; ++c)
+            wider[c] = columns[c];
+        wider[0].size = (lay_scalar)(30 + i % 10);
+        lay_set_grid_columns(ctx, root, wider, 4);
+    }
+    lay_set_grid_columns(ctx, root, columns + 2, 2);
+    lay_memory_usage(ctx, &memory);
+    LTEST_TRUE(memory.tracks == tracks_bytes);
+
+    // Two fill columns now
+    lay_run_context(ctx);
+    column = lay_get_grid_column(ctx, root, 1);
+    LTEST_TRUE(column[0] + column[1] == 201 && column[0] >= 100);
+}
+
+LTEST_DECLARE(grid_auto_size)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 100);
+
+    lay_id grid = lay_item(ctx);
+    lay_set_contain(ctx, grid, LAY_GRID);
+    lay_set_behave(ctx, grid, LAY_LEFT | LAY_TOP);
+    const lay_track columns[] = {
+        {LAY_TRACK_AUTO, 0},
+        {LAY_TRACK_FIXED, 10},
+    };
+    lay_set_grid_columns(ctx, grid, columns, 2);
+    lay_insert(ctx, root, grid);
+
+    // Single column, without any column definitions
+    lay_id list = lay_item(ctx);
+    lay_set_contain(ctx, list, LAY_GRID);
+    lay_set_behave(ctx, list, LAY_RIGHT | LAY_TOP);
+    lay_insert(ctx, root, list);
+
+    static const lay_scalar sizes[3][2] = {{20, 5}, {3, 7}, {8, 4}};
+    lay_id cells[3];
+    lay_id entries[3];
+    for (int i = 0; i < 3; ++i) {
+        cells[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, cells[i], sizes[i][0], sizes[i][1]);
+        lay_set_behave(ctx, cells[i], LAY_LEFT | LAY_TOP);
+        lay_insert(ctx, grid, cells[i]);
+        entries[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, entries[i], sizes[i][0], sizes[i][1]);
+        lay_set_behave(ctx, entries[i], LAY_HFILL | LAY_TOP);
+        lay_insert(ctx, list, entries[i]);
+    }
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, grid), 0, 0, 30, 11);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0]), 0, 0, 20, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1]), 20, 0, 3, 7);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2]), 0, 7, 8, 4);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, list), 80, 0, 20, 16);
+    LTEST_VEC4EQ(lay_get_rect(ctx, entries[0]), 80, 0, 20, 5);
+    LTEST_VEC4EQ(lay_get_rect(ctx, entries[1]), 80, 5, 20, 7);
+    LTEST_VEC4EQ(lay_get_rect(ctx, entries[2]), 80, 12, 20, 4);
+}
+
+LTEST_DECLARE(gap_stacked)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 100);
+    lay_set_contain(ctx, root, LAY_COLUMN | LAY_START);
+    lay_set_gap(ctx, root, 4, 0);
+
+    lay_id row = lay_item(ctx);
+    lay_set_size_xy(ctx, row, 0, 10);
+    lay_set_behave(ctx, row, LAY_HFILL);
+    lay_set_contain(ctx, row, LAY_ROW | LAY_START);
+    lay_set_gap(ctx, row, 5, 0);
+    lay_insert(ctx, root, row);
+
+    lay_id fill_row = lay_item(ctx);
+    lay_set_size_xy(ctx, fill_row, 0, 10);
+    lay_set_behave(ctx, fill_row, LAY_HFILL);
+    lay_set_contain(ctx, fill_row, LAY_ROW);
+    lay_set_gap(ctx, fill_row, 10, 0);
+    lay_insert(ctx, root, fill_row);
+
+    // Sized by its children and the gaps between them
+    lay_id column = lay_item(ctx);
+    lay_set_contain(ctx, column, LAY_COLUMN);
+    lay_set_gap(ctx, column, 3, 0);
+    lay_insert(ctx, root, column);
+
+    lay_id items[3], fillers[2], cells[3];
+    for (int i = 0; i < 3; ++i) {
+        items[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, items[i], 10, 10);
+        lay_insert(ctx, row, items[i]);
+        cells[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, cells[i], 10, 10);
+        lay_insert(ctx, column, cells[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        fillers[i] = lay_item(ctx);
+        lay_set_behave(ctx, fillers[i], LAY_FILL);
+        lay_insert(ctx, fill_row, fillers[i]);
+    }
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[0]), 0, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[1]), 15, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, items[2]), 30, 0, 10, 10);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, fill_row), 0, 14, 100, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, fillers[0]), 0, 14, 45, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, fillers[1]), 55, 14, 45, 10);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, column), 45, 28, 10, 36);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2]), 45, 54, 10, 10);
+
+    lay_vec2 gap = lay_get_gap(ctx, fill_row);
+    LTEST_TRUE(gap[0] == 10 && gap[1] == 0);
+}
+
+LTEST_DECLARE(gap_wrapped)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 100);
+
+    lay_id row = lay_item(ctx);
+    lay_set_size_xy(ctx, row, 50, 0);
+    lay_set_behave(ctx, row, LAY_LEFT | LAY_TOP);
+    lay_set_contain(ctx, row, LAY_ROW | LAY_WRAP | LAY_START);
+    lay_set_gap(ctx, row, 5, 3);
+    lay_insert(ctx, root, row);
+
+    lay_id column = lay_item(ctx);
+    lay_set_size_xy(ctx, column, 0, 50);
+    // Wrapped columns only know their width after the vertical pass, so
+    // anchor this one to the left.
+    lay_set_behave(ctx, column, LAY_LEFT | LAY_TOP);
+    lay_set_margins_ltrb(ctx, column, 60, 0, 0, 0);
+    lay_set_contain(ctx, column, LAY_COLUMN | LAY_WRAP | LAY_START);
+    lay_set_gap(ctx, column, 5, 3);
+    lay_insert(ctx, root, column);
+
+    // Three 10x10 items and two gaps fit in 50, four don't
+    lay_id row_items[7], column_items[7];
+    for (int i = 0; i < 7; ++i) {
+        row_items[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, row_items[i], 10, 10);
+        lay_insert(ctx, row, row_items[i]);
+        column_items[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, column_items[i], 10, 10);
+        lay_insert(ctx, column, column_items[i]);
+    }
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, row), 0, 0, 50, 36);
+    LTEST_VEC4EQ(lay_get_rect(ctx, row_items[2]), 30, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, row_items[3]), 0, 13, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, row_items[6]), 0, 26, 10, 10);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, column), 60, 0, 36, 50);
+    LTEST_VEC4EQ(lay_get_rect(ctx, column_items[2]), 60, 30, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, column_items[3]), 73, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, column_items[6]), 86, 0, 10, 10);
+}
+
+LTEST_DECLARE(gap_grid)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_contain(ctx, root, LAY_GRID);
+    lay_set_gap(ctx, root, 2, 3);
+    const lay_track columns[] = {
+        {LAY_TRACK_FIXED, 10},
+        {LAY_TRACK_FIXED, 10},
+    };
+    lay_set_grid_columns(ctx, root, columns, 2);
+
+    lay_id cells[4];
+    for (int i = 0; i < 4; ++i) {
+        cells[i] = lay_item(ctx);
+        lay_set_behave(ctx, cells[i], LAY_FILL);
+        lay_set_size_xy(ctx, cells[i], 0, 10);
+        lay_insert(ctx, root, cells[i]);
+    }
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, root), 0, 0, 22, 23);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1]), 12, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2]), 0, 13, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[3]), 12, 13, 10, 10);
+}
+
+LTEST_DECLARE(weighted_fill)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 30);
+    lay_set_contain(ctx, root, LAY_COLUMN);
+
+    lay_id rows[3];
+    for (int i = 0; i < 3; ++i) {
+        rows[i] = lay_item(ctx);
+        lay_set_size_xy(ctx, rows[i], 0, 10);
+        lay_set_behave(ctx, rows[i], LAY_HFILL);
+        lay_set_contain(ctx, rows[i], LAY_ROW);
+        lay_insert(ctx, root, rows[i]);
+    }
+
+    lay_id cells[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < (i == 2 ? 2 : 3); ++j) {
+            cells[i][j] = lay_item(ctx);
+            lay_set_behave(ctx, cells[i][j], LAY_FILL);
+            lay_insert(ctx, rows[i], cells[i][j]);
+        }
+    }
+    // 1:3:1
+    lay_set_weights(ctx, cells[0][1], 3, 1);
+    // 1:2:1, but the middle one stops at 40
+    lay_set_weights(ctx, cells[1][1], 2, 1);
+    lay_set_max_size_xy(ctx, cells[1][1], 40, 0);
+    // A filler that doesn't grow past its min size
+    lay_set_weights(ctx, cells[2][0], 0, 1);
+    lay_set_min_size_xy(ctx, cells[2][0], 10, 0);
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][0]), 0, 0, 20, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][1]), 20, 0, 60, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[0][2]), 80, 0, 20, 10);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][0]), 0, 10, 30, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][1]), 30, 10, 40, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[1][2]), 70, 10, 30, 10);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2][0]), 0, 20, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, cells[2][1]), 10, 20, 90, 10);
+
+    uint16_t grow, shrink;
+    lay_get_weights(ctx, cells[1][1], &grow, &shrink);
+    LTEST_TRUE(grow == 2 && shrink == 1);
+    lay_get_weights(ctx, cells[1][0], &grow, &shrink);
+    LTEST_TRUE(grow == 1 && shrink == 1);
+}
+
+LTEST_DECLARE(weighted_shrink)
+{
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 60, 10);
+    lay_set_contain(ctx, root, LAY_ROW);
+
+    lay_id children[3];
+    for (int i = 0; i < 3; ++i) {
+        children[i] = lay_item(ctx);
+        lay_set_behave(ctx, children[i], LAY_TOP);
+        lay_insert(ctx, root, children[i]);
+        lay_id inner = lay_item(ctx);
+        lay_set_size_xy(ctx, inner, 30, 10);
+        lay_insert(ctx, children[i], inner);
+    }
+    // The row is 30 short, taken 1:2:0
+    lay_set_weights(ctx, children[1], 1, 2);
+    lay_set_weights(ctx, children[2], 1, 0);
+
+    lay_run_context(ctx);
+
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[0]), 0, 0, 20, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[1]), 20, 0, 10, 10);
+    LTEST_VEC4EQ(lay_get_rect(ctx, children[2]), 30, 0, 30, 10);
+}
+
+// Builds a row of `count` children in a grid, so that every buffer is in use
+static void build_memory_tree(lay_context *mctx, lay_id count)
+{
+    const lay_track columns[] = {
+        {LAY_TRACK_FIXED, 10},
+        {LAY_TRACK_FILL, 0},
+    };
+    lay_id root = lay_item(mctx);
+    lay_set_size_xy(mctx, root, 100, 0);
+    lay_set_contain(mctx, root, LAY_GRID);
+    lay_set_grid_columns(mctx, root, columns, 2);
+    for (lay_id i = 0; i < count; ++i) {
+        lay_id child = lay_item(mctx);
+        lay_set_size_xy(mctx, child, 0, 10);
+        lay_set_behave(mctx, child, LAY_HFILL);
+        lay_insert(mctx, root, child);
+    }
+}
+
+LTEST_DECLARE(memory_shrink)
+{
+    // A fresh context, so that the buffers start out empty
+    (void)ctx;
+    lay_context mctx;
+    lay_init_context(&mctx);
+    lay_memory memory;
+    LTEST_TRUE(lay_memory_usage(&mctx, &memory) == 0);
+    LTEST_TRUE(memory.items == 0 && memory.ext == 0 && memory.tracks == 0);
+
+    build_memory_tree(&mctx, 999);
+    size_t total = lay_memory_usage(&mctx, &memory);
+    LTEST_TRUE(total == memory.items + memory.ext + memory.tracks + memory.diagnostics + memory.snapshots);
+    LTEST_TRUE(memory.items > 0 && memory.ext > 0 && memory.tracks > 0);
+    const size_t item_bytes = memory.items / mctx.capacity;
+
+    // Shrinking keeps the items, and the layout can be run again
+    lay_shrink_to_fit(&mctx);
+    lay_memory_usage(&mctx, &memory);
+    LTEST_TRUE(memory.items == 1000 * item_bytes);
+    LTEST_TRUE(lay_memory_usage(&mctx, NULL) <= total);
+    lay_run_context(&mctx);
+    LTEST_VEC4EQ(lay_get_rect(&mctx, 999), 0, 4990, 10, 10);
+
+    // Without items, everything is released
+    lay_reset_context(&mctx);
+    lay_shrink_to_fit(&mctx);
+    LTEST_TRUE(lay_memory_usage(&mctx, &memory) == memory.diagnostics);
+    build_memory_tree(&mctx, 3);
+    lay_run_context(&mctx);
+    LTEST_VEC4EQ(lay_get_rect(&mctx, 2), 10, 0, 90, 10);
+
+    // After a spike, the trim policy gives memory back once the context has
+    // been reset three times in a row with few items
+    lay_set_trim_policy(&mctx, 3);
+    lay_reset_context(&mctx);
+    build_memory_tree(&mctx, 999);
+    lay_reset_context(&mctx);
+    const size_t spike = lay_memory_usage(&mctx, NULL);
+    for (int i = 0; i < 2; ++i) {
+        build_memory_tree(&mctx, 19);
+        lay_reset_context(&mctx);
+        LTEST_TRUE(lay_memory_usage(&mctx, NULL) == spike);
+    }
+    build_memory_tree(&mctx, 19);
+    lay_reset_context(&mctx);
+    lay_memory_usage(&mctx, &memory);
+    LTEST_TRUE(memory.items == 40 * item_bytes);
+    LTEST_TRUE(lay_memory_usage(&mctx, NULL) < spike);
+
+    // A busy reset in between starts the count over
+    static const lay_id counts[] = {9, 9, 15, 9, 9};
+    for (int i = 0; i < 5; ++i) {
+        build_memory_tree(&mctx, counts[i]);
+        lay_reset_context(&mctx);
+    }
+    lay_memory_usage(&mctx, &memory);
+    LTEST_TRUE(memory.items == 40 * item_bytes);
+    build_memory_tree(&mctx, 9);
+    lay_reset_context(&mctx);
+    lay_memory_usage(&mctx, &memory);
+    LTEST_TRUE(memory.items == 32 * item_bytes);
+
+    lay_destroy_context(&mctx);
+}
+
+LTEST_DECLARE(copy_context)
+{
+    build_memory_tree(ctx, 99);
+    lay_run_context(ctx);
+
+    // A copy lays out the same, into a context that had other items
+    lay_context copy;
+    lay_init_context(&copy);
+    build_memory_tree(&copy, 3);
+    lay_copy_context(&copy, ctx);
+    LTEST_TRUE(lay_items_count(&copy) == 100);
+    lay_run_context(&copy);
+    for (lay_id i = 0; i < 100; ++i) {
+        lay_vec4 r = lay_get_rect(ctx, i);
+        LTEST_VEC4EQ(lay_get_rect(&copy, i), r[0], r[1], r[2], r[3]);
+    }
+
+    // Changing one afterwards doesn't change the other
+    lay_set_size_xy(ctx, 0, 50, 0);
+    lay_set_min_size_xy(ctx, 5, 0, 30);
+    lay_run_context(ctx);
+    lay_run_context(&copy);
+    LTEST_VEC4EQ(lay_get_rect(ctx, 98), 10, 500, 40, 10);
+    LTEST_VEC4EQ(lay_get_rect(&copy, 98), 10, 480, 90, 10);
+    LTEST_VEC4EQ(lay_get_rect(&copy, 5), 0, 20, 10, 10);
+
+    lay_destroy_context(&copy);
+}
+
+#ifdef LAY_RECORD
+LTEST_DECLARE(record_replay)
+{
+    lay_record_start(ctx);
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 200, 100);
+    lay_set_contain(ctx, root, LAY_ROW);
+    lay_set_gap(ctx, root, 3, 0);
+    lay_id children[4];
+    for (int i = 0; i < 4; ++i) {
+        children[i] = lay_item(ctx);
+        lay_set_behave(ctx, children[i], LAY_FILL);
+        lay_set_margins_ltrb(ctx, children[i], 1, -2, 1, 2);
+        if (i == 0)
+            lay_insert(ctx, root, children[i]);
+        else
+            lay_append(ctx, children[i - 1], children[i]);
+    }
+    lay_set_weights(ctx, children[1], 2, 1);
+    lay_set_min_size_xy(ctx, children[2], 40, 0);
+    lay_set_contain(ctx, children[3], LAY_GRID);
+    const lay_track columns[] = {
+        {LAY_TRACK_FIXED, 10},
+        {LAY_TRACK_FILL, 0},
+    };
+    lay_set_grid_columns(ctx, children[3], columns, 2);
+    lay_id cell = lay_item(ctx);
+    lay_set_size_xy(ctx, cell, 5, 7);
+    lay_push(ctx, children[3], cell);
+    lay_run_context(ctx);
+    lay_record_stop(ctx);
+    // Not recorded
+    lay_set_size_xy(ctx, root, 1, 1);
+    lay_set_size_xy(ctx, root, 200, 100);
+
+    size_t size;
+    const uint8_t *trace = lay_record_data(ctx, &size);
+    lay_context replayed;
+    lay_init_context(&replayed);
+    size_t offset;
+    LTEST_TRUE(lay_replay_begin(trace, size, &offset) == 0);
+    int op, calls = 0, runs = 0;
+    while ((op = lay_replay_next(&replayed, trace, size, &offset)) > 0) {
+        ++calls;
+        if (op == LAY_RECORD_RUN_CONTEXT)
+            ++runs;
+    }
+    LTEST_TRUE(op == LAY_RECORD_END && runs == 1);
+    LTEST_TRUE(calls == 28);
+    LTEST_TRUE(lay_items_count(&replayed) == lay_items_count(ctx));
+    for (lay_id i = 0; i < lay_items_count(ctx); ++i) {
+        lay_vec4 a = lay_get_rect(ctx, i);
+        lay_vec4 b = lay_get_rect(&replayed, i);
+        LTEST_VEC4EQ(a, b[0], b[1], b[2], b[3]);
+    }
+
+    // A truncated trace fails at the call that's cut off: here, the last
+    // child id of lay_push, before the 1 byte lay_run_context call.
+    lay_reset_context(&replayed);
+    LTEST_TRUE(lay_replay_begin(trace, size - 2, &offset) == 0);
+    while ((op = lay_replay_next(&replayed, trace, size - 2, &offset)) > 0) {}
+    LTEST_TRUE(op == -1);
+    LTEST_TRUE(lay_replay_begin(trace, 3, &offset) == -1);
+
+    // Inserting an item into its own child would make a cycle, which the
+    // lay_run_item after it would recurse into forever
+    static const uint8_t cycle[] = {
+        'L', 'A', 'Y', 'T', LAY_RECORD_VERSION, 0,
+        LAY_RECORD_ITEM, LAY_RECORD_ITEM, LAY_RECORD_ITEM,
+        LAY_RECORD_INSERT, 1, 2,
+        LAY_RECORD_INSERT, 2, 1,
+        LAY_RECORD_RUN_ITEM, 1,
+    };
+    lay_reset_context(&replayed);
+    LTEST_TRUE(lay_replay_begin(cycle, sizeof(cycle), &offset) == 0);
+    calls = 0;
+    while ((op = lay_replay_next(&replayed, cycle, sizeof(cycle), &offset)) > 0)
+        ++calls;
+    LTEST_TRUE(op == -1 && calls == 4);
+    LTEST_TRUE(lay_first_child(&replayed, 2) == LAY_INVALID_ID);
+    lay_destroy_context(&replayed);
+}
+#endif
+
+#ifdef LAY_STATS
+LTEST_DECLARE(work_stats)
+{
+    // A fresh context, so that the allocations are counted
+    (void)ctx;
+    lay_context sctx;
+    lay_init_context(&sctx);
+    lay_id root = lay_item(&sctx);
+    lay_set_size_xy(&sctx, root, 100, 60);
+    lay_set_contain(&sctx, root, LAY_COLUMN);
+
+    lay_id row = lay_item(&sctx);
+    lay_insert(&sctx, root, row);
+    lay_set_size_xy(&sctx, row, 0, 20);
+    lay_set_behave(&sctx, row, LAY_HFILL);
+    lay_set_contain(&sctx, row, LAY_ROW);
+    lay_id filler = lay_item(&sctx);
+    lay_insert(&sctx, row, filler);
+    lay_set_behave(&sctx, filler, LAY_FILL);
+    lay_set_min_size_xy(&sctx, filler, 10, 0);
+    lay_id fixed = lay_item(&sctx);
+    lay_insert(&sctx, row, fixed);
+    lay_set_size_xy(&sctx, fixed, 30, 10);
+
+    lay_id wrap = lay_item(&sctx);
+    lay_insert(&sctx, root, wrap);
+    lay_set_size_xy(&sctx, wrap, 70, 40);
+    lay_set_contain(&sctx, wrap, LAY_ROW | LAY_WRAP);
+    for (int i = 0; i < 4; ++i) {
+        lay_id child = lay_item(&sctx);
+        lay_set_size_xy(&sctx, child, 30, 10);
+        // The third and fourth have 1 and 2 siblings to step over
+        lay_insert(&sctx, wrap, child);
+    }
+    lay_run_context(&sctx);
+
+    lay_stats stats;
+    lay_get_stats(&sctx, &stats);
+    for (int i = 0; i < 4; ++i)
+        LTEST_TRUE(stats.items_visited[i] == 9);
+    LTEST_TRUE(stats.insert_steps == 3);
+    LTEST_TRUE(stats.wrap_lines == 2);
+    LTEST_TRUE(stats.fill_lines == 1);
+    LTEST_TRUE(stats.solved_fill_lines == 1);
+    LTEST_TRUE(stats.squeeze_lines == 0);
+    // The item buffer, and the ext buffer for the min size
+    LTEST_TRUE(stats.reallocs == 2);
+    LTEST_TRUE(stats.bytes_allocated ==
+        32 * (sizeof(lay_item_t) + sizeof(lay_vec4) + sizeof(lay_id) + sizeof(lay_item_ext)));
+
+    // Running again does the same work, without allocating
+    lay_reset_stats(&sctx);
+    lay_run_context(&sctx);
+    lay_get_stats(&sctx, &stats);
+    LTEST_TRUE(stats.items_visited[0] == 9 && stats.items_visited[3] == 9);
+    LTEST_TRUE(stats.wrap_lines == 2 && stats.insert_steps == 0);
+    LTEST_TRUE(stats.reallocs == 0 && stats.bytes_allocated == 0);
+    lay_destroy_context(&sctx);
+}
+#endif
+
+#ifdef LAY_TRACE
+typedef struct ltest_buffer {
+    char data[4096];
+    size_t size;
+} ltest_buffer;
+
+static void ltest_buffer_write(void *user, const char *data, size_t size)
+{
+    ltest_buffer *buf = (ltest_buffer*)user;
+    LTEST_TRUE(buf->size + size < sizeof(buf->data));
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    buf->data[buf->size] = '\0';
+}
+
+static int ltest_count(const char *haystack, const char *needle)
+{
+    int count = 0;
+    for (const char *p = strstr(haystack, needle); p != NULL; p = strstr(p + 1, needle))
+        ++count;
+    return count;
+}
+
+LTEST_DECLARE(trace_events)
+{
+    // root > panel > 3 leaves, and a leaf directly in root
+    lay_id root = lay_item(ctx);
+    lay_set_size_xy(ctx, root, 100, 100);
+    lay_id panel = lay_item(ctx);
+    lay_insert(ctx, root, panel);
+    for (int i = 0; i < 3; ++i) {
+        lay_id leaf = lay_item(ctx);
+        lay_set_size_xy(ctx, leaf, 10, 10);
+        lay_insert(ctx, panel, leaf);
+    }
+    lay_id leaf = lay_item(ctx);
+    lay_insert(ctx, root, leaf);
+    lay_set_trace_tag(ctx, root, "root");
+    lay_set_trace_tag(ctx, panel, "a \"panel\"");
+
+    // Only root (6 items) and panel (4 items) are traced. The first run
+    // doesn't know the subtree sizes yet when it sizes the widths.
+    lay_trace_start(ctx, 64, 4);
+    lay_run_context(ctx);
+    ltest_buffer buf;
+    buf.size = 0;
+    LTEST_TRUE(lay_trace_write_json(ctx, ltest_buffer_write, &buf) == 6);
+    lay_run_context(ctx);
+    buf.size = 0;
+    LTEST_TRUE(lay_trace_write_json(ctx, ltest_buffer_write, &buf) == 14);
+    LTEST_TRUE(ltest_count(buf.data, "\"tag\":\"root\"") == 7);
+    LTEST_TRUE(ltest_count(buf.data, "\"tag\":\"a \\\"panel\\\"\"") == 7);
+    LTEST_TRUE(ltest_count(buf.data, "\"name\":\"calc_size x\"") == 2);
+    LTEST_TRUE(ltest_count(buf.data, "\"item\":1,") == 7);
+    LTEST_TRUE(strstr(buf.data, "\"dropped_events\":\"0\"") != NULL);
+
+    // The ring keeps the last 5 events. Stopping keeps them.
+    lay_trace_start(ctx, 5, 1);
+    lay_run_context(ctx);
+    lay_trace_stop(ctx);
+    lay_run_context(ctx);
+    buf.size = 0;
+    LTEST_TRUE(lay_trace_write_json(ctx, ltest_buffer_write, &buf) == 5);
+    LTEST_TRUE(strstr(buf.data, "\"dropped_events\":\"19\"") != NULL);
+    LTEST_TRUE(ltest_count(buf.data, "\"ph\":\"X\"") == 5);
+
+    // New items don't keep the tags of old ones with the same id
+    lay_reset_context(ctx);
+    lay_item(ctx);
+    lay_trace_start(ctx, 8, 1);
+    lay_run_context(ctx);
+    lay_run_context(ctx);
+    buf.size = 0;
+    LTEST_TRUE(lay_trace_write_json(ctx, ltest_buffer_write, &buf) == 8);
+    LTEST_TRUE(strstr(buf.data, "tag") == NULL);
+    lay_trace_stop(ctx);
+}
+#endif
+
+#ifdef LAY_PUBLISH
+LTEST_DECLARE(publish_rects)
+{
+    // A fresh context, so that there are no snapshots yet
+    (void)ctx;
+    lay_context pctx;
+    lay_init_context(&pctx);
+    LTEST_TRUE(lay_acquire_rects(&pctx) == NULL);
+
+    build_memory_tree(&pctx, 3);
+    lay_run_context(&pctx);
+    LTEST_TRUE(lay_publish_rects(&pctx) == 1);
+    const lay_snapshot *first = lay_acquire_rects(&pctx);
+    LTEST_TRUE(first != NULL && first->epoch == 1 && first->count == 4);
+    LTEST_VEC4EQ(first->rects[2], 10, 0, 90, 10);
+
+    // A held snapshot doesn't change while the context is rebuilt and newer
+    // snapshots are published
+    lay_reset_context(&pctx);
+    build_memory_tree(&pctx, 999);
+    lay_run_context(&pctx);
+    LTEST_TRUE(lay_publish_rects(&pctx) == 2);
+    const lay_snapshot *second = lay_acquire_rects(&pctx);
+    LTEST_TRUE(second != first && second->epoch == 2 && second->count == 1000);
+    LTEST_VEC4EQ(second->rects[999], 0, 4990, 10, 10);
+    LTEST_TRUE(first->count == 4);
+    LTEST_VEC4EQ(first->rects[2], 10, 0, 90, 10);
+
+    // Once every buffer but the newest is held, publishing fails and readers
+    // keep getting the newest snapshot
+    uint64_t epoch = 2;
+    for (int i = 2; i < LAY_PUBLISH_BUFFERS && epoch < 10; ++i) {
+        uint64_t next = lay_publish_rects(&pctx);
+        if (next == 0)
+            break;
+        LTEST_TRUE(next == epoch + 1);
+        epoch = next;
+    }
+#if LAY_PUBLISH_BUFFERS <= 3
+    LTEST_TRUE(lay_publish_rects(&pctx) == 0);
+    const lay_snapshot *newest = lay_acquire_rects(&pctx);
+    LTEST_TRUE(newest->epoch == epoch);
+    lay_release_rects(&pctx, newest);
+#endif
+
+    lay_release_rects(&pctx, first);
+    lay_release_rects(&pctx, second);
+    LTEST_TRUE(lay_publish_rects(&pctx) == epoch + 1);
+
+    // Shrinking keeps only the newest snapshot
+    lay_shrink_to_fit(&pctx);
+    lay_memory memory;
+    lay_memory_usage(&pctx, &memory);
+    const lay_snapshot *last = lay_acquire_rects(&pctx);
+    LTEST_TRUE(memory.snapshots == last->capacity * sizeof(lay_vec4));
+    LTEST_TRUE(last->epoch == epoch + 1);
+    LTEST_VEC4EQ(last->rects[999], 0, 4990, 10, 10);
+    lay_release_rects(&pctx, last);
+
+    lay_destroy_context(&pctx);
+}
+#endif
+
+#if LAY_ID_BITS == 16
+LTEST_DECLARE(id_limit)
+{
+    // Capacity grows 32, 128, ..., 32768, and is then clamped so that the
+    // last id isn't LAY_INVALID_ID
+    lay_id root = lay_item(ctx);
+    lay_id last = root;
+    while (lay_items_count(ctx) < LAY_INVALID_ID) {
+        last = lay_item(ctx);
+        lay_insert(ctx, root, last);
+    }
+    LTEST_TRUE(last == LAY_INVALID_ID - 1);
+    LTEST_TRUE(lay_items_capacity(ctx) == LAY_INVALID_ID);
+
+    lay_set_size_xy(ctx, root, 10, 10);
+    lay_set_behave(ctx, last, LAY_FILL);
+    lay_run_context(ctx);
+    LTEST_VEC4EQ(lay_get_rect(ctx, last), 0, 0, 10, 10);
+    LTEST_TRUE(lay_next_sibling(ctx, last) == LAY_INVALID_ID);
+
+#ifdef NDEBUG
+    // One more item is refused without touching the existing ones
+    LTEST_TRUE(lay_item(ctx) == LAY_INVALID_ID);
+    LTEST_TRUE(lay_items_count(ctx) == LAY_INVALID_ID);
+    LTEST_VEC4EQ(lay_get_rect(ctx, root), 0, 0, 10, 10);
+    LTEST_TRUE(lay_first_child(ctx, root) == 1);
+#endif
+}
+#endif
+
 // Call in main to run a test by name
 //
 // Resets string buffer and lay context before running test
@@ -948,6 +2028,12 @@ int main(int argc, char** argv)
     LTEST_RUN(multiple_uninserted);
     LTEST_RUN(column_even_fill);
     LTEST_RUN(row_even_fill);
+#ifndef LAY_FLOAT
+    LTEST_RUN(row_uneven_fill);
+    LTEST_RUN(justify_uneven);
+    LTEST_RUN(squeeze_uneven);
+    LTEST_RUN(row_fill_exact);
+#endif
     LTEST_RUN(fixed_and_fill);
     LTEST_RUN(simple_margins_1);
     LTEST_RUN(nested_boxes_1);
@@ -964,8 +2050,37 @@ int main(int argc, char** argv)
     LTEST_RUN(wrap_column_2);
     LTEST_RUN(wrap_column_3);
     LTEST_RUN(wrap_column_4);
+    LTEST_RUN(wrap_row_rerun);
+    LTEST_RUN(wrap_lines);
     LTEST_RUN(anchor_right_margin1);
     LTEST_RUN(anchor_right_margin2);
+    LTEST_RUN(min_max_size);
+    LTEST_RUN(fill_min_max);
+    LTEST_RUN(squeeze_min);
+    LTEST_RUN(grid_tracks);
+    LTEST_RUN(grid_auto_size);
+    LTEST_RUN(gap_stacked);
+    LTEST_RUN(gap_wrapped);
+    LTEST_RUN(gap_grid);
+    LTEST_RUN(weighted_fill);
+    LTEST_RUN(weighted_shrink);
+    LTEST_RUN(memory_shrink);
+    LTEST_RUN(copy_context);
+#ifdef LAY_RECORD
+    LTEST_RUN(record_replay);
+#endif
+#ifdef LAY_STATS
+    LTEST_RUN(work_stats);
+#endif
+#ifdef LAY_TRACE
+    LTEST_RUN(trace_events);
+#endif
+#ifdef LAY_PUBLISH
+    LTEST_RUN(publish_rects);
+#endif
+#if LAY_ID_BITS == 16
+    LTEST_RUN(id_limit);
+#endif
 
     printf("Finished tests\n");
 
@@ -7,7 +7,7 @@ Usage: tool.bash [options] command [args]
 Commands:
     build <config> <target>
         Configs: debug, release
-        Targets: tests, bench
+        Targets: tests, bench, codegen, differential, async, ffi
         Output: build/<config>/<target>
     clean
         Removes build/
@@ -224,6 +224,12 @@ build_target() {
   if [[ $lang = c ]]; then
     add cc_flags -Wstrict-prototypes
   fi
+  case $os in
+    linux|cygwin*|*bsd*)
+      # -std=c99 hides clock_gettime, which LAY_TRACE and lay_bench time with
+      add cc_flags -D_POSIX_C_SOURCE=200809L
+      ;;
+  esac
   if [[ $cc_id = clang ]]; then
     # We use int16_t on the stack and in math expressions. With -Wconversion,
     # GCC will be spammy about int16_t to and from int. Clang won't issue
@@ -306,19 +312,55 @@ build_target() {
     bench|benchmark)
       add cc_flags -isystem thirdparty
       add source_files benchmark_layout.c
+      add libraries -lm
       case $os in
         linux|cygwin*|*bsd*)
           # librt and high-res posix timers on Linux (and BSD?)
           add libraries -lrt
-          add cc_flags -D_POSIX_C_SOURCE=200809L
+          # pthreads for lay_bench threads
+          add cc_flags -pthread
           ;;
       esac
       out_exe=lay_bench
       ;;
+    codegen)
+      add source_files codegen_layout.c
+      out_exe=lay_codegen
+      ;;
+    diff|differential)
+      add source_files differential_layout.c
+      out_exe=lay_differential
+      ;;
+    async)
+      add source_files async_layout.c
+      # pthreads for the worker thread in layout_async.h
+      case $os in
+        mac|linux|cygwin*|*bsd*) add cc_flags -pthread;;
+      esac
+      out_exe=lay_async
+      ;;
+    ffi)
+      # Shared library for layout_ffi.lua
+      add source_files ffi_layout.c
+      add cc_flags -shared -fPIC -fvisibility=hidden
+      case $os in
+        mac) out_exe=liblayout_ffi.dylib;;
+        cygwin) out_exe=layout_ffi.dll;;
+        *) out_exe=liblayout_ffi.so;;
+      esac
+      ;;
   esac
   try_make_dir "$build_dir"
   try_make_dir "$build_dir/$build_subdir"
   local out_path=$build_dir/$build_subdir/$out_exe
+  if [[ $out_exe = lay_codegen ]]; then
+    # Two steps: build and run the generator, then build the verifier with the
+    # generated code included.
+    local gen_path=$build_dir/$build_subdir/lay_codegen_gen
+    verbose_echo "$cc_exe" "${cc_flags[@]}" -o "$gen_path" "${source_files[@]}"
+    verbose_echo "$gen_path" > "$build_dir/$build_subdir/lay_codegen_out.c"
+    add cc_flags -DLAY_CODEGEN_VERIFY -I "$build_dir/$build_subdir"
+  fi
   # bash versions quirk: empty arrays might give error on expansion, use +
   # trick to avoid expanding second operand
   verbose_echo timed_stats "$cc_exe" "${cc_flags[@]}" -o "$out_path" "${source_files[@]}" ${libraries[@]+"${libraries[@]}"}